@@ -4,6 +4,11 @@
 
 #include <stdio.h>
 
+typedef struct AIProvider AIProvider;
+
+/* Called with the reply text received so far while a streamed reply arrives. */
+typedef void (*AIStreamHook)(void *user, const char *text, size_t len);
+
 typedef struct {
     char *ai_type;
     char *input_file;
@@ -16,19 +21,72 @@ typedef struct {
     int verbose;
     int agentMode;
     int agentThinking;
+    char *session_name;
+    int session_turns;
+    char *trace_file;
+    char *endpoint;
+    char *metrics_textfile;
+    char *metrics_log;
+    int mem_stats;
+    int warmup;
+    char *keep_alive;
+    int pin;
+    char *pin_models;
+    char *ollama_context;
+    const char *json_schema;
+    int repl;
+    int stream;
+    FILE *stream_out;
+    size_t stream_echoed;
+    AIStreamHook stream_hook;
+    void *stream_hook_user;
+    int jsonl;
+    int retries;
+    int singleflight;
+    double deadline;
+    double timeout;
+    int max_steps;
+    const AIProvider *provider;
 } AIConfig;
 
 typedef int (*AIHandler)(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out);
 
+#define AI_REQUEST_MAX_HEADERS 8
+
+/* One provider HTTP call: built by an AIRequestBuilder, sent by request_perform or the async core. */
+typedef struct {
+    char *url;
+    char *body;
+    char *headers[AI_REQUEST_MAX_HEADERS];
+    size_t headerCount;
+    int stream;
+} AIRequest;
+
+typedef int (*AIRequestBuilder)(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req);
+
 int ai_execute(AIConfig *cfg);
 char* read_file(const char *path);
 char* read_stdin(void);
 char* get_api_key(AIConfig *cfg);
+char* get_ai_dir(const char *subdir);
 int http_post(const char *url, const char *headers, const char *body, FILE *out);
+void http_set_retries(int retries);
+void http_set_timeout(double seconds);
+int request_set(AIRequest *req, const char *url, const char *body);
+int request_add_header(AIRequest *req, const char *header);
+int request_perform(const AIRequest *req, FILE *out);
+void request_free(AIRequest *req);
 char* extract_response(const char *ai_type, const char *json);
 
+int chatgpt_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req);
+int ollama_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req);
+int claude_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req);
+int deepseek_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req);
+
 int chatgpt_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out);
 int ollama_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out);
+int ollama_warmup(AIConfig *cfg);
+char* ollama_extract_context(const char *json);
 int claude_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out);
 int deepseek_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out);
 
@@ -3,8 +3,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "ai.h"
+#include "ai_core/jsonEscape.h"
+#include "ai_core/providers.h"
+#include "ai_core/trace.h"
 
-static char* escape_json(const char *str) {
+char* claudeEscapeJson(const char *str) {
     size_t len = strlen(str);
     char *esc = malloc(len * 2 + 1);
     char *p = esc;
@@ -23,35 +26,62 @@ static char* escape_json(const char *str) {
     return esc;
 }
 
-int claude_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
+int claude_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req) {
+    memset(req, 0, sizeof(*req));
+    TraceSpan bodySpan = traceBegin("provider", "build_body");
+    const AIProvider *provider = providerForConfig(cfg, "claude");
     char *key = get_api_key(cfg);
-    if (!key) {
+    if (!key && provider->authHeader) {
         fprintf(stderr, "No API key provided\n");
+        traceEnd(&bodySpan, "{\"ok\":false,\"error\":\"no api key\"}");
         return 1;
     }
     
-    const char *model = cfg->model ? cfg->model : "claude-3-5-sonnet-20241022";
+    const char *model = cfg->model ? cfg->model : provider->model;
     
-    char *esc_input = escape_json(input);
-    char *esc_sys = sys_prompt ? escape_json(sys_prompt) : NULL;
+    char *esc_input = claudeEscapeJson(input);
+    char *esc_sys = sys_prompt ? claudeEscapeJson(sys_prompt) : NULL;
     
-    char body[65536];
-    snprintf(body, sizeof(body),
-        "{\"model\":\"%s\",\"max_tokens\":4096%s%s%s,\"messages\":[{\"role\":\"user\",\"content\":\"%s\"}]}",
+    size_t bodyLen = strlen(model) + (esc_input ? strlen(esc_input) : 0) + (esc_sys ? strlen(esc_sys) : 0) + 256;
+    char *body = esc_input ? malloc(bodyLen) : NULL;
+    if (!body) {
+        free(esc_input);
+        free(esc_sys);
+        traceEnd(&bodySpan, "{\"ok\":false,\"error\":\"out of memory\"}");
+        return 1;
+    }
+    /* No JSON mode here: prefilling the reply with '{' commits it to an object. callAiOnce restores the brace. */
+    snprintf(body, bodyLen,
+        "{\"model\":\"%s\",\"max_tokens\":4096%s%s%s%s,\"messages\":[{\"role\":\"user\",\"content\":\"%s\"}%s]}",
         model,
+        (cfg->stream_out || cfg->stream_hook) ? ",\"stream\":true" : "",
         esc_sys ? ",\"system\":\"" : "",
         esc_sys ? esc_sys : "",
         esc_sys ? "\"" : "",
-        esc_input);
+        esc_input,
+        cfg->json_schema ? ",{\"role\":\"assistant\",\"content\":\"{\"}" : "");
     
-    char headers[512];
-    snprintf(headers, sizeof(headers),
-        "-H 'Content-Type: application/json' -H 'x-api-key: %s' -H 'anthropic-version: 2023-06-01'",
-        key);
+    char auth[768];
+    providerAuthHeader(provider, key, auth, sizeof(auth));
+    req->stream = cfg->stream_out || cfg->stream_hook;
+    int ret = request_set(req, cfg->endpoint ? cfg->endpoint : provider->url, body) != 0 ||
+              request_add_header(req, "Content-Type: application/json") != 0 ||
+              request_add_header(req, auth) != 0 ||
+              request_add_header(req, "anthropic-version: 2023-06-01") != 0 ? 1 : 0;
+    if (ret) request_free(req);
     
-    int ret = http_post("https://api.anthropic.com/v1/messages", headers, body, out);
+    traceEnd(&bodySpan, NULL);
+    free(body);
     free(esc_input);
     if (esc_sys) free(esc_sys);
     
     return ret;
 }
+
+int claude_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
+    AIRequest req;
+    if (claude_build(cfg, input, sys_prompt, &req) != 0) return 1;
+    int ret = request_perform(&req, out);
+    request_free(&req);
+    return ret;
+}
@@ -3,8 +3,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "ai.h"
+#include "ai_core/jsonEscape.h"
+#include "ai_core/providers.h"
+#include "ai_core/trace.h"
 
-static char* escape_json(const char *str) {
+char* deepseekEscapeJson(const char *str) {
     size_t len = strlen(str);
     char *esc = malloc(len * 2 + 1);
     char *p = esc;
@@ -23,37 +26,61 @@ static char* escape_json(const char *str) {
     return esc;
 }
 
-int deepseek_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
+int deepseek_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req) {
+    memset(req, 0, sizeof(*req));
+    TraceSpan bodySpan = traceBegin("provider", "build_body");
+    const AIProvider *provider = providerForConfig(cfg, "deepseek");
     char *key = get_api_key(cfg);
-    if (!key) {
+    if (!key && provider->authHeader) {
         fprintf(stderr, "No API key provided\n");
+        traceEnd(&bodySpan, "{\"ok\":false,\"error\":\"no api key\"}");
         return 1;
     }
     
-    const char *model = cfg->model ? cfg->model : "deepseek-chat";
-    
-    char *esc_input = escape_json(input);
-    char *esc_sys = sys_prompt ? escape_json(sys_prompt) : NULL;
+    const char *model = cfg->model ? cfg->model : provider->model;
     
-    char body[65536];
-    int pos = snprintf(body, sizeof(body),
-        "{\"model\":\"%s\",\"messages\":[", model);
+    char *esc_input = deepseekEscapeJson(input);
+    char *esc_sys = sys_prompt ? deepseekEscapeJson(sys_prompt) : NULL;
     
-    if (esc_sys) {
-        pos += snprintf(body + pos, sizeof(body) - pos,
-            "{\"role\":\"system\",\"content\":\"%s\"},", esc_sys);
+    size_t bodyLen = strlen(model) + (esc_input ? strlen(esc_input) : 0) + (esc_sys ? strlen(esc_sys) : 0) + 256;
+    char *body = esc_input ? malloc(bodyLen) : NULL;
+    if (!body) {
+        free(esc_input);
+        free(esc_sys);
+        traceEnd(&bodySpan, "{\"ok\":false,\"error\":\"out of memory\"}");
+        return 1;
     }
+    snprintf(body, bodyLen,
+        "{\"model\":\"%s\",\"messages\":[%s%s%s{\"role\":\"user\",\"content\":\"%s\"}]%s%s}",
+        model,
+        esc_sys ? "{\"role\":\"system\",\"content\":\"" : "",
+        esc_sys ? esc_sys : "",
+        esc_sys ? "\"}," : "",
+        esc_input,
+        (cfg->stream_out || cfg->stream_hook) ? ",\"stream\":true,\"stream_options\":{\"include_usage\":true}" : "",
+        /* DeepSeek has JSON mode but no schemas; the prompt carries the shape. */
+        cfg->json_schema ? ",\"response_format\":{\"type\":\"json_object\"}" : "");
     
-    pos += snprintf(body + pos, sizeof(body) - pos,
-        "{\"role\":\"user\",\"content\":\"%s\"}]}", esc_input);
-    
-    char headers[512];
-    snprintf(headers, sizeof(headers),
-        "-H 'Content-Type: application/json' -H 'Authorization: Bearer %s'", key);
+    char auth[768];
+    providerAuthHeader(provider, key, auth, sizeof(auth));
+    req->stream = cfg->stream_out || cfg->stream_hook;
+    int ret = request_set(req, cfg->endpoint ? cfg->endpoint : provider->url, body) != 0 ||
+              request_add_header(req, "Content-Type: application/json") != 0 ||
+              request_add_header(req, auth) != 0 ? 1 : 0;
+    if (ret) request_free(req);
     
-    int ret = http_post("https://api.deepseek.com/chat/completions", headers, body, out);
+    traceEnd(&bodySpan, NULL);
+    free(body);
     free(esc_input);
     if (esc_sys) free(esc_sys);
     
     return ret;
 }
+
+int deepseek_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
+    AIRequest req;
+    if (deepseek_build(cfg, input, sys_prompt, &req) != 0) return 1;
+    int ret = request_perform(&req, out);
+    request_free(&req);
+    return ret;
+}
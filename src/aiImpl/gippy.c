@@ -4,8 +4,11 @@
 #include <string.h>
 #include <ctype.h>
 #include "ai.h"
+#include "ai_core/jsonEscape.h"
+#include "ai_core/providers.h"
+#include "ai_core/trace.h"
 
-static void escape_json_str(const char *str, char *out, size_t max) {
+void chatgptEscapeJson(const char *str, char *out, size_t max) {
     char *p = out;
     size_t remaining = max - 1;
     
@@ -39,39 +42,69 @@ static void escape_json_str(const char *str, char *out, size_t max) {
     *p = '\0';
 }
 
-int chatgpt_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
+int chatgpt_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req) {
+    memset(req, 0, sizeof(*req));
+    TraceSpan bodySpan = traceBegin("provider", "build_body");
+    const AIProvider *provider = providerForConfig(cfg, "chatgpt");
     char *key = get_api_key(cfg);
-    if (!key) {
-        fprintf(stderr, "No API key for chatgpt\n");
+    if (!key && provider->authHeader) {
+        fprintf(stderr, "No API key for %s\n", provider->name);
+        traceEnd(&bodySpan, "{\"ok\":false,\"error\":\"no api key\"}");
         return 1;
     }
     
-    const char *model = cfg->model ? cfg->model : "gpt-4";
-    
-    char esc_input[32768];
-    char esc_sys[32768];
+    const char *model = cfg->model ? cfg->model : provider->model;
     
-    escape_json_str(input, esc_input, sizeof(esc_input));
-    if (sys_prompt) {
-        escape_json_str(sys_prompt, esc_sys, sizeof(esc_sys));
+    /* Escaping at most doubles the text; chatgptEscapeJson also wants a little slack at the end. */
+    size_t inputSize = strlen(input) * 2 + 8;
+    size_t sysSize = sys_prompt ? strlen(sys_prompt) * 2 + 8 : 0;
+    char *esc_input = malloc(inputSize);
+    char *esc_sys = sys_prompt ? malloc(sysSize) : NULL;
+    size_t bodyLen = strlen(model) + inputSize + sysSize + (cfg->json_schema ? strlen(cfg->json_schema) : 0) + 256;
+    char *body = esc_input && (esc_sys || !sys_prompt) ? malloc(bodyLen) : NULL;
+    if (!body) {
+        free(esc_input);
+        free(esc_sys);
+        traceEnd(&bodySpan, "{\"ok\":false,\"error\":\"out of memory\"}");
+        return 1;
     }
     
-    char body[65536];
-    int n = 0;
-    
-    n += snprintf(body + n, sizeof(body) - n, "{\"model\":\"%s\",\"messages\":[", model);
-    
+    chatgptEscapeJson(input, esc_input, inputSize);
     if (sys_prompt) {
-        n += snprintf(body + n, sizeof(body) - n,
-            "{\"role\":\"system\",\"content\":\"%s\"},", esc_sys);
+        chatgptEscapeJson(sys_prompt, esc_sys, sysSize);
     }
     
-    n += snprintf(body + n, sizeof(body) - n,
-        "{\"role\":\"user\",\"content\":\"%s\"}]}", esc_input);
+    snprintf(body, bodyLen,
+        "{\"model\":\"%s\",\"messages\":[%s%s%s{\"role\":\"user\",\"content\":\"%s\"}]%s%s%s%s}",
+        model,
+        esc_sys ? "{\"role\":\"system\",\"content\":\"" : "",
+        esc_sys ? esc_sys : "",
+        esc_sys ? "\"}," : "",
+        esc_input,
+        (cfg->stream_out || cfg->stream_hook) ? ",\"stream\":true,\"stream_options\":{\"include_usage\":true}" : "",
+        cfg->json_schema ? ",\"response_format\":{\"type\":\"json_schema\",\"json_schema\":{\"name\":\"reply\",\"strict\":true,\"schema\":" : "",
+        cfg->json_schema ? cfg->json_schema : "",
+        cfg->json_schema ? "}}" : "");
     
-    char headers[1024];
-    snprintf(headers, sizeof(headers),
-        "-H 'Content-Type: application/json' -H 'Authorization: Bearer %s'", key);
+    char auth[768];
+    providerAuthHeader(provider, key, auth, sizeof(auth));
+    req->stream = cfg->stream_out || cfg->stream_hook;
+    int ret = request_set(req, cfg->endpoint ? cfg->endpoint : provider->url, body) != 0 ||
+              request_add_header(req, "Content-Type: application/json") != 0 ||
+              request_add_header(req, auth) != 0 ? 1 : 0;
+    if (ret) request_free(req);
     
-    return http_post("https://api.openai.com/v1/chat/completions", headers, body, out);
+    traceEnd(&bodySpan, NULL);
+    free(body);
+    free(esc_input);
+    free(esc_sys);
+    return ret;
+}
+
+int chatgpt_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
+    AIRequest req;
+    if (chatgpt_build(cfg, input, sys_prompt, &req) != 0) return 1;
+    int ret = request_perform(&req, out);
+    request_free(&req);
+    return ret;
 }
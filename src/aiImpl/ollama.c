@@ -1,10 +1,16 @@
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "ai.h"
+#include "ai_core/jsonEscape.h"
+#include "ai_core/providers.h"
+#include "ai_core/trace.h"
 
-static char* escape_json(const char *str) {
+char* ollamaEscapeJson(const char *str) {
     size_t len = strlen(str);
     char *esc = malloc(len * 2 + 1);
     char *p = esc;
@@ -23,26 +29,173 @@ static char* escape_json(const char *str) {
     return esc;
 }
 
-int ollama_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
-    const char *model = cfg->model ? cfg->model : "llama2";
+static int modelPinned(const AIConfig *cfg, const char *model) {
+    if (!cfg->pin) return 0;
+    /* A bare --pin pins the run's own model. */
+    if (!cfg->pin_models) return 1;
+    size_t len = strlen(model);
+    for (const char *p = cfg->pin_models; *p; ) {
+        const char *end = strchr(p, ',');
+        size_t itemLen = end ? (size_t)(end - p) : strlen(p);
+        if (itemLen == len && strncmp(p, model, len) == 0) return 1;
+        if (!end) break;
+        p = end + 1;
+    }
+    return 0;
+}
+
+/* Writes ,"keep_alive":... for model; plain integers are seconds, anything else an ollama duration ("30m"). */
+static void keepAliveField(const AIConfig *cfg, const AIProvider *provider, const char *model, char *out, size_t max) {
+    const char *value = modelPinned(cfg, model) ? "-1" : cfg->keep_alive ? cfg->keep_alive : provider->keepAlive;
+    if (!value || !*value || strpbrk(value, "\"\\")) {
+        if (max) out[0] = '\0';
+        return;
+    }
+    const char *digits = value[0] == '-' ? value + 1 : value;
+    int numeric = *digits && strspn(digits, "0123456789") == strlen(digits);
+    snprintf(out, max, numeric ? ",\"keep_alive\":%s" : ",\"keep_alive\":\"%s\"", value);
+}
+
+/* Fires an empty-prompt /api/generate, which makes ollama load model, from a detached curl. */
+static int spawnLoad(AIConfig *cfg, const AIProvider *provider, const char *url, const char *model) {
+    char keepAlive[96];
+    keepAliveField(cfg, provider, model, keepAlive, sizeof(keepAlive));
+    char body[512];
+    snprintf(body, sizeof(body), "{\"model\":\"%s\"%s}", model, keepAlive);
+    char auth[768] = "";
+    const char *key = provider->authHeader ? get_api_key(cfg) : NULL;
+    if (key) snprintf(auth, sizeof(auth), "%s %s", provider->authHeader, key);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (fork() != 0) _exit(0);
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        if (*auth) {
+            execlp("curl", "curl", "-s", "-o", "/dev/null", "-X", "POST", url, "-H", "Content-Type: application/json",
+                   "-H", auth, "-d", body, (char *)NULL);
+        } else {
+            execlp("curl", "curl", "-s", "-o", "/dev/null", "-X", "POST", url, "-H", "Content-Type: application/json",
+                   "-d", body, (char *)NULL);
+        }
+        _exit(127);
+    }
+    if (pid < 0) return 0;
+    waitpid(pid, NULL, 0);
+    if (cfg->verbose) fprintf(stderr, "[ollama] loading %s%s\n", model, modelPinned(cfg, model) ? " (pinned)" : "");
+    return 1;
+}
+
+/*
+ * --warmup and --pin: start model loads before the input is read so the
+ * multi-second cold load overlaps it. ollama queues the real request behind
+ * a load already in flight, so nothing here is waited on.
+ */
+int ollama_warmup(AIConfig *cfg) {
+    const AIProvider *provider = providerForConfig(cfg, "ollama");
+    const char *url = cfg->endpoint ? cfg->endpoint : provider->url;
+    const char *model = cfg->model ? cfg->model : provider->model;
+    if (!url || !model) return 0;
+
+    int started = 0;
+    int runModelLoaded = 0;
+    if (cfg->warmup || (cfg->pin && !cfg->pin_models)) {
+        started += spawnLoad(cfg, provider, url, model);
+        runModelLoaded = 1;
+    }
+    if (cfg->pin && cfg->pin_models) {
+        char name[256];
+        for (const char *p = cfg->pin_models; *p; ) {
+            const char *end = strchr(p, ',');
+            size_t itemLen = end ? (size_t)(end - p) : strlen(p);
+            if (itemLen > 0 && itemLen < sizeof(name)) {
+                memcpy(name, p, itemLen);
+                name[itemLen] = '\0';
+                if (!(runModelLoaded && strcmp(name, model) == 0)) started += spawnLoad(cfg, provider, url, name);
+            }
+            if (!end) break;
+            p = end + 1;
+        }
+    }
+    return started;
+}
+
+/* Copies the "context" token array out of a non-streamed /api/generate reply, or NULL. */
+char* ollama_extract_context(const char *json) {
+    const char *start = json ? strstr(json, "\"context\"") : NULL;
+    if (!start) return NULL;
+    start = strchr(start, '[');
+    const char *end = start ? strchr(start, ']') : NULL;
+    if (!end || end - start < 2) return NULL;
+
+    size_t len = (size_t)(end - start) + 1;
+    char *copy = malloc(len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, start, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+int ollama_build(AIConfig *cfg, const char *input, const char *sys_prompt, AIRequest *req) {
+    memset(req, 0, sizeof(*req));
+    TraceSpan bodySpan = traceBegin("provider", "build_body");
+    const AIProvider *provider = providerForConfig(cfg, "ollama");
+    const char *model = cfg->model ? cfg->model : provider->model;
+    const char *context = cfg->ollama_context;
     
-    char *esc_input = escape_json(input);
-    char *esc_sys = sys_prompt ? escape_json(sys_prompt) : NULL;
+    char *esc_input = ollamaEscapeJson(input);
+    /* The system prompt is already inside a reused context; ollama would render it again. */
+    char *esc_sys = sys_prompt && !context ? ollamaEscapeJson(sys_prompt) : NULL;
     
-    char body[65536];
-    snprintf(body, sizeof(body),
-        "{\"model\":\"%s\",\"prompt\":\"%s\",\"stream\":false%s%s%s}",
-        model, esc_input,
+    char keepAlive[96];
+    keepAliveField(cfg, provider, model, keepAlive, sizeof(keepAlive));
+    size_t bodyLen = strlen(model) + strlen(esc_input) + (esc_sys ? strlen(esc_sys) : 0) +
+                     (context ? strlen(context) : 0) + (cfg->json_schema ? strlen(cfg->json_schema) : 0) +
+                     strlen(keepAlive) + 112;
+    char *body = malloc(bodyLen);
+    if (!body) {
+        free(esc_input);
+        free(esc_sys);
+        traceEnd(&bodySpan, "{\"ok\":false,\"error\":\"out of memory\"}");
+        return 1;
+    }
+    snprintf(body, bodyLen,
+        "{\"model\":\"%s\",\"prompt\":\"%s\",\"stream\":%s%s%s%s%s%s%s%s%s}",
+        model, esc_input, (cfg->stream_out || cfg->stream_hook) ? "true" : "false",
         esc_sys ? ",\"system\":\"" : "",
         esc_sys ? esc_sys : "",
-        esc_sys ? "\"" : "");
+        esc_sys ? "\"" : "",
+        context ? ",\"context\":" : "",
+        context ? context : "",
+        cfg->json_schema ? ",\"format\":" : "",
+        cfg->json_schema ? cfg->json_schema : "",
+        keepAlive);
     
-    char headers[256];
-    snprintf(headers, sizeof(headers), "-H 'Content-Type: application/json'");
+    char *key = get_api_key(cfg);
+    char auth[768];
+    providerAuthHeader(provider, key, auth, sizeof(auth));
+    req->stream = cfg->stream_out || cfg->stream_hook;
+    int ret = request_set(req, cfg->endpoint ? cfg->endpoint : provider->url, body) != 0 ||
+              request_add_header(req, "Content-Type: application/json") != 0 ||
+              request_add_header(req, auth) != 0 ? 1 : 0;
+    if (ret) request_free(req);
     
-    int ret = http_post("http://localhost:11434/api/generate", headers, body, out);
+    traceEnd(&bodySpan, NULL);
+    free(body);
     free(esc_input);
     if (esc_sys) free(esc_sys);
     
     return ret;
 }
+
+int ollama_call(AIConfig *cfg, const char *input, const char *sys_prompt, FILE *out) {
+    AIRequest req;
+    if (ollama_build(cfg, input, sys_prompt, &req) != 0) return 1;
+    int ret = request_perform(&req, out);
+    request_free(&req);
+    return ret;
+}
@@ -2,9 +2,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include "ai.h"
 #include "ai_core/agent.h"
 #include "ai_core/core.h"
+#include "ai_core/deadline.h"
+#include "ai_core/providers.h"
+#include "ai_core/subagent.h"
+#include "ai_core/trace.h"
+#include "ai_core/usage.h"
 #include "tools.h"
 
 static char* duplicateString(const char *src) {
@@ -35,37 +41,206 @@ static char* formatString(const char *fmt, ...) {
     return buffer;
 }
 
-static char* invokeAgentTool(const char *name, const char *input, char **error_out) {
-    if (!name) {
-        if (error_out) *error_out = duplicateString("No tool name provided by the agent.");
+/*
+ * The reply shape buildAgentSystemPrompt asks for, as a schema the providers
+ * can enforce. The tool fields come before message so that a streamed reply
+ * closes them early.
+ */
+static const char *agentReplySchema =
+    "{\"type\":\"object\",\"properties\":{"
+    "\"status\":{\"type\":\"string\",\"enum\":[\"continue\",\"done\"]},"
+    "\"tool\":{\"type\":\"string\"},\"toolInput\":{\"type\":\"string\"},\"message\":{\"type\":\"string\"}},"
+    "\"required\":[\"status\",\"tool\",\"toolInput\",\"message\"],\"additionalProperties\":false}";
+
+static int agentReplyValid(const char *response) {
+    char *status = find_json_string(response, "status");
+    char *tool = find_json_string(response, "tool");
+    int valid = status && (strcmp(status, "done") == 0 || (strcmp(status, "continue") == 0 && tool && *tool));
+    free(status);
+    free(tool);
+    return valid;
+}
+
+/*
+ * One retry for a reply that is not the agent JSON. Only the bad reply is
+ * sent back, not the transcript, so the retry costs little prefill.
+ * Returns the repaired reply, or NULL when the retry fails as well.
+ */
+static char* repairAgentReply(AIConfig *cfg, AIHandler handler, const char *agent_prompt, const char *response, FILE *outf) {
+    char *prompt = formatString(
+        "Your previous reply was not a valid JSON object with keys status, tool, toolInput, message:\n%s\n\n"
+        "Reply again with only that JSON object, keeping the same intent. Use status \"continue\" with a tool, or \"done\".",
+        response);
+    if (!prompt) return NULL;
+
+    TraceSpan repairSpan = traceBegin("agent", "repair");
+    char *raw_json = NULL;
+    char *repaired = NULL;
+    cfg->json_schema = agentReplySchema;
+    int ret = callAiOnce(cfg, handler, prompt, agent_prompt, &raw_json, &repaired);
+    cfg->json_schema = NULL;
+    traceEnd(&repairSpan, NULL);
+    free(prompt);
+    if (ret == 0 && cfg->jsonl) usageWriteRecord(outf, repaired, raw_json);
+    if (cfg->verbose && raw_json) fprintf(stderr, "[agent][repair] %s\n", raw_json);
+    free(raw_json);
+
+    if (ret != 0 || !repaired || !agentReplyValid(repaired)) {
+        free(repaired);
         return NULL;
     }
+    return repaired;
+}
 
+static const AgentTool* findAgentTool(const char *name) {
     size_t toolCount = 0;
     const AgentTool *tools = getAgentTools(&toolCount);
 
     for (size_t i = 0; i < toolCount; ++i) {
         if (strcmp(name, tools[i].name) == 0) {
-            return tools[i].invoke(input, error_out);
+            return &tools[i];
         }
     }
+    return NULL;
+}
+
+static char* invokeAgentTool(const char *name, const char *input, char **error_out) {
+    if (!name) {
+        if (error_out) *error_out = duplicateString("No tool name provided by the agent.");
+        return NULL;
+    }
+
+    const AgentTool *tool = findAgentTool(name);
+    if (tool) {
+        return tool->invoke(input, error_out);
+    }
 
     if (error_out) *error_out = formatString("Unknown tool '%s'.", name);
     return NULL;
 }
 
+/*
+ * --stream: a tool started from the stream hook as soon as the reply's
+ * status, tool and toolInput have closed, so it runs while the message is
+ * still being generated. The worker owns output, error and endUs until it
+ * is joined.
+ */
+typedef struct {
+    int started;
+    pthread_t thread;
+    char *name;
+    char *input;
+    char *output;
+    char *error;
+    double startUs;
+    double endUs;
+} EarlyTool;
+
+/* find_json_string, but NULL until the value's closing quote has arrived. */
+static char* findClosedString(const char *json, const char *key) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *pos = strstr(json, pattern);
+    if (!pos) return NULL;
+    pos += strlen(pattern);
+    while (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r' || *pos == ':') pos++;
+    if (*pos != '"') return NULL;
+    for (++pos; *pos; ++pos) {
+        if (*pos == '\\') {
+            if (!*++pos) return NULL;
+        } else if (*pos == '"') {
+            return find_json_string(json, key);
+        }
+    }
+    return NULL;
+}
+
+static void* runEarlyTool(void *arg) {
+    EarlyTool *early = arg;
+    early->output = invokeAgentTool(early->name, early->input, &early->error);
+    early->endUs = traceNowUs();
+    return NULL;
+}
+
+static void watchAgentStream(void *user, const char *text, size_t len) {
+    (void)len;
+    EarlyTool *early = user;
+    if (early->started || deadlineExpired()) return;
+
+    char *status = findClosedString(text, "status");
+    char *name = status && strcmp(status, "continue") == 0 ? findClosedString(text, "tool") : NULL;
+    char *input = name ? findClosedString(text, "toolInput") : NULL;
+    const AgentTool *tool = input ? findAgentTool(name) : NULL;
+    free(status);
+    if (!tool || !tool->early) {
+        free(name);
+        free(input);
+        return;
+    }
+
+    early->name = name;
+    early->input = input;
+    early->startUs = traceNowUs();
+    if (pthread_create(&early->thread, NULL, runEarlyTool, early) == 0) {
+        early->started = 1;
+    } else {
+        free(early->name);
+        free(early->input);
+        early->name = NULL;
+        early->input = NULL;
+    }
+}
+
+/*
+ * Joins the early tool. Its result stands only when the final reply asks
+ * for the same call; *outputOut and *errorOut then take it over and 1 is
+ * returned. Anything else is discarded.
+ */
+static int claimEarlyTool(EarlyTool *early, const char *response, char **outputOut, char **errorOut) {
+    if (!early->started) return 0;
+    pthread_join(early->thread, NULL);
+
+    char *status = response ? find_json_string(response, "status") : NULL;
+    char *name = status && strcmp(status, "continue") == 0 ? find_json_string(response, "tool") : NULL;
+    char *input = name ? find_json_string(response, "toolInput") : NULL;
+    int claimed = input && strcmp(name, early->name) == 0 && strcmp(input, early->input) == 0;
+    free(status);
+    free(name);
+    free(input);
+
+    if (claimed) {
+        *outputOut = early->output;
+        *errorOut = early->error;
+        char args[160];
+        snprintf(args, sizeof(args), "{\"inputBytes\":%zu,\"outputBytes\":%zu,\"ok\":%s,\"early\":true}",
+                 strlen(early->input), early->output ? strlen(early->output) : 0, early->output ? "true" : "false");
+        traceRecord("tool", early->name, early->startUs, early->endUs - early->startUs, args);
+    } else {
+        free(early->output);
+        free(early->error);
+    }
+    free(early->name);
+    free(early->input);
+    memset(early, 0, sizeof(*early));
+    return claimed;
+}
+
 static char* buildAgentSystemPrompt(const char *sys_prompt) {
     const char *header =
-        "You are an autonomous AI agent. Respond exclusively in JSON with keys: status, message, tool, toolInput.\n"
+        "You are an autonomous AI agent. Respond exclusively in JSON with keys, in this order: status, tool, toolInput, message.\n"
         "When status is \"continue\" you must provide tool and toolInput.\n"
         "Available tools:\n";
     const char *footer =
-        "Use tools when needed. When you can answer the user, return status \"done\" and omit tool/toolInput.\n";
+        "Use tools when needed. When you can answer the user, return status \"done\" and leave tool and toolInput empty.\n";
 
     size_t toolCount = 0;
     const AgentTool *tools = getAgentTools(&toolCount);
+    int spawn = subagentAvailable();
 
     size_t total = strlen(header) + strlen(footer) + 1;
+    if (spawn) {
+        total += strlen(SUBAGENT_TOOL_NAME) + strlen(SUBAGENT_TOOL_DESCRIPTION) + 6;
+    }
     if (sys_prompt && *sys_prompt) {
         total += strlen(sys_prompt) + 2;
     }
@@ -111,6 +286,16 @@ static char* buildAgentSystemPrompt(const char *sys_prompt) {
         remaining -= (size_t)written;
     }
 
+    if (spawn) {
+        written = snprintf(ptr, remaining, "- %s: %s\n", SUBAGENT_TOOL_NAME, SUBAGENT_TOOL_DESCRIPTION);
+        if (written < 0 || (size_t)written >= remaining) {
+            free(prompt);
+            return NULL;
+        }
+        ptr += written;
+        remaining -= (size_t)written;
+    }
+
     written = snprintf(ptr, remaining, "%s", footer);
     if (written < 0 || (size_t)written >= remaining) {
         free(prompt);
@@ -120,7 +305,15 @@ static char* buildAgentSystemPrompt(const char *sys_prompt) {
     return prompt;
 }
 
-int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const char *sys_prompt, FILE *outf) {
+static void emitAgentFinal(const AIConfig *cfg, FILE *outf, const char *text, char **final_out) {
+    /* With --jsonl the step records already carry the answer. */
+    if (!cfg->jsonl) fprintf(outf, "%s\n", text);
+    if (final_out && !*final_out) {
+        *final_out = duplicateString(text);
+    }
+}
+
+int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const char *sys_prompt, FILE *outf, char **final_out) {
     char *agent_prompt = buildAgentSystemPrompt(sys_prompt);
     if (!agent_prompt) {
         return 1;
@@ -133,44 +326,97 @@ int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const
         return 1;
     }
 
-    const int max_steps = 8;
+    /*
+     * ollama: the previous step's "context" tokens already hold the system
+     * prompt and the transcript up to contextCovers, so later steps send only
+     * the new suffix and ollama skips re-prefilling it.
+     */
+    int reuseContext = cfg->provider && cfg->provider->protocol == PROVIDER_OLLAMA;
+    char *context = NULL;
+    size_t contextCovers = 0;
+
+    const int max_steps = cfg->max_steps > 0 ? cfg->max_steps : 8;
+    /* The REPL always streams; elsewhere --stream asks for it. Steps are never echoed. */
+    int streamSteps = cfg->stream || cfg->repl;
+    TraceSpan stepSpan = { 0 };
+    char stepName[32];
     for (int step = 0; step < max_steps; ++step) {
+        traceEnd(&stepSpan, NULL);
+        if (deadlineExpired()) break;
+        snprintf(stepName, sizeof(stepName), "step %d", step + 1);
+        stepSpan = traceBegin("agent", stepName);
+        usageSetStep(step + 1);
+
         char *raw_json = NULL;
         char *response = NULL;
-        int ret = callAiOnce(cfg, handler, conversation, agent_prompt, &raw_json, &response);
+        EarlyTool early = { 0 };
+        cfg->ollama_context = context;
+        cfg->json_schema = agentReplySchema;
+        if (streamSteps) {
+            cfg->stream_hook = watchAgentStream;
+            cfg->stream_hook_user = &early;
+        }
+        int ret = callAiOnce(cfg, handler, conversation + (context ? contextCovers : 0), agent_prompt, &raw_json, &response);
+        cfg->ollama_context = NULL;
+        cfg->json_schema = NULL;
+        cfg->stream_hook = NULL;
+        cfg->stream_hook_user = NULL;
+        char *early_output = NULL;
+        char *early_error = NULL;
+        int early_claimed = claimEarlyTool(&early, ret == 0 ? response : NULL, &early_output, &early_error);
+        free(context);
+        context = reuseContext ? ollama_extract_context(raw_json) : NULL;
+        contextCovers = strlen(conversation);
         if (ret != 0) {
             if (raw_json) free(raw_json);
             if (response) free(response);
+            free(context);
             free(conversation);
             free(agent_prompt);
+            traceEnd(&stepSpan, NULL);
             return ret;
         }
 
         if (cfg->verbose && raw_json) {
             fprintf(stderr, "[agent][step %d] %s\n", step + 1, raw_json);
         }
+        if (cfg->jsonl) {
+            usageWriteRecord(outf, response, raw_json);
+        }
 
         if (!response) {
-            if (!cfg->verbose && raw_json) {
+            if (!cfg->verbose && !cfg->jsonl && raw_json) {
                 fprintf(outf, "%s", raw_json);
             }
             if (raw_json) free(raw_json);
+            free(context);
             free(conversation);
             free(agent_prompt);
+            traceEnd(&stepSpan, NULL);
             return 0;
         }
 
+        if (!agentReplyValid(response)) {
+            char *repaired = repairAgentReply(cfg, handler, agent_prompt, response, outf);
+            if (repaired) {
+                free(response);
+                response = repaired;
+            }
+        }
+
         char *status = find_json_string(response, "status");
         char *message = find_json_string(response, "message");
 
         if (!status) {
             const char *final_text = message ? message : response;
-            fprintf(outf, "%s\n", final_text);
+            emitAgentFinal(cfg, outf, final_text, final_out);
             if (message) free(message);
             free(response);
             if (raw_json) free(raw_json);
+            free(context);
             free(conversation);
             free(agent_prompt);
+            traceEnd(&stepSpan, NULL);
             return 0;
         }
 
@@ -193,8 +439,24 @@ int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const
 
             char *tool_error = NULL;
             char *tool_output = NULL;
-            if (tool_name) {
-                tool_output = invokeAgentTool(tool_name, tool_input ? tool_input : "", &tool_error);
+            if (early_claimed) {
+                tool_output = early_output;
+                tool_error = early_error;
+            } else if (deadlineExpired()) {
+                tool_error = duplicateString("Deadline exceeded before the tool could run.");
+            } else if (tool_name) {
+                TraceSpan toolSpan = traceBegin("tool", tool_name);
+                if (strcmp(tool_name, SUBAGENT_TOOL_NAME) == 0) {
+                    tool_output = subagentRun(cfg, handler, sys_prompt, tool_input ? tool_input : "", max_steps - step - 1, &tool_error);
+                } else {
+                    tool_output = invokeAgentTool(tool_name, tool_input ? tool_input : "", &tool_error);
+                }
+                if (toolSpan.active) {
+                    char args[128];
+                    snprintf(args, sizeof(args), "{\"inputBytes\":%zu,\"outputBytes\":%zu,\"ok\":%s}",
+                             tool_input ? strlen(tool_input) : 0, tool_output ? strlen(tool_output) : 0, tool_output ? "true" : "false");
+                    traceEnd(&toolSpan, args);
+                }
             } else {
                 tool_error = duplicateString("Agent response missing tool name.");
             }
@@ -214,15 +476,17 @@ int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const
                 free(status);
                 free(response);
                 if (raw_json) free(raw_json);
+                free(context);
                 free(conversation);
                 free(agent_prompt);
+                traceEnd(&stepSpan, NULL);
                 return 1;
             }
 
             int written = snprintf(
                 updated_conversation,
                 new_len,
-                "%s\n\n[agent step %d]\nResponse: %s\nMessage: %s\nTool: %s\nToolInput: %s\nToolOutput:\n%s\n\nContinue responding in JSON with keys status, message, tool, toolInput.",
+                "%s\n\n[agent step %d]\nResponse: %s\nMessage: %s\nTool: %s\nToolInput: %s\nToolOutput:\n%s\n\nContinue responding in JSON with keys status, tool, toolInput, message.",
                 conversation,
                 step + 1,
                 response,
@@ -242,8 +506,10 @@ int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const
                 free(status);
                 free(response);
                 if (raw_json) free(raw_json);
+                free(context);
                 free(conversation);
                 free(agent_prompt);
+                traceEnd(&stepSpan, NULL);
                 return 1;
             }
 
@@ -271,28 +537,38 @@ int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const
 
         if (statusIsDone) {
             const char *final_text = message ? message : response;
-            fprintf(outf, "%s\n", final_text);
+            emitAgentFinal(cfg, outf, final_text, final_out);
             if (message) free(message);
             free(status);
             free(response);
             if (raw_json) free(raw_json);
+            free(context);
             free(conversation);
             free(agent_prompt);
+            traceEnd(&stepSpan, NULL);
             return 0;
         }
 
         const char *final_text = message ? message : response;
-        fprintf(outf, "%s\n", final_text);
+        emitAgentFinal(cfg, outf, final_text, final_out);
         if (message) free(message);
         free(status);
         free(response);
         if (raw_json) free(raw_json);
+        free(context);
         free(conversation);
         free(agent_prompt);
+        traceEnd(&stepSpan, NULL);
         return 0;
     }
 
-    fprintf(outf, "Agent stopped after maximum iterations without finishing.\n");
+    traceEnd(&stepSpan, NULL);
+    if (deadlineExpired()) {
+        fprintf(stderr, "Agent stopped: deadline exceeded.\n");
+    } else {
+        fprintf(cfg->jsonl ? stderr : outf, "Agent stopped after %d steps without finishing.\n", max_steps);
+    }
+    free(context);
     free(conversation);
     free(agent_prompt);
     return 0;
@@ -4,6 +4,6 @@
 #include <stdio.h>
 #include "ai.h"
 
-int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const char *sys_prompt, FILE *outf);
+int runAgentMode(AIConfig *cfg, AIHandler handler, const char *user_input, const char *sys_prompt, FILE *outf, char **final_out);
 
 #endif
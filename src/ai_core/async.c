@@ -0,0 +1,743 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "ai_core/async.h"
+#include "ai_core/providers.h"
+
+extern char **environ;
+
+#define ASYNC_MAX_IDLE 64
+#define ASYNC_MAX_EVENTS 256
+#define ASYNC_READ_CHUNK 16384
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} AsyncBuffer;
+
+/* A resolved host:port and its idle keep-alive connections. */
+typedef struct AsyncHost {
+    char *name;
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    int failed;
+    int idle[ASYNC_MAX_IDLE];
+    size_t idleCount;
+    struct AsyncHost *next;
+} AsyncHost;
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_CONNECTING,
+    JOB_SENDING,
+    JOB_RECEIVING,
+    JOB_DONE
+} JobState;
+
+typedef struct AsyncJob AsyncJob;
+
+/* epoll data for one descriptor of a job: the socket, or curl's stdout and stdin. */
+typedef struct {
+    AsyncJob *job;
+    int fd;
+} AsyncWatch;
+
+struct AsyncJob {
+    AIRequest req;
+    AsyncCallback done;
+    void *user;
+    JobState state;
+    int https;
+    AsyncHost *host;
+    AsyncWatch watches[2];
+    pid_t pid;
+    AsyncBuffer out;
+    size_t sent;
+    AsyncBuffer in;
+    size_t bodyStart;
+    long contentLength;
+    int chunked;
+    int keepAlive;
+    int status;
+    AsyncBuffer body;
+    size_t chunkPos;
+    int reused;
+    int retried;
+    AsyncJob *prev;
+    AsyncJob *next;
+};
+
+struct AsyncLoop {
+    int epfd;
+    size_t maxInFlight;
+    size_t active;
+    size_t queued;
+    AsyncJob *running;
+    AsyncJob *queueHead;
+    AsyncJob *queueTail;
+    AsyncJob *finished;
+    AsyncHost *hosts;
+};
+
+static int bufferAppend(AsyncBuffer *buffer, const void *data, size_t len) {
+    if (buffer->len + len + 1 > buffer->cap) {
+        size_t newCap = buffer->cap ? buffer->cap : 1024;
+        while (newCap < buffer->len + len + 1) newCap *= 2;
+        char *resized = realloc(buffer->data, newCap);
+        if (!resized) return -1;
+        buffer->data = resized;
+        buffer->cap = newCap;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    buffer->data[buffer->len] = '\0';
+    return 0;
+}
+
+static int bufferFormat(AsyncBuffer *buffer, const char *fmt, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= sizeof(line)) return -1;
+    return bufferAppend(buffer, line, (size_t)n);
+}
+
+static void bufferFree(AsyncBuffer *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+/* Splits an http URL into "host:port" and the request target. */
+static int parseUrl(const char *url, char *authority, size_t authorityMax, char *host, size_t hostMax,
+                    char *port, size_t portMax, const char **target) {
+    const char *start = url + strlen("http://");
+    const char *end = start + strcspn(start, "/?");
+    size_t len = (size_t)(end - start);
+    if (len == 0 || len >= authorityMax) return -1;
+    memcpy(authority, start, len);
+    authority[len] = '\0';
+    *target = *end ? end : "/";
+
+    const char *hostStart = authority;
+    const char *hostEnd;
+    const char *colon;
+    if (authority[0] == '[') {
+        hostStart = authority + 1;
+        hostEnd = strchr(hostStart, ']');
+        if (!hostEnd) return -1;
+        colon = hostEnd[1] == ':' ? hostEnd + 1 : NULL;
+    } else {
+        colon = strrchr(authority, ':');
+        hostEnd = colon ? colon : authority + len;
+    }
+    size_t hostLen = (size_t)(hostEnd - hostStart);
+    if (hostLen == 0 || hostLen >= hostMax) return -1;
+    memcpy(host, hostStart, hostLen);
+    host[hostLen] = '\0';
+    snprintf(port, portMax, "%s", colon && colon[1] ? colon + 1 : "80");
+    return 0;
+}
+
+/* Looks up host:port, resolving it on first use; getaddrinfo blocks, but only once per host. */
+static AsyncHost* findHost(AsyncLoop *loop, const char *authority, const char *host, const char *port) {
+    for (AsyncHost *entry = loop->hosts; entry; entry = entry->next) {
+        if (strcmp(entry->name, authority) == 0) return entry;
+    }
+    AsyncHost *entry = calloc(1, sizeof(*entry));
+    if (!entry) return NULL;
+    size_t len = strlen(authority);
+    entry->name = malloc(len + 1);
+    if (!entry->name) {
+        free(entry);
+        return NULL;
+    }
+    memcpy(entry->name, authority, len + 1);
+
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(host, port, &hints, &result) != 0 || !result) {
+        entry->failed = 1;
+    } else {
+        memcpy(&entry->addr, result->ai_addr, result->ai_addrlen);
+        entry->addrLen = result->ai_addrlen;
+    }
+    if (result) freeaddrinfo(result);
+    entry->next = loop->hosts;
+    loop->hosts = entry;
+    return entry;
+}
+
+static int watchFd(AsyncLoop *loop, AsyncWatch *watch, uint32_t events, int op) {
+    struct epoll_event event = { 0 };
+    event.events = events;
+    event.data.ptr = watch;
+    return epoll_ctl(loop->epfd, op, watch->fd, &event);
+}
+
+static void closeWatch(AsyncLoop *loop, AsyncWatch *watch) {
+    if (watch->fd < 0) return;
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, watch->fd, NULL);
+    close(watch->fd);
+    watch->fd = -1;
+}
+
+static void unlinkRunning(AsyncLoop *loop, AsyncJob *job) {
+    if (job->prev) job->prev->next = job->next;
+    else loop->running = job->next;
+    if (job->next) job->next->prev = job->prev;
+    job->prev = job->next = NULL;
+    loop->active--;
+}
+
+static void releaseJob(AsyncJob *job) {
+    request_free(&job->req);
+    bufferFree(&job->out);
+    bufferFree(&job->in);
+    bufferFree(&job->body);
+    free(job);
+}
+
+static void reapCurl(AsyncJob *job) {
+    if (job->pid <= 0) return;
+    kill(job->pid, SIGTERM);
+    waitpid(job->pid, NULL, 0);
+    job->pid = 0;
+}
+
+/* Completes job; it is freed once the current batch of events is handled. */
+static void finishJob(AsyncLoop *loop, AsyncJob *job, int status, const char *response, size_t len) {
+    int pooled = 0;
+    AsyncWatch *socketWatch = &job->watches[0];
+    if (!job->https && status > 0 && job->keepAlive && socketWatch->fd >= 0 && job->host->idleCount < ASYNC_MAX_IDLE) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, socketWatch->fd, NULL);
+        job->host->idle[job->host->idleCount++] = socketWatch->fd;
+        socketWatch->fd = -1;
+        pooled = 1;
+    }
+    if (!pooled) closeWatch(loop, socketWatch);
+    closeWatch(loop, &job->watches[1]);
+    if (job->https) {
+        if (job->pid > 0) waitpid(job->pid, NULL, 0);
+        job->pid = 0;
+    }
+
+    unlinkRunning(loop, job);
+    job->state = JOB_DONE;
+    job->done(job->user, status, response, len);
+    job->next = loop->finished;
+    loop->finished = job;
+}
+
+static void enqueueFront(AsyncLoop *loop, AsyncJob *job) {
+    job->state = JOB_QUEUED;
+    job->next = loop->queueHead;
+    loop->queueHead = job;
+    if (!loop->queueTail) loop->queueTail = job;
+    loop->queued++;
+}
+
+static void failJob(AsyncLoop *loop, AsyncJob *job, const char *message) {
+    /* A pooled connection the server closed while idle fails before any reply; retry it once on a new one. */
+    if (job->reused && !job->retried && job->in.len == 0) {
+        closeWatch(loop, &job->watches[0]);
+        unlinkRunning(loop, job);
+        job->reused = 0;
+        job->retried = 1;
+        job->sent = 0;
+        enqueueFront(loop, job);
+        return;
+    }
+    if (job->https) reapCurl(job);
+    finishJob(loop, job, 0, message, strlen(message));
+}
+
+static int serializeRequest(AsyncJob *job, const char *authority, const char *target) {
+    if (bufferFormat(&job->out, "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %zu\r\n",
+                     target, authority, strlen(job->req.body)) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < job->req.headerCount; ++i) {
+        if (bufferFormat(&job->out, "%s\r\n", job->req.headers[i]) != 0) return -1;
+    }
+    if (bufferAppend(&job->out, "\r\n", 2) != 0) return -1;
+    return bufferAppend(&job->out, job->req.body, strlen(job->req.body));
+}
+
+/* An idle connection is usable when a peek finds neither EOF nor stray bytes. */
+static int takeIdle(AsyncHost *host) {
+    while (host->idleCount) {
+        int fd = host->idle[--host->idleCount];
+        char probe;
+        ssize_t got = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return fd;
+        close(fd);
+    }
+    return -1;
+}
+
+static int startSocket(AsyncLoop *loop, AsyncJob *job) {
+    char authority[512];
+    char host[512];
+    char port[16];
+    const char *target;
+    if (parseUrl(job->req.url, authority, sizeof(authority), host, sizeof(host), port, sizeof(port), &target) != 0) {
+        failJob(loop, job, "invalid URL");
+        return -1;
+    }
+    if (!job->host) job->host = findHost(loop, authority, host, port);
+    if (!job->host || job->host->failed) {
+        failJob(loop, job, "cannot resolve host");
+        return -1;
+    }
+    if (job->out.len == 0 && serializeRequest(job, authority, target) != 0) {
+        failJob(loop, job, "out of memory");
+        return -1;
+    }
+
+    int fd = job->retried ? -1 : takeIdle(job->host);
+    job->reused = fd >= 0;
+    job->state = JOB_SENDING;
+    if (fd < 0) {
+        fd = socket(job->host->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            failJob(loop, job, strerror(errno));
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, (struct sockaddr *)&job->host->addr, job->host->addrLen) != 0) {
+            if (errno != EINPROGRESS) {
+                const char *message = strerror(errno);
+                close(fd);
+                failJob(loop, job, message);
+                return -1;
+            }
+            job->state = JOB_CONNECTING;
+        }
+    }
+    job->watches[0].fd = fd;
+    if (watchFd(loop, &job->watches[0], EPOLLOUT, EPOLL_CTL_ADD) != 0) {
+        failJob(loop, job, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* https: one curl child reading the body on stdin and writing the reply, then the status, on stdout. */
+static int startCurl(AsyncLoop *loop, AsyncJob *job) {
+    int inPipe[2];
+    int outPipe[2];
+    if (pipe2(inPipe, O_CLOEXEC) != 0) {
+        failJob(loop, job, strerror(errno));
+        return -1;
+    }
+    if (pipe2(outPipe, O_CLOEXEC) != 0) {
+        close(inPipe[0]);
+        close(inPipe[1]);
+        failJob(loop, job, strerror(errno));
+        return -1;
+    }
+
+    char *argv[16 + 2 * AI_REQUEST_MAX_HEADERS];
+    size_t argc = 0;
+    argv[argc++] = "curl";
+    argv[argc++] = "-s";
+    argv[argc++] = "-X";
+    argv[argc++] = "POST";
+    argv[argc++] = job->req.url;
+    for (size_t i = 0; i < job->req.headerCount; ++i) {
+        argv[argc++] = "-H";
+        argv[argc++] = job->req.headers[i];
+    }
+    argv[argc++] = "--data-binary";
+    argv[argc++] = "@-";
+    argv[argc++] = "-w";
+    argv[argc++] = "\n%{http_code}";
+    argv[argc] = NULL;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, inPipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    int spawnError = posix_spawnp(&job->pid, "curl", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(inPipe[0]);
+    close(outPipe[1]);
+
+    job->watches[0].fd = outPipe[0];
+    job->watches[1].fd = inPipe[1];
+    if (spawnError != 0) {
+        job->pid = 0;
+        failJob(loop, job, strerror(spawnError));
+        return -1;
+    }
+    job->state = JOB_SENDING;
+    if (setNonBlocking(outPipe[0]) != 0 || setNonBlocking(inPipe[1]) != 0 ||
+        watchFd(loop, &job->watches[0], EPOLLIN, EPOLL_CTL_ADD) != 0 ||
+        watchFd(loop, &job->watches[1], EPOLLOUT, EPOLL_CTL_ADD) != 0) {
+        failJob(loop, job, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void startQueued(AsyncLoop *loop) {
+    while (loop->queueHead && (loop->maxInFlight == 0 || loop->active < loop->maxInFlight)) {
+        AsyncJob *job = loop->queueHead;
+        loop->queueHead = job->next;
+        if (!loop->queueHead) loop->queueTail = NULL;
+        loop->queued--;
+
+        job->prev = NULL;
+        job->next = loop->running;
+        if (loop->running) loop->running->prev = job;
+        loop->running = job;
+        loop->active++;
+
+        if (job->https) startCurl(loop, job);
+        else startSocket(loop, job);
+    }
+}
+
+/* Parses the status line and the headers that decide where the body ends. */
+static int parseHead(AsyncJob *job) {
+    char *end = memmem(job->in.data, job->in.len, "\r\n\r\n", 4);
+    if (!end) return 0;
+    *end = '\0';
+    int minor = 1;
+    if (sscanf(job->in.data, "HTTP/1.%d %d", &minor, &job->status) != 2 || job->status < 100) return -1;
+
+    job->contentLength = -1;
+    job->chunked = 0;
+    job->keepAlive = minor >= 1;
+    for (char *line = strstr(job->in.data, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            job->contentLength = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            job->chunked = strcasestr(line, "chunked") != NULL;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            if (strcasestr(line, "close")) job->keepAlive = 0;
+            else if (strcasestr(line, "keep-alive")) job->keepAlive = 1;
+        }
+    }
+    *end = '\r';
+
+    size_t headLen = (size_t)(end - job->in.data) + 4;
+    if (job->status < 200) {
+        /* An interim 1xx reply; the real one follows. */
+        memmove(job->in.data, job->in.data + headLen, job->in.len - headLen + 1);
+        job->in.len -= headLen;
+        return parseHead(job);
+    }
+    job->bodyStart = headLen;
+    job->chunkPos = headLen;
+    return 1;
+}
+
+/* Decodes the chunks received so far; 1 once the terminating chunk has arrived. */
+static int decodeChunks(AsyncJob *job) {
+    for (;;) {
+        char *line = job->in.data + job->chunkPos;
+        size_t avail = job->in.len - job->chunkPos;
+        char *lineEnd = memmem(line, avail, "\r\n", 2);
+        if (!lineEnd) return 0;
+        char *sizeEnd;
+        unsigned long size = strtoul(line, &sizeEnd, 16);
+        if (sizeEnd == line) return -1;
+        if (size == 0) return memmem(line, avail, "\r\n\r\n", 4) ? 1 : 0;
+
+        size_t dataStart = (size_t)(lineEnd - job->in.data) + 2;
+        if (job->in.len < dataStart + size + 2) return 0;
+        if (bufferAppend(&job->body, job->in.data + dataStart, size) != 0) return -1;
+        job->chunkPos = dataStart + size + 2;
+    }
+}
+
+/* Completes the job if the reply is whole; eof says the server has closed the connection. */
+static void checkReply(AsyncLoop *loop, AsyncJob *job, int eof) {
+    if (!job->bodyStart) {
+        int parsed = parseHead(job);
+        if (parsed < 0) {
+            failJob(loop, job, "malformed HTTP reply");
+            return;
+        }
+        if (parsed == 0) {
+            if (eof) failJob(loop, job, "connection closed before the reply");
+            return;
+        }
+    }
+
+    const char *body = job->in.data + job->bodyStart;
+    size_t received = job->in.len - job->bodyStart;
+    if (job->chunked) {
+        int state = decodeChunks(job);
+        if (state < 0) {
+            failJob(loop, job, "malformed chunked reply");
+        } else if (state > 0) {
+            finishJob(loop, job, job->status, job->body.data ? job->body.data : "", job->body.len);
+        } else if (eof) {
+            failJob(loop, job, "connection closed mid-reply");
+        }
+    } else if (job->contentLength >= 0) {
+        if (received >= (size_t)job->contentLength) {
+            if (received > (size_t)job->contentLength) job->keepAlive = 0;
+            finishJob(loop, job, job->status, body, (size_t)job->contentLength);
+        } else if (eof) {
+            failJob(loop, job, "connection closed mid-reply");
+        }
+    } else if (eof) {
+        job->keepAlive = 0;
+        finishJob(loop, job, job->status, body, received);
+    }
+}
+
+static int readInto(AsyncJob *job, int fd, int *eof) {
+    for (;;) {
+        if (job->in.cap - job->in.len < ASYNC_READ_CHUNK + 1) {
+            size_t newCap = job->in.cap ? job->in.cap * 2 : ASYNC_READ_CHUNK * 2;
+            char *resized = realloc(job->in.data, newCap);
+            if (!resized) return -1;
+            job->in.data = resized;
+            job->in.cap = newCap;
+        }
+        ssize_t got = read(fd, job->in.data + job->in.len, job->in.cap - job->in.len - 1);
+        if (got > 0) {
+            job->in.len += (size_t)got;
+            job->in.data[job->in.len] = '\0';
+        } else if (got == 0) {
+            *eof = 1;
+            return 0;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+    }
+}
+
+static void onSocket(AsyncLoop *loop, AsyncJob *job, uint32_t events) {
+    int fd = job->watches[0].fd;
+    if (job->state == JOB_CONNECTING) {
+        if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return;
+        int error = 0;
+        socklen_t errorLen = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0) error = errno;
+        if (error) {
+            failJob(loop, job, strerror(error));
+            return;
+        }
+        job->state = JOB_SENDING;
+    }
+
+    if (job->state == JOB_SENDING) {
+        while (job->sent < job->out.len) {
+            ssize_t wrote = send(fd, job->out.data + job->sent, job->out.len - job->sent, MSG_NOSIGNAL);
+            if (wrote > 0) {
+                job->sent += (size_t)wrote;
+            } else if (wrote < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            } else if (wrote < 0 && errno != EINTR) {
+                failJob(loop, job, strerror(errno));
+                return;
+            }
+        }
+        job->state = JOB_RECEIVING;
+        if (watchFd(loop, &job->watches[0], EPOLLIN, EPOLL_CTL_MOD) != 0) failJob(loop, job, strerror(errno));
+        return;
+    }
+
+    if (job->state == JOB_RECEIVING && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        int eof = 0;
+        if (readInto(job, fd, &eof) != 0) {
+            failJob(loop, job, strerror(errno));
+            return;
+        }
+        checkReply(loop, job, eof);
+    }
+}
+
+static void onCurlInput(AsyncLoop *loop, AsyncJob *job) {
+    size_t len = strlen(job->req.body);
+    while (job->sent < len) {
+        ssize_t wrote = write(job->watches[1].fd, job->req.body + job->sent, len - job->sent);
+        if (wrote > 0) {
+            job->sent += (size_t)wrote;
+        } else if (wrote < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else if (wrote < 0 && errno != EINTR) {
+            failJob(loop, job, "curl closed its input");
+            return;
+        }
+    }
+    closeWatch(loop, &job->watches[1]);
+    job->state = JOB_RECEIVING;
+}
+
+static void onCurlOutput(AsyncLoop *loop, AsyncJob *job) {
+    int eof = 0;
+    if (readInto(job, job->watches[0].fd, &eof) != 0) {
+        failJob(loop, job, strerror(errno));
+        return;
+    }
+    if (!eof) return;
+
+    int exitStatus = 0;
+    if (job->pid > 0 && waitpid(job->pid, &exitStatus, 0) == job->pid) job->pid = 0;
+    char *statusLine = job->in.data ? strrchr(job->in.data, '\n') : NULL;
+    int status = statusLine ? atoi(statusLine + 1) : 0;
+    if (status <= 0) {
+        char message[64];
+        snprintf(message, sizeof(message), "curl failed (exit %d)", WIFEXITED(exitStatus) ? WEXITSTATUS(exitStatus) : -1);
+        finishJob(loop, job, 0, message, strlen(message));
+        return;
+    }
+    *statusLine = '\0';
+    finishJob(loop, job, status, job->in.data, (size_t)(statusLine - job->in.data));
+}
+
+AsyncLoop* asyncLoopCreate(size_t maxInFlight) {
+    AsyncLoop *loop = calloc(1, sizeof(*loop));
+    if (!loop) return NULL;
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        free(loop);
+        return NULL;
+    }
+    loop->maxInFlight = maxInFlight;
+    /* A curl child that dies early would otherwise take the process down with it on the next write. */
+    struct sigaction current;
+    if (sigaction(SIGPIPE, NULL, &current) == 0 && current.sa_handler == SIG_DFL) signal(SIGPIPE, SIG_IGN);
+    return loop;
+}
+
+static void freeFinished(AsyncLoop *loop) {
+    while (loop->finished) {
+        AsyncJob *job = loop->finished;
+        loop->finished = job->next;
+        releaseJob(job);
+    }
+}
+
+void asyncLoopDestroy(AsyncLoop *loop) {
+    if (!loop) return;
+    while (loop->running) {
+        AsyncJob *job = loop->running;
+        closeWatch(loop, &job->watches[0]);
+        closeWatch(loop, &job->watches[1]);
+        reapCurl(job);
+        unlinkRunning(loop, job);
+        releaseJob(job);
+    }
+    while (loop->queueHead) {
+        AsyncJob *job = loop->queueHead;
+        loop->queueHead = job->next;
+        releaseJob(job);
+    }
+    freeFinished(loop);
+    while (loop->hosts) {
+        AsyncHost *host = loop->hosts;
+        loop->hosts = host->next;
+        for (size_t i = 0; i < host->idleCount; ++i) close(host->idle[i]);
+        free(host->name);
+        free(host);
+    }
+    close(loop->epfd);
+    free(loop);
+}
+
+int asyncSubmit(AsyncLoop *loop, AIRequest *req, AsyncCallback done, void *user) {
+    AsyncJob *job = calloc(1, sizeof(*job));
+    if (!job) {
+        request_free(req);
+        return -1;
+    }
+    job->req = *req;
+    memset(req, 0, sizeof(*req));
+    job->done = done;
+    job->user = user;
+    job->https = strncmp(job->req.url, "https://", 8) == 0;
+    if (!job->https && strncmp(job->req.url, "http://", 7) != 0) {
+        releaseJob(job);
+        return -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        job->watches[i].job = job;
+        job->watches[i].fd = -1;
+    }
+
+    job->state = JOB_QUEUED;
+    if (loop->queueTail) loop->queueTail->next = job;
+    else loop->queueHead = job;
+    loop->queueTail = job;
+    loop->queued++;
+    return 0;
+}
+
+int asyncSubmitCall(AsyncLoop *loop, AIConfig *cfg, const char *input, const char *sys_prompt, AsyncCallback done, void *user) {
+    if (!cfg->provider || !cfg->provider->builder) return -1;
+    AIRequest req;
+    if (cfg->provider->builder(cfg, input, sys_prompt, &req) != 0) return -1;
+    return asyncSubmit(loop, &req, done, user);
+}
+
+size_t asyncPending(const AsyncLoop *loop) {
+    return loop->active + loop->queued;
+}
+
+size_t asyncRunOnce(AsyncLoop *loop, int timeoutMs) {
+    startQueued(loop);
+    freeFinished(loop);
+    if (loop->active == 0) return asyncPending(loop);
+
+    struct epoll_event events[ASYNC_MAX_EVENTS];
+    int count = epoll_wait(loop->epfd, events, ASYNC_MAX_EVENTS, timeoutMs);
+    for (int i = 0; i < count; ++i) {
+        AsyncWatch *watch = events[i].data.ptr;
+        AsyncJob *job = watch->job;
+        /* Earlier events in this batch may have completed or requeued the job. */
+        if (job->state == JOB_DONE || job->state == JOB_QUEUED || watch->fd < 0) continue;
+        if (!job->https) {
+            onSocket(loop, job, events[i].events);
+        } else if (watch == &job->watches[1]) {
+            onCurlInput(loop, job);
+        } else {
+            onCurlOutput(loop, job);
+        }
+    }
+
+    freeFinished(loop);
+    startQueued(loop);
+    return asyncPending(loop);
+}
+
+void asyncRun(AsyncLoop *loop) {
+    while (asyncRunOnce(loop, -1) > 0) {
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef AI_CORE_ASYNC_H
+#define AI_CORE_ASYNC_H
+
+#include <stddef.h>
+#include "ai.h"
+
+/*
+ * Single-threaded request core. Requests are built once by a provider's
+ * AIRequestBuilder and submitted to an epoll loop, which drives them all
+ * at once and completes each through its callback. http:// URLs are
+ * served in-process on non-blocking sockets, with resolved addresses
+ * cached and keep-alive connections pooled per host. https:// URLs go
+ * through one curl child each, whose pipes the loop polls like sockets.
+ * Replies are delivered whole; streaming, retries, tracing and usage
+ * accounting stay with the blocking http_post path.
+ */
+typedef struct AsyncLoop AsyncLoop;
+
+/*
+ * status is the HTTP status and response the body. A transport failure
+ * has status 0 and a short error message as response. The response is
+ * only valid during the call.
+ */
+typedef void (*AsyncCallback)(void *user, int status, const char *response, size_t len);
+
+/* maxInFlight caps open connections; submissions beyond it queue. 0 means no cap. */
+AsyncLoop* asyncLoopCreate(size_t maxInFlight);
+void asyncLoopDestroy(AsyncLoop *loop);
+
+/* Takes ownership of req's contents, which are left zeroed. */
+int asyncSubmit(AsyncLoop *loop, AIRequest *req, AsyncCallback done, void *user);
+/* Builds the request with cfg's provider and submits it. */
+int asyncSubmitCall(AsyncLoop *loop, AIConfig *cfg, const char *input, const char *sys_prompt, AsyncCallback done, void *user);
+
+/* Waits up to timeoutMs (-1: until something happens) and returns the requests still pending. */
+size_t asyncRunOnce(AsyncLoop *loop, int timeoutMs);
+/* Runs until every submitted request, including ones submitted by callbacks, has completed. */
+void asyncRun(AsyncLoop *loop);
+size_t asyncPending(const AsyncLoop *loop);
+
+#endif
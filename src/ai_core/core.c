@@ -1,28 +1,20 @@
+#include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "ai.h"
 #include "ai_core/agent.h"
 #include "ai_core/core.h"
-
-static const char* defaultKeyEnvForAi(const char *aiType) {
-    if (!aiType) {
-        return NULL;
-    }
-
-    if (strcmp(aiType, "chatgpt") == 0) {
-        return "OPENAI_API_KEY";
-    }
-    if (strcmp(aiType, "claude") == 0) {
-        return "ANTHROPIC_API_KEY";
-    }
-    if (strcmp(aiType, "deepseek") == 0) {
-        return "DEEPSEEK_API_KEY";
-    }
-
-    return NULL;
-}
+#include "ai_core/deadline.h"
+#include "ai_core/providers.h"
+#include "ai_core/repl.h"
+#include "ai_core/session.h"
+#include "ai_core/singleflight.h"
+#include "ai_core/stream.h"
+#include "ai_core/trace.h"
+#include "ai_core/usage.h"
 
 char* read_file(const char *path) {
     FILE *f = fopen(path, "rb");
@@ -86,49 +78,313 @@ char* get_api_key(AIConfig *cfg) {
         }
     }
 
-    const char *defaultEnv = defaultKeyEnvForAi(cfg->ai_type);
-    if (defaultEnv) {
-        return getenv(defaultEnv);
+    const AIProvider *provider = providerForConfig(cfg, cfg->ai_type);
+    if (provider && provider->key) {
+        return provider->key;
+    }
+    if (provider && provider->keyEnv) {
+        return getenv(provider->keyEnv);
     }
 
     return NULL;
 }
 
+char* get_ai_dir(const char *subdir) {
+    const char *home = getenv("HOME");
+    if (!home || !*home) return NULL;
+
+    size_t len = strlen(home) + strlen("/.gipwrap") + (subdir ? strlen(subdir) + 1 : 0) + 1;
+    char *path = malloc(len);
+    if (!path) return NULL;
+
+    snprintf(path, len, "%s/.gipwrap", home);
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+        free(path);
+        return NULL;
+    }
+
+    if (subdir && *subdir) {
+        strcat(path, "/");
+        strcat(path, subdir);
+        if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+            free(path);
+            return NULL;
+        }
+    }
+
+    return path;
+}
+
+/* Turns curl's -w timings (seconds since curl started) into nested http spans. */
+static void traceCurlTimings(const char *timings, double startUs, double endUs, const char *url) {
+    double dns = 0, connect = 0, tls = 0, pretransfer = 0, firstByte = 0, total = 0, bytes = 0;
+    if (sscanf(timings, "%lf %lf %lf %lf %lf %lf %lf", &dns, &connect, &tls, &pretransfer, &firstByte, &total, &bytes) != 7) {
+        return;
+    }
+    usageNoteFirstByte((total - firstByte) * 1e3);
+
+    double spawnUs = (endUs - startUs) - total * 1e6;
+    if (spawnUs < 0) spawnUs = 0;
+    double base = startUs + spawnUs;
+    char args[512];
+    snprintf(args, sizeof(args), "{\"url\":\"%.400s\",\"bytes\":%.0f}", url, bytes);
+    traceRecord("http", "curl", startUs, endUs - startUs, args);
+    traceRecord("http", "spawn", startUs, spawnUs, NULL);
+    traceRecord("http", "dns", base, dns * 1e6, NULL);
+    traceRecord("http", "connect", base + dns * 1e6, (connect - dns) * 1e6, NULL);
+    if (tls > 0) {
+        traceRecord("http", "tls", base + connect * 1e6, (tls - connect) * 1e6, NULL);
+    }
+    traceRecord("http", "server", base + pretransfer * 1e6, (firstByte - pretransfer) * 1e6, NULL);
+    traceRecord("http", "download", base + firstByte * 1e6, (total - firstByte) * 1e6, NULL);
+}
+
+static int httpRetries;
+static double httpTimeout;
+static int httpTimedOut;
+
+/* --retry: curl repeats timeouts and 408/429/5xx replies up to retries times. */
+void http_set_retries(int retries) {
+    httpRetries = retries > 0 ? retries : 0;
+}
+
+/* --timeout: the cap on one request; a --deadline can shorten it further. */
+void http_set_timeout(double seconds) {
+    httpTimeout = seconds > 0 ? seconds : 0;
+}
+
+/* mkstemp for a file curl writes into; tracked so a signal removes it. */
+static int makeTempFile(char *path) {
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    close(fd);
+    deadlineTrackPath(path);
+    return 0;
+}
+
+static void dropTempFile(const char *path) {
+    deadlineUntrackPath(path);
+    unlink(path);
+}
+
+/* Every attempt appends its header block; the last final status wins and earlier ones were retried. */
+static int noteHttpStatus(const char *headerPath) {
+    FILE *f = fopen(headerPath, "r");
+    if (!f) return 0;
+    char line[512];
+    int status = 0;
+    int attempts = 0;
+    while (fgets(line, sizeof(line), f)) {
+        int code = 0;
+        if (strncmp(line, "HTTP/", 5) == 0 && sscanf(line, "HTTP/%*s %d", &code) == 1 && code >= 200) {
+            status = code;
+            attempts++;
+        }
+    }
+    fclose(f);
+    usageNoteHttp(status, attempts > 1 ? attempts - 1 : 0);
+    return status;
+}
+
 int http_post(const char *url, const char *headers, const char *body, FILE *out) {
+    Flight flight;
+    if (flightBegin(&flight, url, headers, body) == FLIGHT_FOLLOWER) {
+        TraceSpan waitSpan = traceBegin("http", "singleflight_wait");
+        int status = 0;
+        int joined = flightAwait(&flight, out, &status) == 0;
+        traceEnd(&waitSpan, NULL);
+        if (joined) {
+            usageNoteFirstByte(0.0);
+            usageNoteHttp(status, 0);
+            usageNoteCoalesced();
+            return 0;
+        }
+        /* The leader failed; make the call ourselves. */
+    }
+
+    double budget = deadlineBudget(httpTimeout);
+    if (budget < 0) {
+        flightEnd(&flight, 0, 0);
+        return -1;
+    }
+
+    TraceSpan writeSpan = traceBegin("http", "write_body");
     char tmppath[256];
     snprintf(tmppath, sizeof(tmppath), "/tmp/gipwrap_XXXXXX");
     int fd = mkstemp(tmppath);
-    if (fd == -1) return -1;
+    if (fd == -1) {
+        flightEnd(&flight, 0, 0);
+        return -1;
+    }
+    deadlineTrackPath(tmppath);
 
     FILE *f = fdopen(fd, "w");
     if (!f) {
         close(fd);
-        unlink(tmppath);
+        dropTempFile(tmppath);
+        flightEnd(&flight, 0, 0);
         return -1;
     }
 
     fputs(body, f);
     fclose(f);
+    traceEnd(&writeSpan, NULL);
+
+    /*
+     * With --retry the body goes to a file (curl truncates it before a retry),
+     * so stdout carries only curl's -w timings and a failed attempt never
+     * reaches out. When only tracing, the body stays on stdout so streamed
+     * replies still arrive chunk by chunk, and the timings go to curl's
+     * stderr, redirected to timingsPath. Response headers of every attempt go
+     * to headerPath.
+     */
+    char respPath[] = "/tmp/gipwrap_resp_XXXXXX";
+    char timingsPath[] = "/tmp/gipwrap_time_XXXXXX";
+    int buffered = httpRetries > 0 && makeTempFile(respPath) == 0;
+    int timed = buffered || (traceEnabled() && makeTempFile(timingsPath) == 0);
+    char headerPath[] = "/tmp/gipwrap_hdr_XXXXXX";
+    int headerFd = mkstemp(headerPath);
+    if (headerFd >= 0) {
+        close(headerFd);
+        deadlineTrackPath(headerPath);
+    }
+
+    char extra[160] = "";
+    int extraLen = 0;
+    if (headerFd >= 0) extraLen += snprintf(extra + extraLen, sizeof(extra) - extraLen, " -D %s", headerPath);
+    if (httpRetries > 0) extraLen += snprintf(extra + extraLen, sizeof(extra) - extraLen, " --retry %d", httpRetries);
+    if (budget > 0) snprintf(extra + extraLen, sizeof(extra) - extraLen, " --max-time %.3f", budget);
 
     char cmd[8192];
-    snprintf(cmd, sizeof(cmd), "curl -s -X POST '%s' %s -d @%s", url, headers, tmppath);
-
-    FILE *p = popen(cmd, "r");
-    if (!p) {
-        unlink(tmppath);
+    const char *timingsFormat = "%{time_namelookup} %{time_connect} %{time_appconnect} %{time_pretransfer} "
+                                "%{time_starttransfer} %{time_total} %{size_download}";
+    if (buffered) {
+        snprintf(cmd, sizeof(cmd), "curl -s -X POST '%s' %s -d @%s%s -o %s -w '%s'", url, headers, tmppath, extra, respPath, timingsFormat);
+    } else if (timed) {
+        snprintf(cmd, sizeof(cmd), "curl -s -X POST '%s' %s -d @%s%s -w '%%{stderr}%s' 2>%s", url, headers, tmppath, extra, timingsFormat, timingsPath);
+    } else {
+        snprintf(cmd, sizeof(cmd), "curl -s -X POST '%s' %s -d @%s%s", url, headers, tmppath, extra);
+    }
+
+    double startUs = traceNowUs();
+    int curlOut = -1;
+    pid_t curl = deadlineSpawnShell(cmd, &curlOut);
+    if (curl < 0) {
+        dropTempFile(tmppath);
+        if (buffered) dropTempFile(respPath);
+        else if (timed) dropTempFile(timingsPath);
+        if (headerFd >= 0) dropTempFile(headerPath);
+        flightEnd(&flight, 0, 0);
         return -1;
     }
 
-    int c;
-    while ((c = fgetc(p)) != EOF) {
-        fputc(c, out);
+    char timings[256] = { 0 };
+    /* read(2) rather than stdio, so a streamed reply reaches out chunk by chunk. */
+    char buffer[65536];
+    size_t timingsLen = 0;
+    ssize_t got;
+    int first = 1;
+    while ((got = read(curlOut, buffer, sizeof(buffer))) > 0 || (got < 0 && errno == EINTR)) {
+        if (got < 0) continue;
+        if (buffered) {
+            size_t keep = (size_t)got < sizeof(timings) - 1 - timingsLen ? (size_t)got : sizeof(timings) - 1 - timingsLen;
+            memcpy(timings + timingsLen, buffer, keep);
+            timingsLen += keep;
+            continue;
+        }
+        if (first) usageNoteFirstByte(0.0);
+        first = 0;
+        fwrite(buffer, 1, (size_t)got, out);
+        flightWrite(&flight, buffer, (size_t)got);
+    }
+    close(curlOut);
+
+    int curlStatus = 0;
+    deadlineWaitChild(curl, &curlStatus);
+    dropTempFile(tmppath);
+    int status = 0;
+    if (headerFd >= 0) {
+        status = noteHttpStatus(headerPath);
+        dropTempFile(headerPath);
+    }
+    if (timed && !buffered) {
+        FILE *timingsFile = fopen(timingsPath, "r");
+        if (timingsFile) {
+            timingsLen = fread(timings, 1, sizeof(timings) - 1, timingsFile);
+            timings[timingsLen] = '\0';
+            fclose(timingsFile);
+        }
+        dropTempFile(timingsPath);
+    }
+    if (timed) traceCurlTimings(timings, startUs, traceNowUs(), url);
+    if (buffered) {
+        FILE *resp = fopen(respPath, "rb");
+        if (resp) {
+            char buffer[65536];
+            size_t got;
+            while ((got = fread(buffer, 1, sizeof(buffer), resp)) > 0) {
+                fwrite(buffer, 1, got, out);
+                flightWrite(&flight, buffer, got);
+            }
+            fclose(resp);
+        }
+        dropTempFile(respPath);
+    }
+    /*
+     * Only a 2xx reply is shared. After a 429, a 5xx or a transport failure the
+     * waiters make their own calls, each with its own --retry budget.
+     */
+    flightEnd(&flight, status >= 200 && status < 300, status);
+    if (deadlineExpired()) return -1;
+    if (WIFEXITED(curlStatus) && WEXITSTATUS(curlStatus) == 28) {
+        fprintf(stderr, "Request to %s timed out after %.1fs.\n", url, budget);
+        httpTimedOut = 1;
+        return -1;
     }
+    return 0;
+}
 
-    pclose(p);
-    unlink(tmppath);
+int request_set(AIRequest *req, const char *url, const char *body) {
+    size_t urlLen = strlen(url);
+    size_t bodyLen = strlen(body);
+    req->url = malloc(urlLen + 1);
+    req->body = malloc(bodyLen + 1);
+    if (!req->url || !req->body) return -1;
+    memcpy(req->url, url, urlLen + 1);
+    memcpy(req->body, body, bodyLen + 1);
     return 0;
 }
 
+int request_add_header(AIRequest *req, const char *header) {
+    if (!header || !*header) return 0;
+    if (req->headerCount == AI_REQUEST_MAX_HEADERS) return -1;
+    size_t len = strlen(header);
+    char *copy = malloc(len + 1);
+    if (!copy) return -1;
+    memcpy(copy, header, len + 1);
+    req->headers[req->headerCount++] = copy;
+    return 0;
+}
+
+/* Blocking send through curl: the headers become -H arguments. */
+int request_perform(const AIRequest *req, FILE *out) {
+    char headers[4096];
+    size_t used = 0;
+    headers[0] = '\0';
+    for (size_t i = 0; i < req->headerCount && used < sizeof(headers); ++i) {
+        used += (size_t)snprintf(headers + used, sizeof(headers) - used, "%s-H '%s'", i ? " " : "", req->headers[i]);
+    }
+    if (req->stream && used < sizeof(headers)) snprintf(headers + used, sizeof(headers) - used, " -N");
+    return http_post(req->url, headers, req->body, out);
+}
+
+void request_free(AIRequest *req) {
+    free(req->url);
+    free(req->body);
+    for (size_t i = 0; i < req->headerCount; ++i) free(req->headers[i]);
+    memset(req, 0, sizeof(*req));
+}
+
 char* find_json_string(const char *json, const char *key) {
     char pattern[256];
     snprintf(pattern, sizeof(pattern), "\"%s\"", key);
@@ -196,13 +452,16 @@ char* find_json_string(const char *json, const char *key) {
 }
 
 char* extract_response(const char *ai_type, const char *json) {
-    if (strcmp(ai_type, "ollama") == 0) {
+    const AIProvider *provider = providerFind(ai_type);
+    if (!provider) return NULL;
+
+    if (provider->protocol == PROVIDER_OLLAMA) {
         return find_json_string(json, "response");
-    } else if (strcmp(ai_type, "chatgpt") == 0 || strcmp(ai_type, "deepseek") == 0) {
+    } else if (provider->protocol == PROVIDER_OPENAI) {
         const char *msg_start = strstr(json, "\"message\"");
         if (!msg_start) return NULL;
         return find_json_string(msg_start, "content");
-    } else if (strcmp(ai_type, "claude") == 0) {
+    } else if (provider->protocol == PROVIDER_ANTHROPIC) {
         return find_json_string(json, "text");
     }
     return NULL;
@@ -214,12 +473,32 @@ int callAiOnce(AIConfig *cfg, AIHandler handler, const char *input, const char *
         return 1;
     }
 
-    int ret = handler(cfg, input, sys_prompt, tmp);
+    /*
+     * With stream_out or stream_hook set the handler asks for a streamed reply;
+     * the decoder echoes it, feeds the hook and leaves the usual JSON in tmp.
+     */
+    FILE *target = tmp;
+    const AIProvider *provider = providerForConfig(cfg, cfg->ai_type);
+    if ((cfg->stream_out || cfg->stream_hook) && provider) {
+        cfg->stream_echoed = 0;
+        target = streamOpen(provider->protocol, cfg->stream_out, cfg->stream_hook, cfg->stream_hook_user, tmp, &cfg->stream_echoed);
+        if (!target) {
+            fclose(tmp);
+            return 1;
+        }
+    }
+
+    usageBeginCall();
+    TraceSpan callSpan = traceBegin("provider", cfg->ai_type);
+    int ret = handler(cfg, input, sys_prompt, target);
+    if (target != tmp) fclose(target);
+    traceEnd(&callSpan, NULL);
     if (ret != 0) {
         fclose(tmp);
         return ret;
     }
 
+    TraceSpan copySpan = traceBegin("core", "tmpfile_copy");
     rewind(tmp);
 
     size_t cap = 8192;
@@ -247,8 +526,22 @@ int callAiOnce(AIConfig *cfg, AIHandler handler, const char *input, const char *
     json[len] = '\0';
 
     fclose(tmp);
+    traceEnd(&copySpan, NULL);
+    usageRecordCall(cfg->ai_type, json);
 
+    TraceSpan extractSpan = traceBegin("core", "extract_response");
     char *response = extract_response(cfg->ai_type, json);
+    if (response && cfg->json_schema && provider && provider->protocol == PROVIDER_ANTHROPIC && response[0] != '{') {
+        /* The reply continues the '{' prefill, which the API does not echo back. */
+        char *braced = malloc(strlen(response) + 2);
+        if (braced) {
+            braced[0] = '{';
+            memcpy(braced + 1, response, strlen(response) + 1);
+        }
+        free(response);
+        response = braced;
+    }
+    traceEnd(&extractSpan, NULL);
 
     if (response_out) {
         *response_out = response;
@@ -265,54 +558,97 @@ int callAiOnce(AIConfig *cfg, AIHandler handler, const char *input, const char *
     return 0;
 }
 
-static int runStandardMode(AIConfig *cfg, AIHandler handler, const char *input, const char *sys_prompt, FILE *outf) {
+static int runStandardMode(AIConfig *cfg, AIHandler handler, const char *input, const char *sys_prompt, FILE *outf, char **final_out) {
     char *raw_json = NULL;
     char *response = NULL;
+    if (cfg->stream && !cfg->jsonl && !cfg->verbose) cfg->stream_out = outf;
     int ret = callAiOnce(cfg, handler, input, sys_prompt, &raw_json, &response);
+    cfg->stream_out = NULL;
     if (ret != 0) {
         if (raw_json) free(raw_json);
         if (response) free(response);
         return ret;
     }
 
-    if (cfg->verbose) {
+    if (cfg->jsonl) {
+        usageWriteRecord(outf, response, raw_json);
+    } else if (cfg->verbose) {
         if (raw_json) {
             fprintf(outf, "%s", raw_json);
         }
     } else if (response) {
-        fprintf(outf, "%s\n", response);
+        fprintf(outf, "%s\n", cfg->stream_echoed ? "" : response);
     } else if (raw_json) {
         fprintf(outf, "%s", raw_json);
     }
 
+    if (final_out) {
+        *final_out = response;
+        response = NULL;
+    }
+
     if (raw_json) free(raw_json);
     if (response) free(response);
     return 0;
 }
 
-int ai_execute(AIConfig *cfg) {
-    AIHandler handler = NULL;
-
-    if (strcmp(cfg->ai_type, "chatgpt") == 0) {
-        handler = chatgpt_call;
-    } else if (strcmp(cfg->ai_type, "ollama") == 0) {
-        handler = ollama_call;
-    } else if (strcmp(cfg->ai_type, "claude") == 0) {
-        handler = claude_call;
-    } else if (strcmp(cfg->ai_type, "deepseek") == 0) {
-        handler = deepseek_call;
-    } else {
+static int executeRun(AIConfig *cfg) {
+    cfg->provider = providerFind(cfg->ai_type);
+    if (!cfg->provider) {
+        size_t count = 0;
+        const AIProvider *providers = providerList(&count);
         fprintf(stderr, "Unknown AI: %s\n", cfg->ai_type);
-        fprintf(stderr, "Available AIs: chatgpt, ollama, claude, deepseek\n");
+        fprintf(stderr, "Available AIs:");
+        for (size_t i = 0; i < count; ++i) {
+            fprintf(stderr, "%s %s", i ? "," : "", providers[i].name);
+        }
+        fprintf(stderr, "\n");
         return 1;
     }
+    AIHandler handler = cfg->provider->handler;
+    if ((cfg->warmup || cfg->pin) && cfg->provider->protocol == PROVIDER_OLLAMA) {
+        TraceSpan warmupSpan = traceBegin("core", "warmup");
+        ollama_warmup(cfg);
+        traceEnd(&warmupSpan, NULL);
+    }
+
+    http_set_retries(cfg->retries);
+    if (cfg->retries > 0 && (cfg->stream || cfg->repl)) {
+        fprintf(stderr, "--retry buffers each reply until curl is done, so replies are not streamed.\n");
+    }
+    http_set_timeout(cfg->timeout);
+    if (cfg->singleflight) singleflightEnable();
+
+    if (cfg->repl) {
+        char *file_prompt = cfg->sys_prompt_file ? read_file(cfg->sys_prompt_file) : NULL;
+        int ret = runRepl(cfg, file_prompt ? file_prompt : cfg->sys_prompt);
+        free(file_prompt);
+        return ret;
+    }
 
+    TraceSpan readSpan = traceBegin("core", "read_input");
     char *input = cfg->input_file ? read_file(cfg->input_file) : read_stdin();
+    traceEnd(&readSpan, NULL);
     if (!input) {
         fprintf(stderr, "Failed to read input\n");
         return 1;
     }
 
+    AISession session;
+    int sessionOpened = 0;
+    char *user_input = input;
+    if (cfg->session_name) {
+        if (sessionOpen(&session, cfg->session_name) != 0) {
+            free(input);
+            return 1;
+        }
+        sessionOpened = 1;
+        char *prompt = sessionBuildPrompt(&session, sessionTurnLimit(cfg->session_turns), input);
+        if (prompt) {
+            input = prompt;
+        }
+    }
+
     char *sys_prompt = NULL;
     int sys_prompt_owned = 0;
     if (cfg->sys_prompt_file) {
@@ -324,21 +660,59 @@ int ai_execute(AIConfig *cfg) {
 
     FILE *outf = cfg->output_file ? fopen(cfg->output_file, "w") : stdout;
     if (!outf) {
-        free(input);
+        if (input != user_input) free(input);
+        free(user_input);
+        if (sessionOpened) sessionClose(&session);
         if (sys_prompt_owned && sys_prompt) free(sys_prompt);
         return 1;
     }
 
     int ret;
+    char *final_text = NULL;
+    char **final_out = sessionOpened ? &final_text : NULL;
     if (cfg->agentMode) {
-        ret = runAgentMode(cfg, handler, input, sys_prompt, outf);
+        ret = runAgentMode(cfg, handler, input, sys_prompt, outf, final_out);
     } else {
-        ret = runStandardMode(cfg, handler, input, sys_prompt, outf);
+        ret = runStandardMode(cfg, handler, input, sys_prompt, outf, final_out);
+    }
+
+    if (sessionOpened) {
+        if (ret == 0 && final_text) {
+            if (sessionAppend(&session, SESSION_ROLE_USER, user_input) != 0 ||
+                sessionAppend(&session, SESSION_ROLE_ASSISTANT, final_text) != 0) {
+                fprintf(stderr, "Failed to record turn in session '%s'.\n", cfg->session_name);
+            }
+        }
+        sessionClose(&session);
     }
 
     if (cfg->output_file) fclose(outf);
-    free(input);
+    if (final_text) free(final_text);
+    if (input != user_input) free(input);
+    free(user_input);
     if (sys_prompt_owned && sys_prompt) free(sys_prompt);
 
     return ret;
 }
+
+int ai_execute(AIConfig *cfg) {
+    deadlineInstall();
+    deadlineStart(cfg->deadline);
+    if (traceOpen(cfg->trace_file) != 0) {
+        fprintf(stderr, "Failed to enable tracing\n");
+        return 1;
+    }
+
+    TraceSpan runSpan = traceBegin("core", "run");
+    int ret = executeRun(cfg);
+    if (deadlineExpired()) {
+        fprintf(stderr, "Deadline of %gs exceeded.\n", cfg->deadline);
+        ret = 124;
+    } else if (httpTimedOut && ret != 0) {
+        ret = 124;
+    }
+    traceEnd(&runSpan, NULL);
+    traceClose();
+    usageReport(cfg);
+    return ret;
+}
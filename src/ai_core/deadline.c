@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "ai_core/deadline.h"
+
+#define DEADLINE_MAX_PATHS 16
+#define DEADLINE_MAX_CHILDREN 16
+#define DEADLINE_PATH_SIZE 64
+
+/* Slots are filled before they are marked used, so the handlers never see a half-written path. */
+typedef struct {
+    volatile sig_atomic_t used;
+    char path[DEADLINE_PATH_SIZE];
+} TrackedPath;
+
+static TrackedPath trackedPaths[DEADLINE_MAX_PATHS];
+static volatile pid_t trackedChildren[DEADLINE_MAX_CHILDREN];
+/* Early agent tools track from a worker thread; the lock serialises slot claims. The handlers only read. */
+static pthread_mutex_t trackLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t expired;
+static double deadlineAt;
+
+static double nowSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void killChildren(void) {
+    for (size_t i = 0; i < DEADLINE_MAX_CHILDREN; ++i) {
+        pid_t pgid = trackedChildren[i];
+        if (pgid > 0) kill(-pgid, SIGTERM);
+    }
+}
+
+static void onAlarm(int sig) {
+    (void)sig;
+    int savedErrno = errno;
+    expired = 1;
+    killChildren();
+    errno = savedErrno;
+}
+
+static void onTerminate(int sig) {
+    killChildren();
+    for (size_t i = 0; i < DEADLINE_MAX_PATHS; ++i) {
+        if (trackedPaths[i].used) unlink(trackedPaths[i].path);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void deadlineInstall(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = onTerminate;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+    /* No SA_RESTART: a wait that the deadline interrupts should notice it. */
+    action.sa_handler = onAlarm;
+    sigaction(SIGALRM, &action, NULL);
+}
+
+void deadlineStart(double seconds) {
+    if (seconds <= 0) return;
+    deadlineAt = nowSeconds() + seconds;
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec = (time_t)seconds;
+    timer.it_value.tv_usec = (suseconds_t)((seconds - (double)(time_t)seconds) * 1e6);
+    if (timer.it_value.tv_sec == 0 && timer.it_value.tv_usec == 0) timer.it_value.tv_usec = 1;
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+int deadlineExpired(void) {
+    if (expired) return 1;
+    if (deadlineAt > 0 && nowSeconds() >= deadlineAt) expired = 1;
+    return expired;
+}
+
+double deadlineBudget(double timeout) {
+    if (deadlineAt <= 0) return timeout > 0 ? timeout : 0;
+    double remaining = deadlineAt - nowSeconds();
+    if (remaining <= 0 || expired) return -1;
+    return timeout > 0 && timeout < remaining ? timeout : remaining;
+}
+
+void deadlineTrackPath(const char *path) {
+    if (strlen(path) >= DEADLINE_PATH_SIZE) return;
+    pthread_mutex_lock(&trackLock);
+    for (size_t i = 0; i < DEADLINE_MAX_PATHS; ++i) {
+        if (!trackedPaths[i].used) {
+            memcpy(trackedPaths[i].path, path, strlen(path) + 1);
+            trackedPaths[i].used = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trackLock);
+}
+
+void deadlineUntrackPath(const char *path) {
+    pthread_mutex_lock(&trackLock);
+    for (size_t i = 0; i < DEADLINE_MAX_PATHS; ++i) {
+        if (trackedPaths[i].used && strcmp(trackedPaths[i].path, path) == 0) {
+            trackedPaths[i].used = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trackLock);
+}
+
+void deadlineTrackChild(pid_t pgid) {
+    pthread_mutex_lock(&trackLock);
+    for (size_t i = 0; i < DEADLINE_MAX_CHILDREN; ++i) {
+        if (trackedChildren[i] == 0) {
+            trackedChildren[i] = pgid;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trackLock);
+}
+
+void deadlineUntrackChild(pid_t pgid) {
+    pthread_mutex_lock(&trackLock);
+    for (size_t i = 0; i < DEADLINE_MAX_CHILDREN; ++i) {
+        if (trackedChildren[i] == pgid) {
+            trackedChildren[i] = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trackLock);
+}
+
+pid_t deadlineSpawnShell(const char *command, int *stdoutFd) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+
+    /* Held off until the child is tracked, so a signal in between cannot orphan it. */
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGHUP);
+    sigaddset(&blocked, SIGALRM);
+    sigprocmask(SIG_BLOCK, &blocked, &previous);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGALRM, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+        dup2(fds[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+    if (pid > 0) {
+        setpgid(pid, pid);
+        deadlineTrackChild(pid);
+        /* Started after the deadline passed: the timer has already fired, so kill it here. */
+        if (expired) kill(-pid, SIGTERM);
+    }
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    *stdoutFd = fds[0];
+    return pid;
+}
+
+int deadlineWaitChild(pid_t pid, int *status) {
+    pid_t got;
+    while ((got = waitpid(pid, status, 0)) < 0 && errno == EINTR) {
+    }
+    deadlineUntrackChild(pid);
+    return got == pid ? 0 : -1;
+}
@@ -0,0 +1,31 @@
+#ifndef AI_CORE_DEADLINE_H
+#define AI_CORE_DEADLINE_H
+
+#include <sys/types.h>
+
+/*
+ * Run deadline and signal cleanup. --deadline arms a timer for the whole
+ * run. Provider requests get what is left of it, capped by --timeout, as
+ * curl's --max-time. When the timer fires, every tracked child process
+ * group (curl, tool commands) is killed, so blocked reads return and the
+ * run stops. SIGINT, SIGTERM and SIGHUP also kill the tracked children and
+ * unlink the tracked temp files before the process dies of the signal.
+ */
+void deadlineInstall(void);
+void deadlineStart(double seconds);
+int deadlineExpired(void);
+/* Seconds a request may take: min(timeout, remaining); 0 means unbounded, negative means none left. */
+double deadlineBudget(double timeout);
+
+/* Paths up to 63 bytes; the handler unlinks them. */
+void deadlineTrackPath(const char *path);
+void deadlineUntrackPath(const char *path);
+void deadlineTrackChild(pid_t pgid);
+void deadlineUntrackChild(pid_t pgid);
+
+/* Runs command with sh -c in its own tracked process group; *stdoutFd reads its output. */
+pid_t deadlineSpawnShell(const char *command, int *stdoutFd);
+/* waitpid for a child from deadlineSpawnShell, then untracks it. */
+int deadlineWaitChild(pid_t pid, int *status);
+
+#endif
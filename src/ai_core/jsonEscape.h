@@ -0,0 +1,17 @@
+#ifndef AI_CORE_JSON_ESCAPE_H
+#define AI_CORE_JSON_ESCAPE_H
+
+#include <stddef.h>
+
+/*
+ * The JSON string escapers of each provider handler and of the tools. They
+ * are only meant for their own file; they are exported so the microbench in
+ * tests/bench/jsonKernels.c can time each kernel as shipped.
+ */
+char* claudeEscapeJson(const char *str);
+char* deepseekEscapeJson(const char *str);
+char* ollamaEscapeJson(const char *str);
+void chatgptEscapeJson(const char *str, char *out, size_t max);
+char* toolsEscapeJson(const char *src);
+
+#endif
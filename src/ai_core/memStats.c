@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "ai_core/memStats.h"
+
+#define MEM_STATS_MAX_PHASES 64
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+typedef struct {
+    char name[48];
+    size_t allocs;
+    size_t frees;
+    size_t reallocs;
+    size_t allocBytes;
+    size_t reallocCopied;
+    long long peakLive;
+} MemPhase;
+
+typedef struct {
+    int enabled;
+    int current;
+    int phaseCount;
+    long long live;
+    long long peak;
+    MemPhase phases[MEM_STATS_MAX_PHASES];
+} MemStatsState;
+
+static MemStatsState memState;
+
+static void notePeak(long long live) {
+    MemPhase *phase = &memState.phases[memState.current];
+    if (live > phase->peakLive) phase->peakLive = live;
+    if (live > memState.peak) memState.peak = live;
+}
+
+static void noteAlloc(void *ptr) {
+    size_t size = malloc_usable_size(ptr);
+    MemPhase *phase = &memState.phases[memState.current];
+    __atomic_add_fetch(&phase->allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&phase->allocBytes, size, __ATOMIC_RELAXED);
+    notePeak(__atomic_add_fetch(&memState.live, (long long)size, __ATOMIC_RELAXED));
+}
+
+static void noteFree(void *ptr) {
+    size_t size = malloc_usable_size(ptr);
+    __atomic_add_fetch(&memState.phases[memState.current].frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&memState.live, (long long)size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    if (memState.enabled && ptr) noteAlloc(ptr);
+    return ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+    void *ptr = __libc_calloc(count, size);
+    if (memState.enabled && ptr) noteAlloc(ptr);
+    return ptr;
+}
+
+void *realloc(void *old, size_t size) {
+    if (!memState.enabled) return __libc_realloc(old, size);
+    if (!old) return malloc(size);
+
+    size_t oldSize = malloc_usable_size(old);
+    void *ptr = __libc_realloc(old, size);
+    if (!ptr) {
+        /* realloc(p, 0) frees p; any other failure leaves it untouched. */
+        if (size == 0) __atomic_sub_fetch(&memState.live, (long long)oldSize, __ATOMIC_RELAXED);
+        return ptr;
+    }
+
+    size_t newSize = malloc_usable_size(ptr);
+    MemPhase *phase = &memState.phases[memState.current];
+    __atomic_add_fetch(&phase->reallocs, 1, __ATOMIC_RELAXED);
+    if (newSize > oldSize) __atomic_add_fetch(&phase->allocBytes, newSize - oldSize, __ATOMIC_RELAXED);
+    if (ptr != old) __atomic_add_fetch(&phase->reallocCopied, oldSize < newSize ? oldSize : newSize, __ATOMIC_RELAXED);
+    notePeak(__atomic_add_fetch(&memState.live, (long long)newSize - (long long)oldSize, __ATOMIC_RELAXED));
+    return ptr;
+}
+
+void free(void *ptr) {
+    if (memState.enabled && ptr) noteFree(ptr);
+    __libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    if (memState.enabled && ptr) noteAlloc(ptr);
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    void *ptr = memalign(alignment, size);
+    if (!ptr) return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+
+void memStatsEnable(void) {
+    strcpy(memState.phases[0].name, "(outside spans)");
+    memState.phaseCount = 1;
+    memState.enabled = 1;
+}
+
+/* Makes category/name the current phase; the token restores the previous one. */
+int memStatsEnter(const char *category, const char *name) {
+    if (!memState.enabled) return 0;
+
+    char key[sizeof(memState.phases[0].name)];
+    snprintf(key, sizeof(key), "%s/%s", category ? category : "", name ? name : "");
+    int index = 0;
+    while (index < memState.phaseCount && strcmp(memState.phases[index].name, key) != 0) index++;
+    if (index == memState.phaseCount) {
+        if (memState.phaseCount == MEM_STATS_MAX_PHASES) {
+            index = 0;
+        } else {
+            memcpy(memState.phases[index].name, key, sizeof(key));
+            memState.phaseCount++;
+        }
+    }
+
+    int token = memState.current + 1;
+    memState.current = index;
+    return token;
+}
+
+void memStatsLeave(int token) {
+    if (memState.enabled && token > 0) memState.current = token - 1;
+}
+
+static double mib(double bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+void memStatsReport(FILE *out) {
+    if (!memState.enabled) return;
+    memState.enabled = 0;
+
+    size_t allocs = 0, frees = 0, reallocs = 0, allocBytes = 0, copied = 0;
+    fprintf(out, "[mem] %-26s %8s %8s %8s %11s %11s %11s\n", "phase", "allocs", "frees", "reallocs", "alloc MiB", "copied MiB", "peak MiB");
+    for (int i = 0; i < memState.phaseCount; ++i) {
+        const MemPhase *phase = &memState.phases[i];
+        if (!phase->allocs && !phase->frees && !phase->reallocs) continue;
+        fprintf(out, "[mem] %-26s %8zu %8zu %8zu %11.3f %11.3f %11.3f\n", phase->name, phase->allocs, phase->frees,
+                phase->reallocs, mib((double)phase->allocBytes), mib((double)phase->reallocCopied), mib((double)phase->peakLive));
+        allocs += phase->allocs;
+        frees += phase->frees;
+        reallocs += phase->reallocs;
+        allocBytes += phase->allocBytes;
+        copied += phase->reallocCopied;
+    }
+    fprintf(out, "[mem] %-26s %8zu %8zu %8zu %11.3f %11.3f %11.3f\n", "total", allocs, frees, reallocs,
+            mib((double)allocBytes), mib((double)copied), mib((double)memState.peak));
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        fprintf(out, "[mem] live at exit %.3f MiB, peak RSS %.3f MiB", mib((double)memState.live), usage.ru_maxrss / 1024.0);
+        if (getrusage(RUSAGE_CHILDREN, &usage) == 0 && usage.ru_maxrss > 0) {
+            fprintf(out, ", largest child peak RSS %.3f MiB", usage.ru_maxrss / 1024.0);
+        }
+        fputc('\n', out);
+    }
+}
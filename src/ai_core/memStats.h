@@ -0,0 +1,19 @@
+#ifndef AI_CORE_MEM_STATS_H
+#define AI_CORE_MEM_STATS_H
+
+#include <stdio.h>
+
+/*
+ * --mem-stats: malloc, calloc, realloc, free and the memalign family are
+ * wrapped (forwarding to glibc's __libc_* entry points) and, once enabled,
+ * counted per phase. Phases are the trace spans (see trace.h), so the
+ * innermost open span gets the allocations. Sizes are malloc_usable_size, so
+ * frees need no header. mmap'ed reads are not counted; getrusage's peak RSS
+ * in the report covers them.
+ */
+void memStatsEnable(void);
+int memStatsEnter(const char *category, const char *name);
+void memStatsLeave(int token);
+void memStatsReport(FILE *out);
+
+#endif
@@ -0,0 +1,250 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ai_core/providers.h"
+
+typedef struct {
+    AIProvider *items;
+    size_t count;
+    size_t cap;
+    int loaded;
+} ProviderRegistry;
+
+static ProviderRegistry registry;
+
+static const struct {
+    const char *name;
+    ProviderProtocol protocol;
+    AIHandler handler;
+    AIRequestBuilder builder;
+    const char *url;
+    const char *model;
+    const char *authHeader;
+    const char *keyEnv;
+} builtinProviders[] = {
+    { "chatgpt", PROVIDER_OPENAI, chatgpt_call, chatgpt_build, "https://api.openai.com/v1/chat/completions", "gpt-4", "Authorization: Bearer", "OPENAI_API_KEY" },
+    { "ollama", PROVIDER_OLLAMA, ollama_call, ollama_build, "http://localhost:11434/api/generate", "llama2", NULL, NULL },
+    { "claude", PROVIDER_ANTHROPIC, claude_call, claude_build, "https://api.anthropic.com/v1/messages", "claude-3-5-sonnet-20241022", "x-api-key:", "ANTHROPIC_API_KEY" },
+    { "deepseek", PROVIDER_OPENAI, deepseek_call, deepseek_build, "https://api.deepseek.com/chat/completions", "deepseek-chat", "Authorization: Bearer", "DEEPSEEK_API_KEY" },
+};
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static char* trimInPlace(char *text) {
+    while (isspace((unsigned char)*text)) text++;
+    size_t len = strlen(text);
+    while (len > 0 && isspace((unsigned char)text[len - 1])) text[--len] = '\0';
+    return text;
+}
+
+static AIProvider* registryFind(const char *name) {
+    for (size_t i = 0; i < registry.count; ++i) {
+        if (strcmp(registry.items[i].name, name) == 0) return &registry.items[i];
+    }
+    return NULL;
+}
+
+static AIProvider* registryAdd(const char *name) {
+    AIProvider *existing = registryFind(name);
+    if (existing) return existing;
+
+    if (registry.count == registry.cap) {
+        size_t newCap = registry.cap ? registry.cap * 2 : 8;
+        AIProvider *resized = realloc(registry.items, newCap * sizeof(AIProvider));
+        if (!resized) return NULL;
+        registry.items = resized;
+        registry.cap = newCap;
+    }
+
+    AIProvider *provider = &registry.items[registry.count];
+    memset(provider, 0, sizeof(*provider));
+    provider->name = duplicateString(name);
+    if (!provider->name) return NULL;
+    provider->protocol = PROVIDER_OPENAI;
+    provider->handler = chatgpt_call;
+    provider->builder = chatgpt_build;
+    provider->model = duplicateString("default");
+    registry.count++;
+    return provider;
+}
+
+static void replaceField(char **field, const char *value) {
+    free(*field);
+    *field = value && *value ? duplicateString(value) : NULL;
+}
+
+static void freeProvider(AIProvider *provider) {
+    free(provider->name);
+    free(provider->url);
+    free(provider->model);
+    free(provider->authHeader);
+    free(provider->keyEnv);
+    free(provider->key);
+    free(provider->keepAlive);
+}
+
+static const char* builtinUrl(const char *name) {
+    for (size_t i = 0; i < sizeof(builtinProviders) / sizeof(builtinProviders[0]); ++i) {
+        if (strcmp(builtinProviders[i].name, name) == 0) return builtinProviders[i].url;
+    }
+    return NULL;
+}
+
+/* The request builders need a url: a built-in falls back to its default, any other provider without one is dropped. */
+static void requireUrls(const char *path) {
+    size_t kept = 0;
+    for (size_t i = 0; i < registry.count; ++i) {
+        AIProvider *provider = &registry.items[i];
+        if (!provider->url) replaceField(&provider->url, builtinUrl(provider->name));
+        if (!provider->url) {
+            fprintf(stderr, "%s: provider %s has no url; ignoring it\n", path, provider->name);
+            freeProvider(provider);
+            continue;
+        }
+        registry.items[kept++] = *provider;
+    }
+    registry.count = kept;
+}
+
+static int applySetting(AIProvider *provider, const char *key, const char *value) {
+    if (strcmp(key, "type") == 0) {
+        if (strcmp(value, "openai") == 0) {
+            provider->protocol = PROVIDER_OPENAI;
+            provider->handler = chatgpt_call;
+            provider->builder = chatgpt_build;
+        } else if (strcmp(value, "anthropic") == 0) {
+            provider->protocol = PROVIDER_ANTHROPIC;
+            provider->handler = claude_call;
+            provider->builder = claude_build;
+        } else if (strcmp(value, "ollama") == 0) {
+            provider->protocol = PROVIDER_OLLAMA;
+            provider->handler = ollama_call;
+            provider->builder = ollama_build;
+        } else {
+            return -1;
+        }
+    } else if (strcmp(key, "url") == 0) {
+        replaceField(&provider->url, value);
+    } else if (strcmp(key, "model") == 0) {
+        replaceField(&provider->model, value);
+    } else if (strcmp(key, "auth_header") == 0) {
+        replaceField(&provider->authHeader, value);
+    } else if (strcmp(key, "key_env") == 0) {
+        replaceField(&provider->keyEnv, value);
+    } else if (strcmp(key, "key") == 0) {
+        replaceField(&provider->key, value);
+    } else if (strcmp(key, "keep_alive") == 0) {
+        replaceField(&provider->keepAlive, value);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static void loadConfig(void) {
+    char *dir = get_ai_dir(NULL);
+    if (!dir) return;
+
+    size_t len = strlen(dir) + strlen("/config") + 1;
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s/config", dir);
+    free(dir);
+    FILE *f = path ? fopen(path, "r") : NULL;
+    if (!f) {
+        free(path);
+        return;
+    }
+
+    char line[1024];
+    int lineNumber = 0;
+    AIProvider *current = NULL;
+    while (fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        /* '#' starts a comment at line start or after whitespace, so URLs keep fragments. */
+        for (char *hash = strchr(line, '#'); hash; hash = strchr(hash + 1, '#')) {
+            if (hash == line || isspace((unsigned char)hash[-1])) {
+                *hash = '\0';
+                break;
+            }
+        }
+        char *text = trimInPlace(line);
+        if (!*text) continue;
+
+        if (*text == '[') {
+            char *close = strchr(text, ']');
+            current = NULL;
+            if (close && strncmp(text, "[provider", 9) == 0 && isspace((unsigned char)text[9])) {
+                *close = '\0';
+                char *name = trimInPlace(text + 10);
+                if (*name) current = registryAdd(name);
+            }
+            /* Other sections are left to whoever reads them. */
+            continue;
+        }
+
+        char *equals = strchr(text, '=');
+        if (!current || !equals) continue;
+        *equals = '\0';
+        char *key = trimInPlace(text);
+        char *value = trimInPlace(equals + 1);
+        if (applySetting(current, key, value) != 0) {
+            fprintf(stderr, "%s:%d: unknown provider setting '%s = %s'\n", path, lineNumber, key, value);
+        }
+    }
+    fclose(f);
+    requireUrls(path);
+    free(path);
+}
+
+static void ensureLoaded(void) {
+    if (registry.loaded) return;
+    registry.loaded = 1;
+
+    for (size_t i = 0; i < sizeof(builtinProviders) / sizeof(builtinProviders[0]); ++i) {
+        AIProvider *provider = registryAdd(builtinProviders[i].name);
+        if (!provider) return;
+        provider->protocol = builtinProviders[i].protocol;
+        provider->handler = builtinProviders[i].handler;
+        provider->builder = builtinProviders[i].builder;
+        replaceField(&provider->url, builtinProviders[i].url);
+        replaceField(&provider->model, builtinProviders[i].model);
+        replaceField(&provider->authHeader, builtinProviders[i].authHeader);
+        replaceField(&provider->keyEnv, builtinProviders[i].keyEnv);
+    }
+    loadConfig();
+}
+
+const AIProvider* providerFind(const char *name) {
+    if (!name) return NULL;
+    ensureLoaded();
+    return registryFind(name);
+}
+
+const AIProvider* providerList(size_t *count) {
+    ensureLoaded();
+    if (count) *count = registry.count;
+    return registry.items;
+}
+
+const AIProvider* providerForConfig(const AIConfig *cfg, const char *fallbackName) {
+    if (cfg && cfg->provider) return cfg->provider;
+    return providerFind(fallbackName);
+}
+
+/* Writes the "<auth_header> <key>" header line, or an empty string for keyless providers. */
+void providerAuthHeader(const AIProvider *provider, const char *key, char *out, size_t max) {
+    if (!provider || !provider->authHeader || !key) {
+        if (max) out[0] = '\0';
+        return;
+    }
+    snprintf(out, max, "%s %s", provider->authHeader, key);
+}
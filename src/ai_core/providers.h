@@ -0,0 +1,44 @@
+#ifndef AI_CORE_PROVIDERS_H
+#define AI_CORE_PROVIDERS_H
+
+#include <stddef.h>
+#include "ai.h"
+
+/*
+ * Provider registry: the built-in chatgpt, claude, deepseek and ollama
+ * entries, then [provider NAME] sections from ~/.gipwrap/config, which add
+ * backends or override fields of a built-in one:
+ *
+ *   [provider local]
+ *   type = openai                 # openai | anthropic | ollama wire format
+ *   url = http://127.0.0.1:8000/v1/chat/completions
+ *   model = qwen2.5-7b-instruct
+ *   auth_header = Authorization: Bearer   # key is appended; omit for none
+ *   key_env = LOCAL_LLM_KEY       # or key = ...
+ *   keep_alive = 30m              # ollama only: sent with every request
+ */
+typedef enum {
+    PROVIDER_OPENAI,
+    PROVIDER_ANTHROPIC,
+    PROVIDER_OLLAMA
+} ProviderProtocol;
+
+struct AIProvider {
+    char *name;
+    ProviderProtocol protocol;
+    AIHandler handler;
+    AIRequestBuilder builder;
+    char *url;
+    char *model;
+    char *authHeader;
+    char *keyEnv;
+    char *key;
+    char *keepAlive;
+};
+
+const AIProvider* providerFind(const char *name);
+const AIProvider* providerList(size_t *count);
+const AIProvider* providerForConfig(const AIConfig *cfg, const char *fallbackName);
+void providerAuthHeader(const AIProvider *provider, const char *key, char *out, size_t max);
+
+#endif
@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ai.h"
+#include "ai_core/agent.h"
+#include "ai_core/core.h"
+#include "ai_core/providers.h"
+#include "ai_core/repl.h"
+#include "ai_core/session.h"
+#include "ai_core/usage.h"
+
+typedef struct {
+    AISessionTurn *turns;
+    size_t count;
+    size_t cap;
+    char *context;
+    char *model;
+    AISession session;
+    int sessionOpened;
+    int turnNumber;
+} ReplState;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static void dropContext(ReplState *state) {
+    free(state->context);
+    state->context = NULL;
+}
+
+static void forgetTurns(ReplState *state) {
+    sessionFreeTurns(state->turns, state->count);
+    state->turns = NULL;
+    state->count = 0;
+    state->cap = 0;
+    dropContext(state);
+}
+
+static int rememberTurn(ReplState *state, int role, const char *text) {
+    if (state->count == state->cap) {
+        size_t newCap = state->cap ? state->cap * 2 : 16;
+        AISessionTurn *resized = realloc(state->turns, newCap * sizeof(AISessionTurn));
+        if (!resized) return -1;
+        state->turns = resized;
+        state->cap = newCap;
+    }
+    char *copy = duplicateString(text);
+    if (!copy) return -1;
+    state->turns[state->count].role = role;
+    state->turns[state->count].timestamp = (int64_t)time(NULL);
+    state->turns[state->count].text = copy;
+    state->count++;
+    return 0;
+}
+
+static const char* currentModel(const AIConfig *cfg) {
+    return cfg->model ? cfg->model : cfg->provider->model;
+}
+
+/* Reads one prompt; lines ending in '\' continue it. NULL at end of input. */
+static char* readPrompt(FILE *in, int interactive) {
+    char *text = NULL;
+    size_t len = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t got;
+    while ((got = getline(&line, &cap, in)) >= 0) {
+        while (got > 0 && (line[got - 1] == '\n' || line[got - 1] == '\r')) line[--got] = '\0';
+        int more = got > 0 && line[got - 1] == '\\';
+        if (more) line[--got] = '\n';
+
+        char *resized = realloc(text, len + (size_t)got + 1);
+        if (!resized) break;
+        text = resized;
+        memcpy(text + len, line, (size_t)got);
+        len += (size_t)got;
+        text[len] = '\0';
+        if (!more) break;
+        if (interactive) fprintf(stderr, "... ");
+    }
+    free(line);
+    return text;
+}
+
+static void printHistory(const ReplState *state, FILE *out) {
+    for (size_t i = 0; i < state->count; ++i) {
+        fprintf(out, "%s: %s\n\n", state->turns[i].role == SESSION_ROLE_USER ? "User" : "Assistant", state->turns[i].text);
+    }
+}
+
+/* Returns 1 when the REPL should exit. */
+static int runCommand(AIConfig *cfg, ReplState *state, char *line) {
+    char *name = line + 1;
+    char *arg = name + strcspn(name, " \t");
+    if (*arg) *arg++ = '\0';
+    arg += strspn(arg, " \t");
+
+    if (strcmp(name, "quit") == 0 || strcmp(name, "exit") == 0) {
+        return 1;
+    } else if (strcmp(name, "model") == 0) {
+        free(state->model);
+        state->model = *arg ? duplicateString(arg) : NULL;
+        cfg->model = state->model;
+        dropContext(state);
+        fprintf(stderr, "model: %s\n", currentModel(cfg));
+    } else if (strcmp(name, "provider") == 0) {
+        const AIProvider *provider = providerFind(arg);
+        if (!provider) {
+            size_t count = 0;
+            const AIProvider *providers = providerList(&count);
+            fprintf(stderr, "Unknown provider '%s'. Available:", arg);
+            for (size_t i = 0; i < count; ++i) fprintf(stderr, "%s %s", i ? "," : "", providers[i].name);
+            fprintf(stderr, "\n");
+            return 0;
+        }
+        cfg->provider = provider;
+        cfg->ai_type = provider->name;
+        free(state->model);
+        state->model = NULL;
+        cfg->model = NULL;
+        dropContext(state);
+        fprintf(stderr, "provider: %s, model: %s\n", provider->name, currentModel(cfg));
+    } else if (strcmp(name, "reset") == 0) {
+        forgetTurns(state);
+    } else if (strcmp(name, "history") == 0) {
+        printHistory(state, stdout);
+    } else {
+        fprintf(stderr,
+            "/model [NAME]    switch model (no name: the provider's default)\n"
+            "/provider NAME   switch provider; the model resets to its default\n"
+            "/reset           forget the conversation\n"
+            "/history         print the conversation\n"
+            "/quit            leave (as does end of input)\n");
+    }
+    return 0;
+}
+
+static void runTurn(AIConfig *cfg, ReplState *state, const char *sys_prompt, const char *line) {
+    int ollama = cfg->provider->protocol == PROVIDER_OLLAMA;
+    int reuseContext = ollama && state->context && !cfg->agentMode;
+    size_t maxTurns = sessionTurnLimit(cfg->session_turns);
+    size_t first = state->count > maxTurns ? state->count - maxTurns : 0;
+    char *prompt = reuseContext ? NULL : sessionRenderPrompt(state->turns + first, state->count - first, line);
+    if (!reuseContext && !prompt) return;
+
+    usageSetStep(++state->turnNumber);
+    char *reply = NULL;
+    int ret;
+    if (cfg->agentMode) {
+        ret = runAgentMode(cfg, cfg->provider->handler, prompt, sys_prompt, stdout, &reply);
+    } else {
+        char *raw_json = NULL;
+        cfg->ollama_context = reuseContext ? state->context : NULL;
+        cfg->stream_out = stdout;
+        ret = callAiOnce(cfg, cfg->provider->handler, reuseContext ? line : prompt, sys_prompt, &raw_json, &reply);
+        cfg->stream_out = NULL;
+        cfg->ollama_context = NULL;
+        if (ret == 0) {
+            if (!reply) {
+                fprintf(stdout, "%s\n", raw_json ? raw_json : "(empty reply)");
+            } else {
+                fprintf(stdout, "%s\n", cfg->stream_echoed ? "" : reply);
+            }
+            fflush(stdout);
+            if (cfg->verbose && raw_json) fprintf(stderr, "%s\n", raw_json);
+            if (reply && ollama) {
+                dropContext(state);
+                state->context = ollama_extract_context(raw_json);
+            }
+        }
+        free(raw_json);
+    }
+    fflush(stdout);
+    free(prompt);
+
+    if (ret != 0) {
+        fprintf(stderr, "Request to %s failed.\n", cfg->provider->name);
+    } else if (reply) {
+        if (rememberTurn(state, SESSION_ROLE_USER, line) != 0 || rememberTurn(state, SESSION_ROLE_ASSISTANT, reply) != 0) {
+            fprintf(stderr, "Out of memory; turn not kept in history.\n");
+        }
+        if (state->sessionOpened &&
+            (sessionAppend(&state->session, SESSION_ROLE_USER, line) != 0 ||
+             sessionAppend(&state->session, SESSION_ROLE_ASSISTANT, reply) != 0)) {
+            fprintf(stderr, "Failed to record turn in session '%s'.\n", cfg->session_name);
+        }
+    }
+    free(reply);
+}
+
+int runRepl(AIConfig *cfg, const char *sys_prompt) {
+    ReplState state = { 0 };
+    char *originalModel = cfg->model;
+    if (cfg->session_name) {
+        if (sessionOpen(&state.session, cfg->session_name) != 0) return 1;
+        state.sessionOpened = 1;
+        if (sessionLoadTurns(&state.session, sessionTurnLimit(cfg->session_turns), &state.turns, &state.count) != 0) {
+            fprintf(stderr, "Failed to load session '%s'; starting without history.\n", cfg->session_name);
+        }
+        state.cap = state.count;
+    }
+
+    int interactive = isatty(STDIN_FILENO);
+    for (;;) {
+        if (interactive) fprintf(stderr, "%s/%s> ", cfg->provider->name, currentModel(cfg));
+        char *line = readPrompt(stdin, interactive);
+        if (!line) break;
+
+        int quit = 0;
+        if (line[0] == '/') {
+            quit = runCommand(cfg, &state, line);
+        } else if (line[strspn(line, " \t\n")] != '\0') {
+            runTurn(cfg, &state, sys_prompt, line);
+        }
+        free(line);
+        if (quit) break;
+    }
+
+    forgetTurns(&state);
+    if (state.sessionOpened) sessionClose(&state.session);
+    cfg->model = originalModel;
+    free(state.model);
+    return 0;
+}
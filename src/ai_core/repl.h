@@ -0,0 +1,16 @@
+#ifndef AI_CORE_REPL_H
+#define AI_CORE_REPL_H
+
+#include "ai.h"
+
+/*
+ * -r: read prompts line by line (a trailing '\' continues the line) and
+ * stream each reply to stdout. The provider, key and system prompt are
+ * resolved once. The turns stay in memory, and with --session they are also
+ * loaded from and appended to the session. ollama continues from the previous
+ * reply's context tokens instead of a re-rendered transcript. Lines starting
+ * with '/' are commands; /help lists them.
+ */
+int runRepl(AIConfig *cfg, const char *sys_prompt);
+
+#endif
@@ -0,0 +1,469 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "ai.h"
+#include "ai_core/session.h"
+
+#define SESSION_LOG_MAGIC 0x474c5347u
+#define SESSION_IDX_MAGIC 0x58495347u
+#define SESSION_REC_MAGIC 0x43525347u
+#define SESSION_VERSION 1u
+
+/* Compaction keeps the newest SESSION_RETAIN_TURNS once the log passes SESSION_COMPACT_TURNS. */
+#define SESSION_COMPACT_TURNS 512
+#define SESSION_RETAIN_TURNS 256
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+} SessionFileHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t role;
+    uint64_t length;
+    int64_t timestamp;
+} SessionRecordHeader;
+
+static char* formatPath(const char *dir, const char *name, const char *ext) {
+    size_t len = strlen(dir) + strlen(name) + strlen(ext) + 2;
+    char *path = malloc(len);
+    if (!path) return NULL;
+    snprintf(path, len, "%s/%s%s", dir, name, ext);
+    return path;
+}
+
+static int isValidSessionName(const char *name) {
+    if (!name || !*name || name[0] == '.') {
+        return 0;
+    }
+    for (const char *p = name; *p; ++p) {
+        if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_' && *p != '.') {
+            return 0;
+        }
+    }
+    return strlen(name) <= 128;
+}
+
+static int preadFull(int fd, void *buf, size_t len, off_t offset) {
+    char *dst = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, dst, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        dst += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int pwriteFull(int fd, const void *buf, size_t len, off_t offset) {
+    const char *src = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, src, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        src += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+static off_t fileSize(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    return st.st_size;
+}
+
+static int sameInode(int fd, const char *path) {
+    struct stat fdStat;
+    struct stat pathStat;
+    if (fstat(fd, &fdStat) != 0 || stat(path, &pathStat) != 0) return 0;
+    return fdStat.st_ino == pathStat.st_ino && fdStat.st_dev == pathStat.st_dev;
+}
+
+static int writeFileHeader(int fd, uint32_t magic, uint64_t generation) {
+    SessionFileHeader header = { magic, SESSION_VERSION, generation };
+    if (ftruncate(fd, 0) != 0) return -1;
+    return pwriteFull(fd, &header, sizeof(header), 0);
+}
+
+static int readFileHeader(int fd, uint32_t magic, SessionFileHeader *header) {
+    if (preadFull(fd, header, sizeof(*header), 0) != 0) return -1;
+    if (header->magic != magic || header->version != SESSION_VERSION) return -1;
+    return 0;
+}
+
+static int readRecordHeader(int fd, off_t offset, off_t limit, SessionRecordHeader *record) {
+    if (offset + (off_t)sizeof(*record) > limit) return -1;
+    if (preadFull(fd, record, sizeof(*record), offset) != 0) return -1;
+    if (record->magic != SESSION_REC_MAGIC) return -1;
+    if (record->length > (uint64_t)(limit - offset - (off_t)sizeof(*record))) return -1;
+    return 0;
+}
+
+/* Slow path, only taken after a crash mid-compaction: re-derive NAME.idx from NAME.log. */
+static int rebuildIndex(AISession *session, uint64_t generation) {
+    off_t logSize = fileSize(session->logFd);
+    if (logSize < 0) return -1;
+    if (writeFileHeader(session->idxFd, SESSION_IDX_MAGIC, generation) != 0) return -1;
+
+    off_t offset = sizeof(SessionFileHeader);
+    off_t idxPos = sizeof(SessionFileHeader);
+    uint64_t count = 0;
+    SessionRecordHeader record;
+    while (readRecordHeader(session->logFd, offset, logSize, &record) == 0) {
+        uint64_t entry = (uint64_t)offset;
+        if (pwriteFull(session->idxFd, &entry, sizeof(entry), idxPos) != 0) return -1;
+        idxPos += sizeof(entry);
+        offset += (off_t)sizeof(record) + (off_t)record.length;
+        count++;
+    }
+
+    if (offset != logSize && ftruncate(session->logFd, offset) != 0) return -1;
+    session->turnCount = count;
+    return 0;
+}
+
+static int reopenFile(int *fd, const char *path) {
+    if (*fd >= 0 && sameInode(*fd, path)) return 0;
+    if (*fd >= 0) close(*fd);
+    *fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    return *fd >= 0 ? 0 : -1;
+}
+
+/*
+ * Brings the open descriptors in line with the files on disk and repairs a
+ * torn tail. Must be called with the session lock held exclusively.
+ * Appends write the record, sync, then publish its offset in the index, so
+ * the only torn states are an unindexed log tail or a partial index entry.
+ */
+static int sessionSync(AISession *session) {
+    if (reopenFile(&session->logFd, session->logPath) != 0) return -1;
+    if (reopenFile(&session->idxFd, session->idxPath) != 0) return -1;
+
+    SessionFileHeader logHeader;
+    if (fileSize(session->logFd) == 0) {
+        if (writeFileHeader(session->logFd, SESSION_LOG_MAGIC, 1) != 0) return -1;
+        if (writeFileHeader(session->idxFd, SESSION_IDX_MAGIC, 1) != 0) return -1;
+    }
+    if (readFileHeader(session->logFd, SESSION_LOG_MAGIC, &logHeader) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    session->generation = logHeader.generation;
+
+    SessionFileHeader idxHeader;
+    if (readFileHeader(session->idxFd, SESSION_IDX_MAGIC, &idxHeader) != 0 || idxHeader.generation != logHeader.generation) {
+        return rebuildIndex(session, logHeader.generation);
+    }
+
+    off_t logSize = fileSize(session->logFd);
+    off_t idxSize = fileSize(session->idxFd);
+    if (logSize < 0 || idxSize < 0) return -1;
+
+    uint64_t count = (uint64_t)(idxSize - (off_t)sizeof(SessionFileHeader)) / sizeof(uint64_t);
+    off_t logEnd = sizeof(SessionFileHeader);
+    while (count > 0) {
+        uint64_t last = 0;
+        SessionRecordHeader record;
+        off_t entryPos = (off_t)sizeof(SessionFileHeader) + (off_t)((count - 1) * sizeof(uint64_t));
+        if (preadFull(session->idxFd, &last, sizeof(last), entryPos) == 0 &&
+            readRecordHeader(session->logFd, (off_t)last, logSize, &record) == 0) {
+            logEnd = (off_t)last + (off_t)sizeof(record) + (off_t)record.length;
+            break;
+        }
+        count--;
+    }
+
+    off_t expectedIdx = (off_t)sizeof(SessionFileHeader) + (off_t)(count * sizeof(uint64_t));
+    if (idxSize != expectedIdx && ftruncate(session->idxFd, expectedIdx) != 0) return -1;
+    if (logSize != logEnd && ftruncate(session->logFd, logEnd) != 0) return -1;
+
+    session->turnCount = count;
+    return 0;
+}
+
+static int sessionLock(AISession *session) {
+    while (flock(session->lockFd, LOCK_EX) != 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (sessionSync(session) != 0) {
+        flock(session->lockFd, LOCK_UN);
+        return -1;
+    }
+    return 0;
+}
+
+static void sessionUnlock(AISession *session) {
+    flock(session->lockFd, LOCK_UN);
+}
+
+int sessionOpen(AISession *session, const char *name) {
+    memset(session, 0, sizeof(*session));
+    session->lockFd = -1;
+    session->logFd = -1;
+    session->idxFd = -1;
+
+    if (!isValidSessionName(name)) {
+        fprintf(stderr, "Invalid session name '%s'. Use letters, digits, '.', '-' and '_'.\n", name ? name : "");
+        return 1;
+    }
+
+    char *dir = get_ai_dir("sessions");
+    if (!dir) {
+        fprintf(stderr, "Failed to create ~/.gipwrap/sessions: %s\n", strerror(errno));
+        return 1;
+    }
+
+    session->name = formatPath("", name, "");
+    session->logPath = formatPath(dir, name, ".log");
+    session->idxPath = formatPath(dir, name, ".idx");
+    char *lockPath = formatPath(dir, name, ".lock");
+    free(dir);
+    if (!session->name || !session->logPath || !session->idxPath || !lockPath) {
+        free(lockPath);
+        sessionClose(session);
+        return 1;
+    }
+
+    session->lockFd = open(lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    free(lockPath);
+    if (session->lockFd < 0 || sessionLock(session) != 0) {
+        fprintf(stderr, "Failed to open session '%s': %s\n", name, strerror(errno));
+        sessionClose(session);
+        return 1;
+    }
+    sessionUnlock(session);
+    return 0;
+}
+
+void sessionClose(AISession *session) {
+    if (!session) return;
+    if (session->logFd >= 0) close(session->logFd);
+    if (session->idxFd >= 0) close(session->idxFd);
+    if (session->lockFd >= 0) close(session->lockFd);
+    free(session->name);
+    free(session->logPath);
+    free(session->idxPath);
+    memset(session, 0, sizeof(*session));
+    session->lockFd = -1;
+    session->logFd = -1;
+    session->idxFd = -1;
+}
+
+/* Rewrites the newest SESSION_RETAIN_TURNS into a new generation and swaps it in with rename(). */
+static int sessionCompact(AISession *session) {
+    uint64_t keep = session->turnCount < SESSION_RETAIN_TURNS ? session->turnCount : SESSION_RETAIN_TURNS;
+    uint64_t first = session->turnCount - keep;
+    uint64_t generation = session->generation + 1;
+
+    uint64_t *offsets = malloc((size_t)keep * sizeof(uint64_t));
+    if (!offsets) return -1;
+    if (keep > 0 && preadFull(session->idxFd, offsets, (size_t)keep * sizeof(uint64_t),
+                              (off_t)sizeof(SessionFileHeader) + (off_t)(first * sizeof(uint64_t))) != 0) {
+        free(offsets);
+        return -1;
+    }
+
+    size_t tmpLen = strlen(session->logPath) + 5;
+    char *logTmp = malloc(tmpLen);
+    char *idxTmp = malloc(tmpLen);
+    if (!logTmp || !idxTmp) {
+        free(offsets);
+        free(logTmp);
+        free(idxTmp);
+        return -1;
+    }
+    snprintf(logTmp, tmpLen, "%s.tmp", session->logPath);
+    snprintf(idxTmp, tmpLen, "%s.tmp", session->idxPath);
+
+    int ret = -1;
+    int logOut = open(logTmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int idxOut = open(idxTmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    off_t logSize = fileSize(session->logFd);
+    if (logOut < 0 || idxOut < 0 || logSize < 0) goto done;
+    if (writeFileHeader(logOut, SESSION_LOG_MAGIC, generation) != 0) goto done;
+    if (writeFileHeader(idxOut, SESSION_IDX_MAGIC, generation) != 0) goto done;
+
+    off_t base = keep > 0 ? (off_t)offsets[0] : logSize;
+    off_t shift = base - (off_t)sizeof(SessionFileHeader);
+    for (uint64_t i = 0; i < keep; ++i) {
+        offsets[i] -= (uint64_t)shift;
+    }
+    if (keep > 0 && pwriteFull(idxOut, offsets, (size_t)keep * sizeof(uint64_t), sizeof(SessionFileHeader)) != 0) goto done;
+
+    char chunk[65536];
+    for (off_t pos = base; pos < logSize;) {
+        size_t want = (size_t)(logSize - pos) < sizeof(chunk) ? (size_t)(logSize - pos) : sizeof(chunk);
+        if (preadFull(session->logFd, chunk, want, pos) != 0) goto done;
+        if (pwriteFull(logOut, chunk, want, pos - shift) != 0) goto done;
+        pos += (off_t)want;
+    }
+
+    if (fsync(logOut) != 0 || fsync(idxOut) != 0) goto done;
+    if (rename(logTmp, session->logPath) != 0) goto done;
+    if (rename(idxTmp, session->idxPath) != 0) goto done;
+    ret = sessionSync(session);
+
+done:
+    if (logOut >= 0) close(logOut);
+    if (idxOut >= 0) close(idxOut);
+    if (ret != 0) {
+        unlink(logTmp);
+        unlink(idxTmp);
+    }
+    free(logTmp);
+    free(idxTmp);
+    free(offsets);
+    return ret;
+}
+
+int sessionAppend(AISession *session, int role, const char *text) {
+    if (!text) text = "";
+    if (sessionLock(session) != 0) return 1;
+
+    int ret = 1;
+    off_t offset = fileSize(session->logFd);
+    if (offset < 0) goto done;
+
+    SessionRecordHeader record = { SESSION_REC_MAGIC, (uint32_t)role, strlen(text), (int64_t)time(NULL) };
+    struct iovec iov[2] = {
+        { &record, sizeof(record) },
+        { (void *)text, record.length }
+    };
+    size_t total = sizeof(record) + record.length;
+    if (pwritev(session->logFd, iov, 2, offset) != (ssize_t)total) {
+        /* The unindexed partial record is trimmed by sessionSync on the next lock. */
+        goto done;
+    }
+    if (fdatasync(session->logFd) != 0) goto done;
+
+    uint64_t entry = (uint64_t)offset;
+    off_t idxPos = (off_t)sizeof(SessionFileHeader) + (off_t)(session->turnCount * sizeof(uint64_t));
+    if (pwriteFull(session->idxFd, &entry, sizeof(entry), idxPos) != 0) goto done;
+    session->turnCount++;
+
+    if (session->turnCount > SESSION_COMPACT_TURNS && sessionCompact(session) != 0) {
+        fprintf(stderr, "Session '%s' compaction failed: %s\n", session->name, strerror(errno));
+    }
+    ret = 0;
+
+done:
+    sessionUnlock(session);
+    return ret;
+}
+
+void sessionFreeTurns(AISessionTurn *turns, size_t count) {
+    if (!turns) return;
+    for (size_t i = 0; i < count; ++i) {
+        free(turns[i].text);
+    }
+    free(turns);
+}
+
+size_t sessionTurnLimit(int sessionTurns) {
+    return sessionTurns > 0 ? (size_t)sessionTurns : SIZE_MAX;
+}
+
+int sessionLoadTurns(AISession *session, size_t maxTurns, AISessionTurn **turnsOut, size_t *countOut) {
+    *turnsOut = NULL;
+    *countOut = 0;
+    if (sessionLock(session) != 0) return 1;
+
+    uint64_t count = session->turnCount < maxTurns ? session->turnCount : maxTurns;
+    if (count == 0) {
+        sessionUnlock(session);
+        return 0;
+    }
+
+    uint64_t firstOffset = 0;
+    off_t entryPos = (off_t)sizeof(SessionFileHeader) + (off_t)((session->turnCount - count) * sizeof(uint64_t));
+    off_t logSize = fileSize(session->logFd);
+    if (logSize < 0 || preadFull(session->idxFd, &firstOffset, sizeof(firstOffset), entryPos) != 0) {
+        sessionUnlock(session);
+        return 1;
+    }
+
+    size_t tailLen = (size_t)(logSize - (off_t)firstOffset);
+    char *tail = malloc(tailLen);
+    AISessionTurn *turns = calloc((size_t)count, sizeof(AISessionTurn));
+    if (!tail || !turns || preadFull(session->logFd, tail, tailLen, (off_t)firstOffset) != 0) {
+        free(tail);
+        free(turns);
+        sessionUnlock(session);
+        return 1;
+    }
+    sessionUnlock(session);
+
+    size_t pos = 0;
+    size_t loaded = 0;
+    while (loaded < count && pos + sizeof(SessionRecordHeader) <= tailLen) {
+        SessionRecordHeader record;
+        memcpy(&record, tail + pos, sizeof(record));
+        pos += sizeof(record);
+        if (record.magic != SESSION_REC_MAGIC || record.length > tailLen - pos) break;
+
+        char *text = malloc((size_t)record.length + 1);
+        if (!text) break;
+        memcpy(text, tail + pos, (size_t)record.length);
+        text[record.length] = '\0';
+        pos += (size_t)record.length;
+
+        turns[loaded].role = (int)record.role;
+        turns[loaded].timestamp = record.timestamp;
+        turns[loaded].text = text;
+        loaded++;
+    }
+    free(tail);
+
+    *turnsOut = turns;
+    *countOut = loaded;
+    return 0;
+}
+
+/* Flattens turns and the new input into one prompt for the single-input handlers. */
+char* sessionRenderPrompt(const AISessionTurn *turns, size_t count, const char *input) {
+    if (!input) input = "";
+    size_t total = strlen(input) + 64;
+    for (size_t i = 0; i < count; ++i) {
+        total += strlen(turns[i].text) + 16;
+    }
+
+    char *prompt = malloc(total);
+    if (!prompt) return NULL;
+
+    char *ptr = prompt;
+    if (count > 0) {
+        ptr += sprintf(ptr, "Previous conversation:\n");
+        for (size_t i = 0; i < count; ++i) {
+            ptr += sprintf(ptr, "%s: %s\n\n", turns[i].role == SESSION_ROLE_USER ? "User" : "Assistant", turns[i].text);
+        }
+        ptr += sprintf(ptr, "User: ");
+    }
+    strcpy(ptr, input);
+    return prompt;
+}
+
+char* sessionBuildPrompt(AISession *session, size_t maxTurns, const char *input) {
+    AISessionTurn *turns = NULL;
+    size_t count = 0;
+    if (sessionLoadTurns(session, maxTurns, &turns, &count) != 0) {
+        fprintf(stderr, "Failed to load session '%s'; continuing without history.\n", session->name);
+    }
+
+    char *prompt = sessionRenderPrompt(turns, count, input);
+    sessionFreeTurns(turns, count);
+    return prompt;
+}
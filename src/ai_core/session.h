@@ -0,0 +1,45 @@
+#ifndef AI_CORE_SESSION_H
+#define AI_CORE_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SESSION_ROLE_USER 0
+#define SESSION_ROLE_ASSISTANT 1
+
+/*
+ * A session is stored under ~/.gipwrap/sessions as three files:
+ *   NAME.log  append-only turn records (header + payload)
+ *   NAME.idx  fixed-size offsets of every record in NAME.log
+ *   NAME.lock flock target shared by readers, writers and compaction
+ * The last N turns sit contiguously at the tail of the log, so loading
+ * them is two preads regardless of how long the session has grown.
+ */
+typedef struct {
+    char *name;
+    char *logPath;
+    char *idxPath;
+    int lockFd;
+    int logFd;
+    int idxFd;
+    uint64_t generation;
+    uint64_t turnCount;
+} AISession;
+
+typedef struct {
+    int role;
+    int64_t timestamp;
+    char *text;
+} AISessionTurn;
+
+int sessionOpen(AISession *session, const char *name);
+void sessionClose(AISession *session);
+/* How many turns --session-turns N keeps, for one-shot runs and the REPL alike: the last N, or all for N <= 0. */
+size_t sessionTurnLimit(int sessionTurns);
+int sessionLoadTurns(AISession *session, size_t maxTurns, AISessionTurn **turnsOut, size_t *countOut);
+void sessionFreeTurns(AISessionTurn *turns, size_t count);
+char* sessionRenderPrompt(const AISessionTurn *turns, size_t count, const char *input);
+char* sessionBuildPrompt(AISession *session, size_t maxTurns, const char *input);
+int sessionAppend(AISession *session, int role, const char *text);
+
+#endif
@@ -0,0 +1,166 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "ai.h"
+#include "ai_core/deadline.h"
+#include "ai_core/singleflight.h"
+
+/* Fixed-size status line at the start of a flight file; the response follows. */
+#define FLIGHT_HEADER_SIZE 32
+
+static int flightEnabled;
+static char *flightDir;
+
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* A short write leaves no DONE line, which waiters treat as a failed leader. */
+static int writeHeader(int fd, const char *text) {
+    char header[FLIGHT_HEADER_SIZE];
+    memset(header, ' ', sizeof(header));
+    memcpy(header, text, strlen(text));
+    header[sizeof(header) - 1] = '\n';
+    return pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) ? 0 : -1;
+}
+
+void singleflightEnable(void) {
+    flightEnabled = 1;
+}
+
+static void resetFlight(Flight *flight) {
+    if (flight->fd >= 0) close(flight->fd);
+    free(flight->path);
+    flight->fd = -1;
+    flight->path = NULL;
+    flight->role = FLIGHT_OFF;
+}
+
+/* Becomes the leader by linking a pre-locked file into place, or joins the flight already there. */
+FlightRole flightBegin(Flight *flight, const char *url, const char *headers, const char *body) {
+    memset(flight, 0, sizeof(*flight));
+    flight->fd = -1;
+    flight->role = FLIGHT_OFF;
+    if (!flightEnabled) return FLIGHT_OFF;
+    if (!flightDir) flightDir = get_ai_dir("inflight");
+    if (!flightDir) return FLIGHT_OFF;
+
+    uint64_t key = fnv1a(0xcbf29ce484222325ULL, url, strlen(url) + 1);
+    key = fnv1a(key, headers, strlen(headers) + 1);
+    key = fnv1a(key, body, strlen(body));
+    size_t pathLen = strlen(flightDir) + 64;
+    flight->path = malloc(pathLen);
+    if (!flight->path) return FLIGHT_OFF;
+    snprintf(flight->path, pathLen, "%s/%016llx.flight", flightDir, (unsigned long long)key);
+
+    char tmpPath[4096];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%ld", flight->path, (long)getpid());
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        unlink(tmpPath);
+        int fd = open(tmpPath, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) break;
+        if (flock(fd, LOCK_EX) != 0 || writeHeader(fd, "PENDING") != 0 || lseek(fd, FLIGHT_HEADER_SIZE, SEEK_SET) < 0) {
+            close(fd);
+            unlink(tmpPath);
+            break;
+        }
+        int linked = link(tmpPath, flight->path) == 0;
+        int linkError = errno;
+        unlink(tmpPath);
+        if (linked) {
+            flight->fd = fd;
+            flight->role = FLIGHT_LEADER;
+            return FLIGHT_LEADER;
+        }
+        close(fd);
+        if (linkError != EEXIST) break;
+
+        fd = open(flight->path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            flight->fd = fd;
+            flight->role = FLIGHT_FOLLOWER;
+            return FLIGHT_FOLLOWER;
+        }
+        /* The leader finished between link and open; try to lead instead. */
+    }
+    resetFlight(flight);
+    return FLIGHT_OFF;
+}
+
+/* Follower: waits for the leader and copies its response to out. Returns 0 on success, -1 to call upstream. */
+int flightAwait(Flight *flight, FILE *out, int *statusOut) {
+    while (flock(flight->fd, LOCK_SH) != 0) {
+        if (errno != EINTR || deadlineExpired()) {
+            resetFlight(flight);
+            return -1;
+        }
+    }
+
+    char header[FLIGHT_HEADER_SIZE + 1] = { 0 };
+    int status = 0;
+    int done = pread(flight->fd, header, FLIGHT_HEADER_SIZE, 0) == FLIGHT_HEADER_SIZE &&
+               sscanf(header, "DONE %d", &status) == 1;
+    if (!done) {
+        /* No leader holds the lock and none finished: it died. Retire the file if it is still the one we joined. */
+        struct stat joined, current;
+        if (fstat(flight->fd, &joined) == 0 && stat(flight->path, &current) == 0 &&
+            joined.st_ino == current.st_ino && joined.st_dev == current.st_dev) {
+            unlink(flight->path);
+        }
+        resetFlight(flight);
+        return -1;
+    }
+
+    char buffer[65536];
+    ssize_t got;
+    off_t offset = FLIGHT_HEADER_SIZE;
+    while ((got = pread(flight->fd, buffer, sizeof(buffer), offset)) > 0) {
+        fwrite(buffer, 1, (size_t)got, out);
+        offset += got;
+    }
+    if (statusOut) *statusOut = status;
+    resetFlight(flight);
+    return 0;
+}
+
+void flightWrite(Flight *flight, const void *data, size_t len) {
+    if (flight->role != FLIGHT_LEADER || flight->failed) return;
+    const char *p = data;
+    while (len > 0) {
+        ssize_t written = write(flight->fd, p, len);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            flight->failed = 1;
+            return;
+        }
+        p += written;
+        len -= (size_t)written;
+    }
+}
+
+/* Leader: publishes the outcome, then unlinks before unlocking so late arrivals start a new flight. */
+void flightEnd(Flight *flight, int ok, int status) {
+    if (flight->role != FLIGHT_LEADER) {
+        resetFlight(flight);
+        return;
+    }
+    if (ok && !flight->failed) {
+        char done[FLIGHT_HEADER_SIZE];
+        snprintf(done, sizeof(done), "DONE %d", status);
+        if (writeHeader(flight->fd, done) != 0) flight->failed = 1;
+    }
+    unlink(flight->path);
+    flock(flight->fd, LOCK_UN);
+    resetFlight(flight);
+}
@@ -0,0 +1,37 @@
+#ifndef AI_CORE_SINGLEFLIGHT_H
+#define AI_CORE_SINGLEFLIGHT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * --singleflight: identical requests coalesce across processes. The request
+ * key is the FNV-1a hash of URL, headers and body. The first process
+ * publishes ~/.gipwrap/inflight/KEY.flight with link(2) while holding an
+ * exclusive flock, and tees the response into it. Processes that find the
+ * file take a shared flock, which blocks until the leader is done, and then
+ * read the response from their open descriptor. The leader unlinks the file
+ * before unlocking, so nothing is cached beyond the flight itself. Only a
+ * 2xx response is published; if the leader gets any other status, fails or
+ * dies, the waiters make their own calls.
+ */
+typedef enum {
+    FLIGHT_OFF,
+    FLIGHT_LEADER,
+    FLIGHT_FOLLOWER
+} FlightRole;
+
+typedef struct {
+    FlightRole role;
+    int fd;
+    int failed;
+    char *path;
+} Flight;
+
+void singleflightEnable(void);
+FlightRole flightBegin(Flight *flight, const char *url, const char *headers, const char *body);
+int flightAwait(Flight *flight, FILE *out, int *statusOut);
+void flightWrite(Flight *flight, const void *data, size_t len);
+void flightEnd(Flight *flight, int ok, int status);
+
+#endif
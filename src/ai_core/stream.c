@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "ai_core/core.h"
+#include "ai_core/stream.h"
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} StreamBuffer;
+
+typedef struct {
+    ProviderProtocol protocol;
+    FILE *echo;
+    AIStreamHook hook;
+    void *hookUser;
+    FILE *sink;
+    size_t *echoedOut;
+    size_t echoed;
+    int events;
+    StreamBuffer line;
+    StreamBuffer text;
+    StreamBuffer raw;
+    char *start;
+    char *tail;
+} StreamDecoder;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static int bufferAppend(StreamBuffer *buffer, const char *data, size_t len) {
+    if (buffer->len + len + 1 > buffer->cap) {
+        size_t newCap = buffer->cap ? buffer->cap : 1024;
+        while (newCap < buffer->len + len + 1) newCap *= 2;
+        char *resized = realloc(buffer->data, newCap);
+        if (!resized) return -1;
+        buffer->data = resized;
+        buffer->cap = newCap;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    buffer->data[buffer->len] = '\0';
+    return 0;
+}
+
+static void replaceCopy(char **field, const char *value) {
+    free(*field);
+    *field = duplicateString(value);
+}
+
+/* True when key is followed by an object rather than null, e.g. openai's per-chunk "usage":null. */
+static int hasObject(const char *json, const char *key) {
+    const char *pos = strstr(json, key);
+    if (!pos) return 0;
+    pos += strlen(key);
+    while (*pos == ' ' || *pos == ':') pos++;
+    return *pos == '{';
+}
+
+static void emitDelta(StreamDecoder *decoder, char *delta) {
+    if (!delta) return;
+    size_t len = strlen(delta);
+    if (len) {
+        bufferAppend(&decoder->text, delta, len);
+        if (decoder->echo) {
+            fwrite(delta, 1, len, decoder->echo);
+            fflush(decoder->echo);
+            decoder->echoed += len;
+        }
+        if (decoder->hook) decoder->hook(decoder->hookUser, decoder->text.data, decoder->text.len);
+    }
+    free(delta);
+}
+
+static void handleEvent(StreamDecoder *decoder, const char *payload) {
+    decoder->events++;
+    if (decoder->protocol == PROVIDER_OLLAMA) {
+        emitDelta(decoder, find_json_string(payload, "response"));
+        if (strstr(payload, "\"done\":true")) replaceCopy(&decoder->tail, payload);
+    } else if (decoder->protocol == PROVIDER_ANTHROPIC) {
+        if (strstr(payload, "\"content_block_delta\"")) {
+            emitDelta(decoder, find_json_string(payload, "text"));
+        } else if (strstr(payload, "\"message_start\"")) {
+            replaceCopy(&decoder->start, payload);
+        } else if (strstr(payload, "\"message_delta\"")) {
+            replaceCopy(&decoder->tail, payload);
+        }
+    } else {
+        const char *delta = strstr(payload, "\"delta\"");
+        if (delta) emitDelta(decoder, find_json_string(delta, "content"));
+        if (hasObject(payload, "\"usage\"")) replaceCopy(&decoder->tail, payload);
+    }
+}
+
+static void handleLine(StreamDecoder *decoder, char *line, size_t len) {
+    if (len && line[len - 1] == '\r') line[--len] = '\0';
+
+    if (decoder->protocol == PROVIDER_OLLAMA) {
+        if (line[0] == '{' && strstr(line, "\"response\"")) {
+            handleEvent(decoder, line);
+            return;
+        }
+    } else if (strncmp(line, "data:", 5) == 0) {
+        const char *payload = line + 5;
+        while (*payload == ' ') payload++;
+        if (strcmp(payload, "[DONE]") != 0) handleEvent(decoder, payload);
+        return;
+    } else if (len == 0 || strncmp(line, "event:", 6) == 0 || line[0] == ':') {
+        return;
+    }
+
+    bufferAppend(&decoder->raw, line, len);
+    bufferAppend(&decoder->raw, "\n", 1);
+}
+
+static ssize_t decoderWrite(void *cookie, const char *data, size_t size) {
+    StreamDecoder *decoder = cookie;
+    if (bufferAppend(&decoder->line, data, size) != 0) return -1;
+
+    size_t consumed = 0;
+    char *newline;
+    while ((newline = memchr(decoder->line.data + consumed, '\n', decoder->line.len - consumed)) != NULL) {
+        *newline = '\0';
+        handleLine(decoder, decoder->line.data + consumed, (size_t)(newline - decoder->line.data) - consumed);
+        consumed = (size_t)(newline - decoder->line.data) + 1;
+    }
+    memmove(decoder->line.data, decoder->line.data + consumed, decoder->line.len - consumed);
+    decoder->line.len -= consumed;
+    decoder->line.data[decoder->line.len] = '\0';
+    return (ssize_t)size;
+}
+
+static void writeJsonString(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+        switch (*p) {
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (*p < 0x20) fprintf(out, "\\u%04x", *p);
+                else fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void writeReply(StreamDecoder *decoder) {
+    FILE *out = decoder->sink;
+    const char *text = decoder->text.data ? decoder->text.data : "";
+    if (decoder->protocol == PROVIDER_OLLAMA) {
+        /* The final line carries the counters and context; its empty "response" comes after ours. */
+        fputs("{\"response\":", out);
+        writeJsonString(out, text);
+        if (decoder->tail) fprintf(out, ",%s", decoder->tail + 1);
+        else fputc('}', out);
+    } else if (decoder->protocol == PROVIDER_ANTHROPIC) {
+        fputs("{\"content\":[{\"type\":\"text\",\"text\":", out);
+        writeJsonString(out, text);
+        fputs("}]", out);
+        if (decoder->tail) fprintf(out, ",\"stream_end\":%s", decoder->tail);
+        if (decoder->start) fprintf(out, ",\"stream_start\":%s", decoder->start);
+        fputc('}', out);
+    } else {
+        fputs("{\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":", out);
+        writeJsonString(out, text);
+        fputs("}}]", out);
+        if (decoder->tail) fprintf(out, ",\"stream_end\":%s", decoder->tail);
+        fputc('}', out);
+    }
+}
+
+static int decoderClose(void *cookie) {
+    StreamDecoder *decoder = cookie;
+    if (decoder->line.len) handleLine(decoder, decoder->line.data, decoder->line.len);
+
+    if (decoder->events) {
+        writeReply(decoder);
+    } else if (decoder->raw.len) {
+        fwrite(decoder->raw.data, 1, decoder->raw.len, decoder->sink);
+    }
+    if (decoder->echoedOut) *decoder->echoedOut = decoder->echoed;
+
+    free(decoder->line.data);
+    free(decoder->text.data);
+    free(decoder->raw.data);
+    free(decoder->start);
+    free(decoder->tail);
+    free(decoder);
+    return 0;
+}
+
+FILE* streamOpen(ProviderProtocol protocol, FILE *echo, AIStreamHook hook, void *hookUser, FILE *sink, size_t *echoedOut) {
+    StreamDecoder *decoder = calloc(1, sizeof(*decoder));
+    if (!decoder) return NULL;
+    decoder->protocol = protocol;
+    decoder->echo = echo;
+    decoder->hook = hook;
+    decoder->hookUser = hookUser;
+    decoder->sink = sink;
+    decoder->echoedOut = echoedOut;
+
+    cookie_io_functions_t functions = { .read = NULL, .write = decoderWrite, .seek = NULL, .close = decoderClose };
+    FILE *stream = fopencookie(decoder, "w", functions);
+    if (!stream) {
+        free(decoder);
+        return NULL;
+    }
+    /* Unbuffered, so each chunk curl hands over is decoded and echoed at once. */
+    setvbuf(stream, NULL, _IONBF, 0);
+    return stream;
+}
@@ -0,0 +1,18 @@
+#ifndef AI_CORE_STREAM_H
+#define AI_CORE_STREAM_H
+
+#include <stdio.h>
+#include "ai_core/providers.h"
+
+/*
+ * Streamed replies. streamOpen returns a FILE that takes the raw streamed
+ * body: SSE for openai and anthropic, NDJSON for ollama. Text deltas are
+ * echoed to echo (if not NULL) as they arrive, and hook is handed the
+ * text so far after each one. On fclose a reply in the non-streamed
+ * shape is written to sink, so extract_response and usage accounting work
+ * unchanged. *echoedOut receives the number of bytes echoed. A body that is
+ * not a stream, such as an error reply, goes to sink untouched.
+ */
+FILE* streamOpen(ProviderProtocol protocol, FILE *echo, AIStreamHook hook, void *hookUser, FILE *sink, size_t *echoedOut);
+
+#endif
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "ai_core/agent.h"
+#include "ai_core/deadline.h"
+#include "ai_core/subagent.h"
+#include "ai_core/trace.h"
+
+#define SUBAGENT_MAX_TASKS 16
+#define SUBAGENT_MAX_WORKERS 8
+#define SUBAGENT_DEFAULT_WORKERS 4
+#define SUBAGENT_DEFAULT_STEPS 6
+#define SUBAGENT_MAX_ANSWER (64 * 1024)
+
+typedef struct {
+    char *task;
+    pid_t pid;
+    int fd;
+    int status;
+    double startUs;
+    char *answer;
+    size_t len;
+} SubagentSlot;
+
+static int inChild;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static char* formatString(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0) {
+        return NULL;
+    }
+
+    char *buffer = malloc((size_t)needed + 1);
+    if (!buffer) return NULL;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, (size_t)needed + 1, fmt, args);
+    va_end(args);
+
+    return buffer;
+}
+
+int subagentAvailable(void) {
+    return !inChild;
+}
+
+static char* trimCopy(const char *start, const char *end) {
+    while (start < end && (*start == ' ' || *start == '\t' || *start == '\n' || *start == '\r')) start++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) end--;
+    if (start == end) return NULL;
+    char *out = malloc((size_t)(end - start) + 1);
+    if (!out) return NULL;
+    memcpy(out, start, (size_t)(end - start));
+    out[end - start] = '\0';
+    return out;
+}
+
+/* Keeps the first SUBAGENT_MAX_TASKS tasks and counts the rest in *dropped. */
+static void addTask(char *task, char **tasks, size_t *count, size_t *dropped) {
+    if (!task) return;
+    if (*count < SUBAGENT_MAX_TASKS) {
+        tasks[(*count)++] = task;
+    } else {
+        free(task);
+        (*dropped)++;
+    }
+}
+
+/* Splits input into tasks: blocks between --- lines, or else one per line. Leading steps= and workers= lines are options. */
+static size_t parseTasks(const char *input, char **tasks, size_t *dropped, int *steps, int *workers) {
+    const char *pos = input;
+    for (;;) {
+        while (*pos == '\n' || *pos == '\r' || *pos == ' ') pos++;
+        if (strncmp(pos, "steps=", 6) == 0) {
+            *steps = atoi(pos + 6);
+        } else if (strncmp(pos, "workers=", 8) == 0) {
+            *workers = atoi(pos + 8);
+        } else {
+            break;
+        }
+        const char *newline = strchr(pos, '\n');
+        pos = newline ? newline + 1 : pos + strlen(pos);
+    }
+
+    int blocks = strncmp(pos, "---", 3) == 0 || strstr(pos, "\n---") != NULL;
+    size_t count = 0;
+    const char *start = pos;
+    while (*pos) {
+        const char *newline = strchr(pos, '\n');
+        const char *lineEnd = newline ? newline : pos + strlen(pos);
+        const char *next = newline ? newline + 1 : lineEnd;
+        int separator = blocks ? (lineEnd - pos >= 3 && strncmp(pos, "---", 3) == 0) : 1;
+        if (separator) {
+            addTask(trimCopy(start, blocks ? pos : lineEnd), tasks, &count, dropped);
+            start = next;
+        }
+        pos = next;
+    }
+    if (blocks) addTask(trimCopy(start, pos), tasks, &count, dropped);
+    return count;
+}
+
+/* The child runs the task as a fresh agent run and writes its final answer to fd. */
+static void runChild(const AIConfig *cfg, AIHandler handler, const char *sys_prompt, const char *task, int steps, int fd) {
+    inChild = 1;
+    AIConfig childCfg = *cfg;
+    childCfg.jsonl = 0;
+    childCfg.max_steps = steps;
+    childCfg.stream_out = NULL;
+    childCfg.stream_hook = NULL;
+    childCfg.stream_hook_user = NULL;
+    FILE *out = fdopen(fd, "w");
+    int ret = out ? runAgentMode(&childCfg, handler, task, sys_prompt, out, NULL) : 1;
+    if (out) fclose(out);
+    /* _exit: the parent's atexit handlers and stdio buffers are not ours to flush. */
+    _exit(ret & 0xff);
+}
+
+static int startChild(const AIConfig *cfg, AIHandler handler, const char *sys_prompt, SubagentSlot *slot, int steps) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+
+    /* As in deadlineSpawnShell: the child is tracked before a signal can see it. */
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGHUP);
+    sigaddset(&blocked, SIGALRM);
+    sigprocmask(SIG_BLOCK, &blocked, &previous);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+        close(fds[0]);
+        runChild(cfg, handler, sys_prompt, slot->task, steps, fds[1]);
+    }
+    if (pid > 0) {
+        setpgid(pid, pid);
+        deadlineTrackChild(pid);
+        if (deadlineExpired()) kill(-pid, SIGTERM);
+    }
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    slot->pid = pid;
+    slot->fd = fds[0];
+    slot->startUs = traceNowUs();
+    return 0;
+}
+
+static void finishChild(SubagentSlot *slot, size_t index) {
+    close(slot->fd);
+    slot->fd = -1;
+    int status = 0;
+    deadlineWaitChild(slot->pid, &status);
+    slot->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+    char name[32];
+    char args[64];
+    snprintf(name, sizeof(name), "agent %zu", index + 1);
+    snprintf(args, sizeof(args), "{\"exit\":%d,\"answerBytes\":%zu}", slot->status, slot->len);
+    traceRecord("subagent", name, slot->startUs, traceNowUs() - slot->startUs, args);
+}
+
+/* Returns 0 at end of output. Past SUBAGENT_MAX_ANSWER the output is read and dropped. */
+static int readChild(SubagentSlot *slot) {
+    char buffer[4096];
+    ssize_t got = read(slot->fd, buffer, sizeof(buffer));
+    if (got < 0) return errno == EINTR || errno == EAGAIN;
+    if (got == 0) return 0;
+    size_t keep = slot->len + (size_t)got <= SUBAGENT_MAX_ANSWER ? (size_t)got : SUBAGENT_MAX_ANSWER - slot->len;
+    if (keep == 0) return 1;
+    char *resized = realloc(slot->answer, slot->len + keep + 1);
+    if (!resized) return 1;
+    slot->answer = resized;
+    memcpy(slot->answer + slot->len, buffer, keep);
+    slot->len += keep;
+    slot->answer[slot->len] = '\0';
+    return 1;
+}
+
+/* One "[agent N] task" header per task, followed by its answer, then notes for a capped steps= and tasks past the cap. */
+static char* joinAnswers(SubagentSlot *slots, size_t count, size_t dropped, int cappedSteps) {
+    size_t total = 256;
+    for (size_t i = 0; i < count; ++i) total += strlen(slots[i].task) + slots[i].len + 96;
+    char *out = malloc(total);
+    if (!out) return NULL;
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const SubagentSlot *slot = &slots[i];
+        const char *answer = slot->len ? slot->answer : "(no answer)";
+        len += (size_t)snprintf(out + len, total - len, "%s[agent %zu] %s\n%s%s", i ? "\n" : "", i + 1, slot->task, answer,
+                                slot->len && answer[slot->len - 1] == '\n' ? "" : "\n");
+        if (slot->pid <= 0) {
+            len += (size_t)snprintf(out + len, total - len, "(not started)\n");
+        } else if (slot->status != 0) {
+            len += (size_t)snprintf(out + len, total - len, "(agent exited with status %d)\n", slot->status);
+        }
+    }
+    if (cappedSteps) {
+        len += (size_t)snprintf(out + len, total - len, "\n(steps capped at %d per agent, the caller's remaining step budget)\n", cappedSteps);
+    }
+    if (dropped) {
+        snprintf(out + len, total - len, "\n(%zu task%s not run: at most %d tasks per call)\n", dropped, dropped == 1 ? "" : "s",
+                 SUBAGENT_MAX_TASKS);
+    }
+    return out;
+}
+
+char* subagentRun(const AIConfig *cfg, AIHandler handler, const char *sys_prompt, const char *input, int stepBudget, char **error_out) {
+    if (inChild) {
+        if (error_out) *error_out = duplicateString("Sub-agents cannot spawn agents.");
+        return NULL;
+    }
+
+    char *tasks[SUBAGENT_MAX_TASKS];
+    int steps = SUBAGENT_DEFAULT_STEPS;
+    int workers = SUBAGENT_DEFAULT_WORKERS;
+    size_t dropped = 0;
+    size_t count = parseTasks(input ? input : "", tasks, &dropped, &steps, &workers);
+    if (count == 0) {
+        if (error_out) *error_out = duplicateString("No tasks given; separate tasks with --- lines or put one per line.");
+        return NULL;
+    }
+    if (steps <= 0) steps = SUBAGENT_DEFAULT_STEPS;
+    /* A child must not outrun the agent that asked for it. */
+    if (stepBudget < 1) stepBudget = 1;
+    int cappedSteps = 0;
+    if (steps > stepBudget) {
+        steps = stepBudget;
+        cappedSteps = stepBudget;
+    }
+    if (workers <= 0) workers = SUBAGENT_DEFAULT_WORKERS;
+    if (workers > SUBAGENT_MAX_WORKERS) workers = SUBAGENT_MAX_WORKERS;
+
+    SubagentSlot slots[SUBAGENT_MAX_TASKS];
+    memset(slots, 0, sizeof(slots));
+    for (size_t i = 0; i < count; ++i) {
+        slots[i].task = tasks[i];
+        slots[i].fd = -1;
+    }
+
+    size_t next = 0;
+    size_t running = 0;
+    char *startError = NULL;
+    while ((next < count && !startError) || running > 0) {
+        while (next < count && !startError && running < (size_t)workers && !deadlineExpired()) {
+            if (startChild(cfg, handler, sys_prompt, &slots[next], steps) != 0) {
+                startError = formatString("Failed to start agent %zu: %s", next + 1, strerror(errno));
+                break;
+            }
+            next++;
+            running++;
+        }
+        if (deadlineExpired() && next < count) next = count;
+        if (running == 0) break;
+
+        struct pollfd fds[SUBAGENT_MAX_TASKS];
+        size_t owners[SUBAGENT_MAX_TASKS];
+        nfds_t nfds = 0;
+        for (size_t i = 0; i < next; ++i) {
+            if (slots[i].fd < 0) continue;
+            fds[nfds].fd = slots[i].fd;
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = i;
+        }
+        /* A deadline or a signal interrupts the wait; the killed children then hang up. */
+        if (poll(fds, nfds, -1) < 0) continue;
+        for (nfds_t i = 0; i < nfds; ++i) {
+            if (!fds[i].revents) continue;
+            SubagentSlot *slot = &slots[owners[i]];
+            if (!(fds[i].revents & POLLIN) || !readChild(slot)) {
+                finishChild(slot, owners[i]);
+                running--;
+            }
+        }
+    }
+
+    char *result = joinAnswers(slots, count, dropped, cappedSteps);
+    if (startError) {
+        fprintf(stderr, "%s\n", startError);
+        free(startError);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        free(slots[i].task);
+        free(slots[i].answer);
+    }
+    if (!result && error_out) *error_out = duplicateString("Failed to collect sub-agent answers.");
+    return result;
+}
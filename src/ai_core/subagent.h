@@ -0,0 +1,25 @@
+#ifndef AI_CORE_SUBAGENT_H
+#define AI_CORE_SUBAGENT_H
+
+#include "ai.h"
+
+#define SUBAGENT_TOOL_NAME "spawnAgent"
+#define SUBAGENT_TOOL_DESCRIPTION \
+    "Run independent sub-tasks in parallel, each as its own agent with a fresh transcript and the same tools; returns each final answer. " \
+    "Input: up to 16 tasks separated by lines of ---, or one task per line. Optional first lines steps=N (per agent, default 6, at most your remaining steps), workers=N (default 4, max 8)."
+
+/*
+ * spawnAgent: each task runs runAgentMode in a forked child process, at most
+ * workers at a time, with its own transcript and step budget. A child has
+ * its own copy of the config, usage and trace state, so its provider calls
+ * are not counted in the parent's --jsonl, --trace or metrics output. The
+ * parent records one "subagent" span per child. steps= is capped at
+ * stepBudget, the caller's remaining steps, and tasks past the first 16 are
+ * not run; the result ends with a note for either. Children are tracked
+ * process groups, so --deadline and signals reach them, and they cannot
+ * spawn agents themselves.
+ */
+int subagentAvailable(void);
+char* subagentRun(const AIConfig *cfg, AIHandler handler, const char *sys_prompt, const char *input, int stepBudget, char **error_out);
+
+#endif
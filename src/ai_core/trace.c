@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai_core/memStats.h"
+#include "ai_core/trace.h"
+
+typedef struct {
+    const char *category;
+    char *name;
+    char *args;
+    double startUs;
+    double durUs;
+} TraceEvent;
+
+typedef struct {
+    char *path;
+    struct timespec origin;
+    TraceEvent *events;
+    size_t count;
+    size_t cap;
+} TraceState;
+
+static TraceState traceState;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+int traceOpen(const char *path) {
+    if (!path || !*path) return 0;
+    traceState.path = duplicateString(path);
+    clock_gettime(CLOCK_MONOTONIC, &traceState.origin);
+    return traceState.path ? 0 : -1;
+}
+
+int traceEnabled(void) {
+    return traceState.path != NULL;
+}
+
+double traceNowUs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - traceState.origin.tv_sec) * 1e6 + (double)(now.tv_nsec - traceState.origin.tv_nsec) / 1e3;
+}
+
+TraceSpan traceBegin(const char *category, const char *name) {
+    TraceSpan span = { category, name, 0.0, 0, memStatsEnter(category, name) };
+    if (traceState.path) {
+        span.startUs = traceNowUs();
+        span.active = 1;
+    }
+    return span;
+}
+
+void traceRecord(const char *category, const char *name, double startUs, double durUs, const char *argsJson) {
+    if (!traceState.path) return;
+    if (traceState.count == traceState.cap) {
+        size_t newCap = traceState.cap ? traceState.cap * 2 : 64;
+        TraceEvent *resized = realloc(traceState.events, newCap * sizeof(TraceEvent));
+        if (!resized) return;
+        traceState.events = resized;
+        traceState.cap = newCap;
+    }
+    TraceEvent *event = &traceState.events[traceState.count++];
+    event->category = category;
+    event->name = duplicateString(name);
+    event->args = duplicateString(argsJson);
+    event->startUs = startUs;
+    event->durUs = durUs < 0.0 ? 0.0 : durUs;
+}
+
+void traceEnd(TraceSpan *span, const char *argsJson) {
+    if (!span) return;
+    memStatsLeave(span->memToken);
+    span->memToken = 0;
+    if (!span->active) return;
+    traceRecord(span->category, span->name, span->startUs, traceNowUs() - span->startUs, argsJson);
+    span->active = 0;
+}
+
+static void writeJsonString(FILE *out, const char *text) {
+    putc('"', out);
+    for (const unsigned char *p = (const unsigned char *)(text ? text : ""); *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            putc(*p, out);
+        }
+    }
+    putc('"', out);
+}
+
+static int writeChromeTrace(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+
+    int pid = (int)getpid();
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < traceState.count; ++i) {
+        const TraceEvent *event = &traceState.events[i];
+        fprintf(out, "{\"ph\":\"X\",\"pid\":%d,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f,\"cat\":", pid, event->startUs, event->durUs);
+        writeJsonString(out, event->category);
+        fprintf(out, ",\"name\":");
+        writeJsonString(out, event->name);
+        if (event->args) {
+            fprintf(out, ",\"args\":%s", event->args);
+        }
+        fprintf(out, "}%s\n", i + 1 < traceState.count ? "," : "");
+    }
+    fprintf(out, "]}\n");
+    return fclose(out);
+}
+
+typedef struct {
+    const char *category;
+    const char *name;
+    size_t count;
+    double totalUs;
+    double maxUs;
+} TracePhase;
+
+static int comparePhases(const void *a, const void *b) {
+    const TracePhase *left = a;
+    const TracePhase *right = b;
+    return left->totalUs < right->totalUs ? 1 : left->totalUs > right->totalUs ? -1 : 0;
+}
+
+/* Phase totals, then one line per agent step with the time of each nested phase. */
+static void printSummary(void) {
+    TracePhase *phases = calloc(traceState.count ? traceState.count : 1, sizeof(TracePhase));
+    if (!phases) return;
+
+    size_t phaseCount = 0;
+    for (size_t i = 0; i < traceState.count; ++i) {
+        const TraceEvent *event = &traceState.events[i];
+        size_t p = 0;
+        while (p < phaseCount && (strcmp(phases[p].category, event->category) != 0 || strcmp(phases[p].name, event->name) != 0)) p++;
+        if (p == phaseCount) {
+            phases[p].category = event->category;
+            phases[p].name = event->name;
+            phaseCount++;
+        }
+        phases[p].count++;
+        phases[p].totalUs += event->durUs;
+        if (event->durUs > phases[p].maxUs) phases[p].maxUs = event->durUs;
+    }
+    qsort(phases, phaseCount, sizeof(TracePhase), comparePhases);
+
+    fprintf(stderr, "[trace] %-10s %-22s %6s %10s %10s\n", "category", "phase", "count", "total ms", "max ms");
+    for (size_t p = 0; p < phaseCount; ++p) {
+        fprintf(stderr, "[trace] %-10s %-22s %6zu %10.2f %10.2f\n", phases[p].category, phases[p].name,
+                phases[p].count, phases[p].totalUs / 1000.0, phases[p].maxUs / 1000.0);
+    }
+    free(phases);
+
+    for (size_t i = 0; i < traceState.count; ++i) {
+        const TraceEvent *step = &traceState.events[i];
+        if (strcmp(step->category, "agent") != 0) continue;
+
+        fprintf(stderr, "[trace] %s %.2f ms:", step->name, step->durUs / 1000.0);
+        for (size_t j = 0; j < traceState.count; ++j) {
+            const TraceEvent *child = &traceState.events[j];
+            if ((strcmp(child->category, "provider") == 0 || strcmp(child->category, "tool") == 0) &&
+                child->startUs >= step->startUs && child->startUs + child->durUs <= step->startUs + step->durUs) {
+                fprintf(stderr, " %s %s %.2f ms;", child->category, child->name, child->durUs / 1000.0);
+            }
+        }
+        fputc('\n', stderr);
+    }
+}
+
+void traceClose(void) {
+    if (!traceState.path) return;
+
+    if (writeChromeTrace(traceState.path) != 0) {
+        fprintf(stderr, "[trace] Failed to write %s\n", traceState.path);
+    }
+    printSummary();
+
+    for (size_t i = 0; i < traceState.count; ++i) {
+        free(traceState.events[i].name);
+        free(traceState.events[i].args);
+    }
+    free(traceState.events);
+    free(traceState.path);
+    memset(&traceState, 0, sizeof(traceState));
+}
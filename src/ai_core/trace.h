@@ -0,0 +1,27 @@
+#ifndef AI_CORE_TRACE_H
+#define AI_CORE_TRACE_H
+
+/*
+ * Phase spans for --trace FILE. Spans are kept in memory and written on
+ * traceClose as Chrome trace-event JSON (load it in chrome://tracing or
+ * Perfetto), followed by a per-phase and per-agent-step summary on stderr.
+ * When tracing is off, traceBegin/traceEnd only test a flag. Spans also
+ * delimit the --mem-stats phases.
+ */
+typedef struct {
+    const char *category;
+    const char *name;
+    double startUs;
+    int active;
+    int memToken;
+} TraceSpan;
+
+int traceOpen(const char *path);
+int traceEnabled(void);
+double traceNowUs(void);
+TraceSpan traceBegin(const char *category, const char *name);
+void traceEnd(TraceSpan *span, const char *argsJson);
+void traceRecord(const char *category, const char *name, double startUs, double durUs, const char *argsJson);
+void traceClose(void);
+
+#endif
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/types.h>
+
+#include "ai_core/core.h"
+#include "ai_core/providers.h"
+#include "ai_core/usage.h"
+
+typedef struct {
+    int step;
+    const char *provider;
+    char *model;
+    long promptTokens;
+    long completionTokens;
+    long cachedTokens;
+    double latencyMs;
+    double ttftMs;
+    int httpStatus;
+    int retries;
+    int coalesced;
+} UsageCall;
+
+typedef struct {
+    UsageCall *calls;
+    size_t count;
+    size_t cap;
+    int step;
+    double callStartMs;
+    double firstByteMs;
+    int httpStatus;
+    int retries;
+    int coalesced;
+    char runId[32];
+} UsageState;
+
+static UsageState usageState;
+
+typedef struct {
+    char *name;
+    char *labels;
+    double value;
+} PromSample;
+
+typedef struct {
+    PromSample *samples;
+    size_t count;
+    size_t cap;
+} PromFile;
+
+static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+} promMetrics[] = {
+    { "gipwrap_runs_total", "counter", "gipwrap runs that made at least one provider call." },
+    { "gipwrap_requests_total", "counter", "Provider calls." },
+    { "gipwrap_prompt_tokens_total", "counter", "Prompt tokens reported by the provider, cached ones included." },
+    { "gipwrap_completion_tokens_total", "counter", "Completion tokens reported by the provider." },
+    { "gipwrap_cached_tokens_total", "counter", "Prompt tokens served from the provider's prompt cache." },
+    { "gipwrap_request_duration_seconds_total", "counter", "Wall time spent in provider calls." },
+    { "gipwrap_last_tokens_per_second", "gauge", "Completion tokens per second of wall time in the last run." },
+    { "gipwrap_last_ttft_seconds", "gauge", "Time to the first response byte of the first call in the last run." },
+    { "gipwrap_last_run_timestamp_seconds", "gauge", "Unix time of the last run." },
+};
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+double usageNowMs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e3 + (double)now.tv_nsec / 1e6;
+}
+
+void usageSetStep(int step) {
+    usageState.step = step;
+}
+
+void usageBeginCall(void) {
+    usageState.callStartMs = usageNowMs();
+    usageState.firstByteMs = 0.0;
+    usageState.httpStatus = 0;
+    usageState.retries = 0;
+    usageState.coalesced = 0;
+}
+
+/* Called by http_post when the first response byte arrived agoMs ago. */
+void usageNoteFirstByte(double agoMs) {
+    if (usageState.firstByteMs == 0.0) {
+        usageState.firstByteMs = usageNowMs() - agoMs;
+    }
+}
+
+/* Called by http_post with the final HTTP status (0 if none arrived) and the attempts curl repeated. */
+void usageNoteHttp(int status, int retries) {
+    usageState.httpStatus = status;
+    usageState.retries = retries;
+}
+
+/* The reply came from another process's identical in-flight request (--singleflight). */
+void usageNoteCoalesced(void) {
+    usageState.coalesced = 1;
+}
+
+static long findJsonNumber(const char *json, const char *key) {
+    char pattern[128];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *pos = strstr(json, pattern);
+    if (!pos) return 0;
+
+    pos += strlen(pattern);
+    while (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r' || *pos == ':') pos++;
+    return isdigit((unsigned char)*pos) ? strtol(pos, NULL, 10) : 0;
+}
+
+void usageRecordCall(const char *ai_type, const char *json) {
+    if (!ai_type || !json) return;
+    if (usageState.count == usageState.cap) {
+        size_t newCap = usageState.cap ? usageState.cap * 2 : 8;
+        UsageCall *resized = realloc(usageState.calls, newCap * sizeof(UsageCall));
+        if (!resized) return;
+        usageState.calls = resized;
+        usageState.cap = newCap;
+    }
+
+    double now = usageNowMs();
+    UsageCall *call = &usageState.calls[usageState.count++];
+    memset(call, 0, sizeof(*call));
+    call->step = usageState.step;
+    call->provider = ai_type;
+    call->model = find_json_string(json, "model");
+    call->latencyMs = now - usageState.callStartMs;
+    call->ttftMs = usageState.firstByteMs > 0.0 ? usageState.firstByteMs - usageState.callStartMs : call->latencyMs;
+    call->httpStatus = usageState.httpStatus;
+    call->retries = usageState.retries;
+    call->coalesced = usageState.coalesced;
+
+    const AIProvider *provider = providerFind(ai_type);
+    ProviderProtocol protocol = provider ? provider->protocol : PROVIDER_OPENAI;
+    if (protocol == PROVIDER_OLLAMA) {
+        call->promptTokens = findJsonNumber(json, "prompt_eval_count");
+        call->completionTokens = findJsonNumber(json, "eval_count");
+    } else if (protocol == PROVIDER_ANTHROPIC) {
+        call->cachedTokens = findJsonNumber(json, "cache_read_input_tokens");
+        call->promptTokens = findJsonNumber(json, "input_tokens") + call->cachedTokens +
+                             findJsonNumber(json, "cache_creation_input_tokens");
+        call->completionTokens = findJsonNumber(json, "output_tokens");
+    } else {
+        call->promptTokens = findJsonNumber(json, "prompt_tokens");
+        call->completionTokens = findJsonNumber(json, "completion_tokens");
+        /* OpenAI nests cached_tokens in prompt_tokens_details; DeepSeek reports cache hits. */
+        call->cachedTokens = strstr(json, "\"prompt_cache_hit_tokens\"") ? findJsonNumber(json, "prompt_cache_hit_tokens")
+                                                                        : findJsonNumber(json, "cached_tokens");
+    }
+}
+
+static const char* callModel(const UsageCall *call) {
+    return call->model && *call->model ? call->model : "unknown";
+}
+
+static int sameSeries(const UsageCall *a, const UsageCall *b) {
+    return strcmp(a->provider, b->provider) == 0 && strcmp(callModel(a), callModel(b)) == 0;
+}
+
+static double tokensPerSecond(long tokens, double ms) {
+    return ms > 0.0 ? (double)tokens * 1000.0 / ms : 0.0;
+}
+
+static void printSummary(void) {
+    long prompt = 0, completion = 0, cached = 0;
+    double ms = 0.0;
+    for (size_t i = 0; i < usageState.count; ++i) {
+        const UsageCall *call = &usageState.calls[i];
+        fprintf(stderr, "[usage] step %d %s/%s: prompt %ld (cached %ld), completion %ld, %.1f ms, ttft %.1f ms, %.1f tok/s\n",
+                call->step, call->provider, callModel(call), call->promptTokens, call->cachedTokens, call->completionTokens,
+                call->latencyMs, call->ttftMs, tokensPerSecond(call->completionTokens, call->latencyMs));
+        prompt += call->promptTokens;
+        completion += call->completionTokens;
+        cached += call->cachedTokens;
+        ms += call->latencyMs;
+    }
+    fprintf(stderr, "[usage] total %zu calls: prompt %ld (cached %ld), completion %ld, %.1f ms, %.1f tok/s\n",
+            usageState.count, prompt, cached, completion, ms, tokensPerSecond(completion, ms));
+}
+
+static void writeJsonString(FILE *out, const char *text) {
+    putc('"', out);
+    for (const unsigned char *p = (const unsigned char *)(text ? text : ""); *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            putc(*p, out);
+        }
+    }
+    putc('"', out);
+}
+
+/* --jsonl: one self-contained record for the most recent call; raw_json is kept only when nothing was extracted. */
+void usageWriteRecord(FILE *out, const char *content, const char *raw_json) {
+    if (usageState.count == 0) return;
+    const UsageCall *call = &usageState.calls[usageState.count - 1];
+    if (!usageState.runId[0]) {
+        snprintf(usageState.runId, sizeof(usageState.runId), "%lx-%x", (long)time(NULL), (unsigned)getpid());
+    }
+
+    fprintf(out, "{\"id\":\"%s-%zu\",\"ts\":%ld,\"provider\":", usageState.runId, usageState.count, (long)time(NULL));
+    writeJsonString(out, call->provider);
+    fprintf(out, ",\"model\":");
+    writeJsonString(out, callModel(call));
+    fprintf(out, ",\"step\":%d,\"status\":%d,\"retries\":%d,\"coalesced\":%s,\"ttfbMs\":%.3f,\"latencyMs\":%.3f,"
+                 "\"promptTokens\":%ld,\"completionTokens\":%ld,\"cachedTokens\":%ld,\"tokensPerSecond\":%.2f,\"content\":",
+            call->step, call->httpStatus, call->retries, call->coalesced ? "true" : "false", call->ttftMs, call->latencyMs, call->promptTokens,
+            call->completionTokens, call->cachedTokens, tokensPerSecond(call->completionTokens, call->latencyMs));
+    if (content) {
+        writeJsonString(out, content);
+    } else {
+        fprintf(out, "null,\"raw\":");
+        writeJsonString(out, raw_json);
+    }
+    fprintf(out, "}\n");
+    fflush(out);
+}
+
+static int appendMetricsLog(const char *path) {
+    FILE *out = fopen(path, "a");
+    if (!out) return -1;
+
+    long prompt = 0, completion = 0, cached = 0;
+    double ms = 0.0;
+    for (size_t i = 0; i < usageState.count; ++i) {
+        prompt += usageState.calls[i].promptTokens;
+        completion += usageState.calls[i].completionTokens;
+        cached += usageState.calls[i].cachedTokens;
+        ms += usageState.calls[i].latencyMs;
+    }
+
+    fprintf(out, "{\"ts\":%ld,\"provider\":", (long)time(NULL));
+    writeJsonString(out, usageState.calls[0].provider);
+    fprintf(out, ",\"model\":");
+    writeJsonString(out, callModel(&usageState.calls[0]));
+    fprintf(out, ",\"calls\":%zu,\"promptTokens\":%ld,\"completionTokens\":%ld,\"cachedTokens\":%ld,"
+                 "\"durationMs\":%.1f,\"ttftMs\":%.1f,\"tokensPerSecond\":%.2f,\"steps\":[",
+            usageState.count, prompt, completion, cached, ms, usageState.calls[0].ttftMs, tokensPerSecond(completion, ms));
+    for (size_t i = 0; i < usageState.count; ++i) {
+        const UsageCall *call = &usageState.calls[i];
+        fprintf(out, "%s{\"step\":%d,\"status\":%d,\"retries\":%d,\"promptTokens\":%ld,\"completionTokens\":%ld,\"cachedTokens\":%ld,"
+                     "\"durationMs\":%.1f,\"ttftMs\":%.1f,\"tokensPerSecond\":%.2f}",
+                i ? "," : "", call->step, call->httpStatus, call->retries, call->promptTokens, call->completionTokens, call->cachedTokens,
+                call->latencyMs, call->ttftMs, tokensPerSecond(call->completionTokens, call->latencyMs));
+    }
+    fprintf(out, "]}\n");
+    return fclose(out);
+}
+
+static PromSample* promFind(PromFile *file, const char *name, const char *labels) {
+    for (size_t i = 0; i < file->count; ++i) {
+        if (strcmp(file->samples[i].name, name) == 0 && strcmp(file->samples[i].labels, labels) == 0) {
+            return &file->samples[i];
+        }
+    }
+    if (file->count == file->cap) {
+        size_t newCap = file->cap ? file->cap * 2 : 32;
+        PromSample *resized = realloc(file->samples, newCap * sizeof(PromSample));
+        if (!resized) return NULL;
+        file->samples = resized;
+        file->cap = newCap;
+    }
+    PromSample *sample = &file->samples[file->count];
+    sample->name = duplicateString(name);
+    sample->labels = duplicateString(labels);
+    sample->value = 0.0;
+    if (!sample->name || !sample->labels) {
+        free(sample->name);
+        free(sample->labels);
+        return NULL;
+    }
+    file->count++;
+    return sample;
+}
+
+static void promSet(PromFile *file, const char *name, const char *labels, double value, int add) {
+    PromSample *sample = promFind(file, name, labels);
+    if (sample) sample->value = add ? sample->value + value : value;
+}
+
+/* Reads back the samples of a textfile this module wrote earlier. */
+static void promLoad(PromFile *file, FILE *in) {
+    char line[1024];
+    while (fgets(line, sizeof(line), in)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char *labels = strchr(line, '{');
+        char *close = labels ? strrchr(line, '}') : NULL;
+        char *value = close ? close + 1 : strchr(line, ' ');
+        if (!value) continue;
+
+        char *nameEnd = labels ? labels : value;
+        *nameEnd = '\0';
+        if (labels) *close = '\0';
+        promSet(file, line, labels ? labels + 1 : "", strtod(value + 1, NULL), 0);
+    }
+}
+
+static void escapeLabel(char *out, size_t max, const char *text) {
+    size_t len = 0;
+    for (; *text && len + 3 < max; ++text) {
+        if (*text == '"' || *text == '\\') out[len++] = '\\';
+        out[len++] = *text == '\n' ? ' ' : *text;
+    }
+    out[len] = '\0';
+}
+
+static int writeTextfile(const char *path) {
+    size_t pathLen = strlen(path);
+    char *lockPath = malloc(pathLen + 6);
+    char *tmpPath = malloc(pathLen + 32);
+    if (!lockPath || !tmpPath) {
+        free(lockPath);
+        free(tmpPath);
+        return -1;
+    }
+    snprintf(lockPath, pathLen + 6, "%s.lock", path);
+    snprintf(tmpPath, pathLen + 32, "%s.%d.tmp", path, (int)getpid());
+
+    /* Counters accumulate across runs, so the read-modify-write is serialised. */
+    int lockFd = open(lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd >= 0) flock(lockFd, LOCK_EX);
+
+    PromFile file = { 0 };
+    FILE *in = fopen(path, "r");
+    if (in) {
+        promLoad(&file, in);
+        fclose(in);
+    }
+
+    for (size_t i = 0; i < usageState.count; ++i) {
+        const UsageCall *call = &usageState.calls[i];
+        char provider[128], model[256], labels[512];
+        escapeLabel(provider, sizeof(provider), call->provider);
+        escapeLabel(model, sizeof(model), callModel(call));
+        snprintf(labels, sizeof(labels), "provider=\"%s\",model=\"%s\"", provider, model);
+
+        promSet(&file, "gipwrap_requests_total", labels, 1, 1);
+        promSet(&file, "gipwrap_prompt_tokens_total", labels, (double)call->promptTokens, 1);
+        promSet(&file, "gipwrap_completion_tokens_total", labels, (double)call->completionTokens, 1);
+        promSet(&file, "gipwrap_cached_tokens_total", labels, (double)call->cachedTokens, 1);
+        promSet(&file, "gipwrap_request_duration_seconds_total", labels, call->latencyMs / 1000.0, 1);
+
+        int first = 1;
+        for (size_t j = 0; j < i && first; ++j) first = !sameSeries(&usageState.calls[j], call);
+        if (!first) continue;
+
+        long completion = 0;
+        double ms = 0.0;
+        for (size_t j = i; j < usageState.count; ++j) {
+            if (!sameSeries(&usageState.calls[j], call)) continue;
+            completion += usageState.calls[j].completionTokens;
+            ms += usageState.calls[j].latencyMs;
+        }
+        promSet(&file, "gipwrap_runs_total", labels, 1, 1);
+        promSet(&file, "gipwrap_last_tokens_per_second", labels, tokensPerSecond(completion, ms), 0);
+        promSet(&file, "gipwrap_last_ttft_seconds", labels, call->ttftMs / 1000.0, 0);
+        promSet(&file, "gipwrap_last_run_timestamp_seconds", labels, (double)time(NULL), 0);
+    }
+
+    int ret = -1;
+    FILE *out = fopen(tmpPath, "w");
+    if (out) {
+        for (size_t m = 0; m < sizeof(promMetrics) / sizeof(promMetrics[0]); ++m) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", promMetrics[m].name, promMetrics[m].help, promMetrics[m].name, promMetrics[m].type);
+            for (size_t i = 0; i < file.count; ++i) {
+                if (strcmp(file.samples[i].name, promMetrics[m].name) != 0) continue;
+                fprintf(out, "%s{%s} %.15g\n", file.samples[i].name, file.samples[i].labels, file.samples[i].value);
+            }
+        }
+        ret = fclose(out) == 0 && rename(tmpPath, path) == 0 ? 0 : -1;
+        if (ret != 0) unlink(tmpPath);
+    }
+
+    if (lockFd >= 0) close(lockFd);
+    for (size_t i = 0; i < file.count; ++i) {
+        free(file.samples[i].name);
+        free(file.samples[i].labels);
+    }
+    free(file.samples);
+    free(lockPath);
+    free(tmpPath);
+    return ret;
+}
+
+int usageReport(const AIConfig *cfg) {
+    int ret = 0;
+    if (usageState.count > 0) {
+        if (cfg->verbose) {
+            printSummary();
+        }
+        if (cfg->metrics_log && appendMetricsLog(cfg->metrics_log) != 0) {
+            fprintf(stderr, "Failed to append usage to %s\n", cfg->metrics_log);
+            ret = -1;
+        }
+        if (cfg->metrics_textfile && writeTextfile(cfg->metrics_textfile) != 0) {
+            fprintf(stderr, "Failed to write metrics to %s\n", cfg->metrics_textfile);
+            ret = -1;
+        }
+    }
+
+    for (size_t i = 0; i < usageState.count; ++i) {
+        free(usageState.calls[i].model);
+    }
+    free(usageState.calls);
+    memset(&usageState, 0, sizeof(usageState));
+    return ret;
+}
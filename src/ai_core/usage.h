@@ -0,0 +1,24 @@
+#ifndef AI_CORE_USAGE_H
+#define AI_CORE_USAGE_H
+
+#include "ai.h"
+
+/*
+ * Token accounting. Every provider call records the usage block of its
+ * response (prompt, completion and cached tokens), its latency, the time to
+ * the first response byte and the HTTP status, tagged with the current agent
+ * step. --jsonl writes each call as a record as it completes. At the end
+ * of a run the totals can be merged into a node_exporter textfile and/or
+ * appended as one JSON line to a metrics log.
+ */
+double usageNowMs(void);
+void usageSetStep(int step);
+void usageBeginCall(void);
+void usageNoteFirstByte(double agoMs);
+void usageNoteHttp(int status, int retries);
+void usageNoteCoalesced(void);
+void usageRecordCall(const char *ai_type, const char *json);
+void usageWriteRecord(FILE *out, const char *content, const char *raw_json);
+int usageReport(const AIConfig *cfg);
+
+#endif
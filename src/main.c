@@ -3,12 +3,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
 #include "ai.h"
+#include "ai_core/memStats.h"
 
 
 static void usage(void) {
     fprintf(stderr, "Usage: gipwrap [options]\n");
-    fprintf(stderr, "  -a  AI type (chatgpt|ollama|claude|deepseek) [default: chatgpt]\n");
+    fprintf(stderr, "  -a  AI type (chatgpt|ollama|claude|deepseek or a [provider NAME] from ~/.gipwrap/config) [default: chatgpt]\n");
     fprintf(stderr, "  -i  Input file [default: stdin]\n");
     fprintf(stderr, "  -o  Output file [default: stdout]\n");
     fprintf(stderr, "  -s  System prompt file\n");
@@ -19,6 +21,24 @@ static void usage(void) {
     fprintf(stderr, "  -v  Verbose output (full JSON)\n");
     fprintf(stderr, "  -A  Enable agent mode with tool usage\n");
     fprintf(stderr, "  -T  Print agent thinking messages to stderr\n");
+    fprintf(stderr, "  -u  Provider endpoint URL [default: the provider's public API]\n");
+    fprintf(stderr, "  -r  Interactive REPL: streamed replies, in-memory history, /help for commands\n");
+    fprintf(stderr, "  --session NAME        Persist turns in ~/.gipwrap/sessions/NAME and resume from them\n");
+    fprintf(stderr, "  --session-turns N     Number of previous turns to resume with, 0 for all [default: 16]\n");
+    fprintf(stderr, "  --trace FILE          Write Chrome trace-event JSON to FILE and a phase summary to stderr\n");
+    fprintf(stderr, "  --metrics-textfile F  Merge token usage counters into node_exporter textfile F (e.g. .../gipwrap.prom)\n");
+    fprintf(stderr, "  --metrics-log FILE    Append one JSON line of token usage per run to FILE\n");
+    fprintf(stderr, "  --mem-stats           Count allocations, bytes, realloc copies and peak live bytes per phase; print with peak RSS to stderr\n");
+    fprintf(stderr, "  --warmup              ollama: start loading the model while the input is read\n");
+    fprintf(stderr, "  --keep-alive DUR      ollama: keep_alive sent with every request (seconds or 5m, 1h; -1 forever)\n");
+    fprintf(stderr, "  --jsonl               Print one JSON record per provider call: id, provider, model, status, retries, ttfb, latency, tokens, content\n");
+    fprintf(stderr, "  --retry N             Let curl retry timeouts and 408/429/5xx replies up to N times\n");
+    fprintf(stderr, "  --singleflight        Coalesce identical in-flight requests across gipwrap processes into one upstream call\n");
+    fprintf(stderr, "  --deadline SECS       Bound the whole run; requests and tools get the time left, then are killed (exit 124)\n");
+    fprintf(stderr, "  --timeout SECS        Cap each provider request at SECS\n");
+    fprintf(stderr, "  --max-steps N         Agent steps before giving up [default: 8]\n");
+    fprintf(stderr, "  --stream              Stream the reply as it arrives; with -A, start each step's tool before the reply ends\n");
+    fprintf(stderr, "  --pin[=MODELS]        ollama: load MODELS (comma-separated; default the run's model) now and keep them loaded\n");
     exit(1);
 }
 
@@ -34,11 +54,75 @@ int main(int argc, char *argv[]) {
         .key_raw = NULL,
         .verbose = 0,
         .agentMode = 0,
-        .agentThinking = 0
+        .agentThinking = 0,
+        .session_name = NULL,
+        .session_turns = 16,
+        .trace_file = NULL,
+        .endpoint = NULL,
+        .metrics_textfile = NULL,
+        .metrics_log = NULL,
+        .mem_stats = 0,
+        .warmup = 0,
+        .keep_alive = NULL,
+        .pin = 0,
+        .pin_models = NULL,
+        .ollama_context = NULL,
+        .json_schema = NULL,
+        .repl = 0,
+        .stream = 0,
+        .stream_out = NULL,
+        .stream_echoed = 0,
+        .stream_hook = NULL,
+        .stream_hook_user = NULL,
+        .jsonl = 0,
+        .retries = 0,
+        .singleflight = 0,
+        .deadline = 0,
+        .timeout = 0,
+        .max_steps = 8
+    };
+
+    enum {
+        OPT_SESSION = 256,
+        OPT_SESSION_TURNS,
+        OPT_TRACE,
+        OPT_METRICS_TEXTFILE,
+        OPT_METRICS_LOG,
+        OPT_MEM_STATS,
+        OPT_WARMUP,
+        OPT_KEEP_ALIVE,
+        OPT_PIN,
+        OPT_JSONL,
+        OPT_RETRY,
+        OPT_SINGLEFLIGHT,
+        OPT_DEADLINE,
+        OPT_TIMEOUT,
+        OPT_MAX_STEPS,
+        OPT_STREAM
+    };
+    static const struct option longOptions[] = {
+        { "session", required_argument, NULL, OPT_SESSION },
+        { "session-turns", required_argument, NULL, OPT_SESSION_TURNS },
+        { "trace", required_argument, NULL, OPT_TRACE },
+        { "metrics-textfile", required_argument, NULL, OPT_METRICS_TEXTFILE },
+        { "metrics-log", required_argument, NULL, OPT_METRICS_LOG },
+        { "mem-stats", no_argument, NULL, OPT_MEM_STATS },
+        { "warmup", no_argument, NULL, OPT_WARMUP },
+        { "keep-alive", required_argument, NULL, OPT_KEEP_ALIVE },
+        { "pin", optional_argument, NULL, OPT_PIN },
+        { "jsonl", no_argument, NULL, OPT_JSONL },
+        { "retry", required_argument, NULL, OPT_RETRY },
+        { "singleflight", no_argument, NULL, OPT_SINGLEFLIGHT },
+        { "deadline", required_argument, NULL, OPT_DEADLINE },
+        { "timeout", required_argument, NULL, OPT_TIMEOUT },
+        { "max-steps", required_argument, NULL, OPT_MAX_STEPS },
+        { "stream", no_argument, NULL, OPT_STREAM },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "a:i:o:s:S:m:k:K:vATh")) != -1) {
+    while ((opt = getopt_long(argc, argv, "a:i:o:s:S:m:k:K:vATu:rh", longOptions, NULL)) != -1) {
         switch (opt) {
             case 'a': cfg.ai_type = optarg; break;
             case 'i': cfg.input_file = optarg; break;
@@ -51,11 +135,34 @@ int main(int argc, char *argv[]) {
             case 'v': cfg.verbose = 1; break;
             case 'A': cfg.agentMode = 1; break;
             case 'T': cfg.agentThinking = 1; break;
+            case 'u': cfg.endpoint = optarg; break;
+            case 'r': cfg.repl = 1; break;
+            case OPT_SESSION: cfg.session_name = optarg; break;
+            case OPT_SESSION_TURNS: cfg.session_turns = atoi(optarg); break;
+            case OPT_TRACE: cfg.trace_file = optarg; break;
+            case OPT_METRICS_TEXTFILE: cfg.metrics_textfile = optarg; break;
+            case OPT_METRICS_LOG: cfg.metrics_log = optarg; break;
+            case OPT_MEM_STATS: cfg.mem_stats = 1; break;
+            case OPT_WARMUP: cfg.warmup = 1; break;
+            case OPT_KEEP_ALIVE: cfg.keep_alive = optarg; break;
+            case OPT_PIN: cfg.pin = 1; cfg.pin_models = optarg; break;
+            case OPT_JSONL: cfg.jsonl = 1; break;
+            case OPT_RETRY: cfg.retries = atoi(optarg); break;
+            case OPT_SINGLEFLIGHT: cfg.singleflight = 1; break;
+            case OPT_DEADLINE: cfg.deadline = atof(optarg); break;
+            case OPT_TIMEOUT: cfg.timeout = atof(optarg); break;
+            case OPT_MAX_STEPS: cfg.max_steps = atoi(optarg); break;
+            case OPT_STREAM: cfg.stream = 1; break;
             case 'h':
             default: usage();
         }
     }
     
+    if (cfg.mem_stats) {
+        memStatsEnable();
+    }
+
     int ret = ai_execute(&cfg);
+    memStatsReport(stderr);
     return ret;
 }
@@ -9,6 +9,8 @@ typedef struct {
     const char *name;
     const char *description;
     AgentToolInvoker invoke;
+    /* Read-only: may start on a worker thread while the provider reply is still streaming. */
+    int early;
 } AgentTool;
 
 const AgentTool* getAgentTools(size_t *count);
@@ -1,7 +1,9 @@
+#define _GNU_SOURCE
 #include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,7 +15,14 @@
 #include <unistd.h>
 
 #include "ai.h"
+#include "ai_core/deadline.h"
+#include "ai_core/jsonEscape.h"
 #include "tools.h"
+#include "tools/fileSearch.h"
+#include "tools/memory.h"
+#include "tools/memoryVector.h"
+#include "tools/player.h"
+#include "tools/speech.h"
 
 static char* duplicateString(const char *src) {
     if (!src) return NULL;
@@ -79,77 +88,415 @@ static char* formatString(const char *fmt, ...) {
     return buffer;
 }
 
-static char* agentToolReadFile(const char *argument, char **error_out) {
-    if (!argument || !*argument) {
+#define READ_FILE_DEFAULT_MAX (64 * 1024)
+#define READ_FILE_HARD_MAX (1024 * 1024)
+#define READ_FILE_SNIFF_BYTES 8192
+
+typedef struct {
+    char *path;
+    size_t offset;
+    size_t length;
+    size_t firstLine;
+    size_t lastLine;
+    size_t maxBytes;
+} ReadFileRequest;
+
+static int parseSize(const char *value, size_t *out) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (errno != 0 || end == value || *value == '-') return -1;
+    if (*end == 'k' || *end == 'K') {
+        parsed *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        parsed *= 1024 * 1024;
+        end++;
+    }
+    if (*end) return -1;
+    *out = (size_t)parsed;
+    return 0;
+}
+
+/*
+ * Input is a bare path, or lines: path=, offset= and length= (bytes, k/m suffixes),
+ * lines=START-END (1-based, inclusive; "START-" reads to EOF) and max= (output cap).
+ */
+static int parseReadFileRequest(const char *argument, ReadFileRequest *request, char **error_out) {
+    memset(request, 0, sizeof(*request));
+    request->maxBytes = READ_FILE_DEFAULT_MAX;
+
+    char *copy = duplicateString(argument ? argument : "");
+    if (!copy) {
+        if (error_out) *error_out = duplicateString("Out of memory while parsing readFile input.");
+        return -1;
+    }
+
+    int failed = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(copy, "\n", &save); line && !failed; line = strtok_r(NULL, "\n", &save)) {
+        trimWhitespaceInPlace(line);
+        if (!*line) continue;
+
+        const char *value = strchr(line, '=');
+        if (value && strncasecmp(line, "path=", 5) == 0) {
+            free(request->path);
+            request->path = duplicateTrimmed(value + 1);
+        } else if (value && strncasecmp(line, "offset=", 7) == 0) {
+            failed = parseSize(value + 1, &request->offset);
+        } else if (value && strncasecmp(line, "length=", 7) == 0) {
+            failed = parseSize(value + 1, &request->length);
+        } else if (value && strncasecmp(line, "max=", 4) == 0) {
+            failed = parseSize(value + 1, &request->maxBytes) || request->maxBytes == 0;
+        } else if (value && strncasecmp(line, "lines=", 6) == 0) {
+            char *end = NULL;
+            unsigned long first = strtoul(value + 1, &end, 10);
+            unsigned long last = first;
+            if (*end == '-') {
+                last = strtoul(end + 1, &end, 10);
+            }
+            if (*end || first == 0 || (last != 0 && last < first)) failed = 1;
+            request->firstLine = first;
+            request->lastLine = last;
+        } else if (!request->path) {
+            request->path = duplicateString(line);
+        }
+        if (failed && error_out) *error_out = formatString("Invalid readFile option '%s'.", line);
+    }
+    free(copy);
+
+    if (!failed && (!request->path || !*request->path)) {
         if (error_out) *error_out = duplicateString("readFile requires a file path argument.");
-        return NULL;
+        failed = 1;
     }
+    if (failed) {
+        free(request->path);
+        request->path = NULL;
+        return -1;
+    }
+    if (request->maxBytes > READ_FILE_HARD_MAX) request->maxBytes = READ_FILE_HARD_MAX;
+    return 0;
+}
 
-    char *contents = read_file(argument);
-    if (!contents) {
-        if (error_out) *error_out = formatString("Failed to read file '%s'.", argument);
-        return NULL;
+/* NUL bytes or mostly control characters in the sniffed prefix mark a file as binary. */
+static int looksBinary(const unsigned char *data, size_t len) {
+    size_t control = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] == 0) return 1;
+        if (data[i] < 0x20 && data[i] != '\n' && data[i] != '\r' && data[i] != '\t' && data[i] != '\f' && data[i] != 0x1b) {
+            control++;
+        }
     }
+    return len > 0 && control * 10 > len;
+}
 
-    return contents;
+#define READ_FILE_CHUNK (64 * 1024)
+
+/*
+ * Finds the byte span of 1-based lines [first, last] (last == 0 means EOF) by
+ * reading the file in chunks. *startOut is SIZE_MAX when first is past the
+ * last line; *linesOut is the last line number the span reaches.
+ */
+static int lineSpan(int fd, size_t size, size_t first, size_t last, size_t *startOut, size_t *spanOut, size_t *linesOut) {
+    char *chunk = malloc(READ_FILE_CHUNK);
+    if (!chunk) return -1;
+
+    size_t line = 1;
+    size_t start = first == 1 ? 0 : SIZE_MAX;
+    size_t end = size;
+    size_t pos = 0;
+    char lastByte = '\n';
+    int done = 0;
+    while (pos < size && !done) {
+        size_t want = size - pos < READ_FILE_CHUNK ? size - pos : READ_FILE_CHUNK;
+        ssize_t got = pread(fd, chunk, want, (off_t)pos);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            /* Truncated underneath us: the file now ends here. */
+            end = pos;
+            break;
+        }
+        for (const char *nl = memchr(chunk, '\n', (size_t)got); nl; nl = memchr(nl + 1, '\n', (size_t)(chunk + got - nl - 1))) {
+            size_t after = pos + (size_t)(nl - chunk) + 1;
+            if (line + 1 == first) start = after;
+            line++;
+            if (last && line > last) {
+                end = after;
+                done = 1;
+                break;
+            }
+        }
+        lastByte = chunk[got - 1];
+        pos += (size_t)got;
+    }
+    free(chunk);
+
+    /* A final line without a newline still counts. */
+    if (!done && lastByte != '\n') line++;
+    *linesOut = line - 1;
+    if (start != SIZE_MAX && (start > end || first > *linesOut)) start = SIZE_MAX;
+    *startOut = start;
+    *spanOut = start == SIZE_MAX ? 0 : end - start;
+    return 0;
 }
 
-static char* agentToolListDir(const char *argument, char **error_out) {
-    const char *path = (argument && *argument) ? argument : ".";
-    DIR *dir = opendir(path);
-    if (!dir) {
-        if (error_out) *error_out = formatString("Failed to open directory '%s': %s", path, strerror(errno));
+/* Reads up to len bytes at offset; a file that shrinks underneath only gives a short read. */
+static char* readSpan(int fd, size_t offset, size_t len, size_t *gotOut) {
+    char *buffer = malloc(len + 1);
+    if (!buffer) return NULL;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, buffer + got, len - got, (off_t)(offset + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    buffer[got] = '\0';
+    *gotOut = got;
+    return buffer;
+}
+
+static int appendBytes(char **buffer, size_t *len, size_t *cap, const char *data, size_t dataLen) {
+    if (*len + dataLen + 1 > *cap) {
+        size_t newCap = *cap ? *cap : 256;
+        while (*len + dataLen + 1 > newCap) newCap *= 2;
+        char *resized = realloc(*buffer, newCap);
+        if (!resized) return -1;
+        *buffer = resized;
+        *cap = newCap;
+    }
+    memcpy(*buffer + *len, data, dataLen);
+    *len += dataLen;
+    (*buffer)[*len] = '\0';
+    return 0;
+}
+
+static char* hexPreview(const unsigned char *data, size_t len, size_t baseOffset) {
+    char *out = NULL;
+    size_t outLen = 0;
+    size_t cap = 0;
+    for (size_t row = 0; row < len; row += 16) {
+        char line[96];
+        int n = snprintf(line, sizeof(line), "%08zx ", baseOffset + row);
+        for (size_t i = row; i < row + 16 && i < len; ++i) {
+            n += snprintf(line + n, sizeof(line) - (size_t)n, " %02x", data[i]);
+        }
+        line[n++] = '\n';
+        if (appendBytes(&out, &outLen, &cap, line, (size_t)n) != 0) {
+            free(out);
+            return NULL;
+        }
+    }
+    return out;
+}
+
+/*
+ * Slices the file with pread, so only the requested span is read (or just
+ * its head and tail when it is over max=), and a file truncated by another
+ * process only shortens the result. Output past max= keeps a head and a
+ * tail, cut at line boundaries, with the elided span spelled out so the
+ * agent can page into it with offset=/length=.
+ */
+static char* agentToolReadFile(const char *argument, char **error_out) {
+    ReadFileRequest request;
+    if (parseReadFileRequest(argument, &request, error_out) != 0) {
         return NULL;
     }
 
-    size_t cap = 256;
-    size_t len = 0;
-    char *buffer = malloc(cap);
-    if (!buffer) {
-        closedir(dir);
-        if (error_out) *error_out = duplicateString("Out of memory while listing directory.");
+    int fd = open(request.path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (error_out) *error_out = formatString("Failed to read file '%s': %s", request.path, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(request.path);
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        if (error_out) *error_out = formatString("'%s' is not a regular file.", request.path);
+        free(request.path);
         return NULL;
     }
-    buffer[0] = '\0';
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+    size_t size = (size_t)st.st_size;
+    size_t start = request.offset < size ? request.offset : size;
+    size_t span = size - start;
+    size_t totalLines = 0;
+    if (request.firstLine) {
+        if (lineSpan(fd, size, request.firstLine, request.lastLine, &start, &span, &totalLines) != 0) {
+            close(fd);
+            if (error_out) *error_out = formatString("Out of memory while reading '%s'.", request.path);
+            free(request.path);
+            return NULL;
         }
-        size_t name_len = strlen(entry->d_name);
-        while (len + name_len + 2 >= cap) {
-            cap *= 2;
-            char *resized = realloc(buffer, cap);
-            if (!resized) {
-                free(buffer);
-                closedir(dir);
-                if (error_out) *error_out = duplicateString("Out of memory while listing directory.");
-                return NULL;
-            }
-            buffer = resized;
+        if (start == SIZE_MAX) {
+            close(fd);
+            if (error_out) *error_out = formatString("Start line %zu is past the end of '%s' (%zu lines).", request.firstLine, request.path, totalLines);
+            free(request.path);
+            return NULL;
+        }
+    } else if (request.length && request.length < span) {
+        span = request.length;
+    }
+
+    /* The head also covers the binary sniff; past max= only its first half is shown. */
+    size_t sniff = span < READ_FILE_SNIFF_BYTES ? span : READ_FILE_SNIFF_BYTES;
+    size_t headLen = span <= request.maxBytes ? span : request.maxBytes / 2;
+    size_t headGot = 0;
+    char *head = readSpan(fd, start, headLen > sniff ? headLen : sniff, &headGot);
+    if (head && headGot < headLen) {
+        /* The file shrank: show what is left. */
+        span = headLen = headGot;
+    }
+    int binary = head && looksBinary((const unsigned char *)head, headGot < sniff ? headGot : sniff);
+
+    char *out = NULL;
+    size_t outLen = 0;
+    size_t cap = 0;
+    char *header;
+    if (request.firstLine) {
+        size_t lastShown = request.lastLine && request.lastLine < totalLines ? request.lastLine : totalLines;
+        header = formatString("[%s: %zu bytes; lines %zu-%zu = bytes %zu-%zu%s]\n", request.path, size,
+                              request.firstLine, lastShown, start, start + span,
+                              request.lastLine == 0 || request.lastLine > totalLines ? ", end of file" : "");
+    } else {
+        header = formatString("[%s: %zu bytes; bytes %zu-%zu%s]\n", request.path, size, start, start + span,
+                              start + span == size ? ", end of file" : "");
+    }
+    int failed = !head || !header || appendBytes(&out, &outLen, &cap, header, strlen(header)) != 0;
+    free(header);
+
+    if (!failed && binary) {
+        size_t previewLen = headGot < 256 ? headGot : 256;
+        char *preview = hexPreview((const unsigned char *)head, previewLen, start);
+        char *note = formatString("Binary content; hex preview of %zu bytes. Use offset=/length= to inspect other regions.\n", previewLen);
+        failed = !preview || !note ||
+                 appendBytes(&out, &outLen, &cap, note, strlen(note)) != 0 ||
+                 appendBytes(&out, &outLen, &cap, preview, strlen(preview)) != 0;
+        free(preview);
+        free(note);
+    } else if (!failed && span <= request.maxBytes) {
+        failed = appendBytes(&out, &outLen, &cap, head, span) != 0;
+    } else if (!failed) {
+        size_t tailLen = request.maxBytes - headLen;
+        const char *headEnd = memrchr(head, '\n', headLen);
+        if (headEnd && (size_t)(headEnd - head) >= headLen / 2) {
+            headLen = (size_t)(headEnd - head) + 1;
         }
-        memcpy(buffer + len, entry->d_name, name_len);
-        len += name_len;
-        buffer[len++] = '\n';
-        buffer[len] = '\0';
+        size_t tailStart = start + span - tailLen;
+        size_t tailGot = 0;
+        char *tail = readSpan(fd, tailStart, tailLen, &tailGot);
+        const char *tailNl = tail ? memchr(tail, '\n', tailGot < tailLen / 2 ? tailGot : tailLen / 2) : NULL;
+        size_t skip = tailNl ? (size_t)(tailNl - tail) + 1 : 0;
+        tailStart += skip;
+        char *marker = formatString("\n[... %zu bytes elided (bytes %zu-%zu); read them with offset=%zu length=%zu ...]\n",
+                                    tailStart - (start + headLen), start + headLen, tailStart,
+                                    start + headLen, tailStart - (start + headLen));
+        failed = !tail || !marker ||
+                 appendBytes(&out, &outLen, &cap, head, headLen) != 0 ||
+                 appendBytes(&out, &outLen, &cap, marker, strlen(marker)) != 0 ||
+                 appendBytes(&out, &outLen, &cap, tail + skip, tailGot - skip) != 0;
+        free(marker);
+        free(tail);
+    }
+
+    free(head);
+    close(fd);
+    if (failed) {
+        free(out);
+        if (error_out) *error_out = formatString("Out of memory while reading '%s'.", request.path);
+        out = NULL;
+    }
+    free(request.path);
+    return out;
+}
+
+/*
+ * listDir and searchFiles take a bare first line (the directory, or the
+ * pattern for searchFiles) or lines path=, depth= (0 or recursive=1 for no
+ * limit), glob=, max=, all=1 (keep hidden and gitignored entries) and, for
+ * searchFiles, pattern=, fixed=1 and case=insensitive.
+ */
+static int parseWalkRequest(const char *argument, int forSearch, FileSearchOptions *request, char **storage, char **error_out) {
+    memset(request, 0, sizeof(*request));
+    request->walk.root = ".";
+    request->walk.maxDepth = forSearch ? 0 : 1;
+    request->walk.maxEntries = forSearch ? 200 : 1000;
+    int all = -1;
+
+    char *copy = duplicateString(argument ? argument : "");
+    if (!copy) {
+        if (error_out) *error_out = duplicateString("Out of memory while parsing tool input.");
+        return -1;
     }
-    closedir(dir);
 
-    if (len == 0) {
-        const char *empty_msg = "(empty directory)\n";
-        size_t msg_len = strlen(empty_msg);
-        char *resized = realloc(buffer, msg_len + 1);
-        if (!resized) {
-            free(buffer);
-            if (error_out) *error_out = duplicateString("Out of memory while finalizing directory listing.");
-            return NULL;
+    char *save = NULL;
+    int sawBare = 0;
+    for (char *line = strtok_r(copy, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        trimWhitespaceInPlace(line);
+        if (!*line) continue;
+
+        char *value = strchr(line, '=');
+        if (value) value++;
+        if (value && strncasecmp(line, "path=", 5) == 0) {
+            request->walk.root = value;
+        } else if (value && strncasecmp(line, "depth=", 6) == 0) {
+            request->walk.maxDepth = atoi(value) < 0 ? 0 : atoi(value);
+        } else if (value && strncasecmp(line, "recursive=", 10) == 0) {
+            request->walk.maxDepth = atoi(value) ? 0 : 1;
+        } else if (value && strncasecmp(line, "glob=", 5) == 0) {
+            request->walk.glob = value;
+        } else if (value && strncasecmp(line, "max=", 4) == 0) {
+            long max = strtol(value, NULL, 10);
+            long cap = forSearch ? 2000 : 10000;
+            request->walk.maxEntries = max < 1 ? 1 : (max > cap ? (size_t)cap : (size_t)max);
+        } else if (value && strncasecmp(line, "all=", 4) == 0) {
+            all = atoi(value) != 0;
+        } else if (forSearch && value && strncasecmp(line, "pattern=", 8) == 0) {
+            request->pattern = value;
+        } else if (forSearch && value && strncasecmp(line, "fixed=", 6) == 0) {
+            request->fixedString = atoi(value) != 0;
+        } else if (forSearch && value && strncasecmp(line, "case=", 5) == 0) {
+            request->ignoreCase = strcasecmp(value, "insensitive") == 0 || strcasecmp(value, "ignore") == 0;
+        } else if (!sawBare) {
+            sawBare = 1;
+            if (forSearch) {
+                request->pattern = line;
+            } else {
+                request->walk.root = line;
+            }
+        } else {
+            if (error_out) *error_out = formatString("Unrecognized option '%s'.", line);
+            free(copy);
+            return -1;
         }
-        buffer = resized;
-        memcpy(buffer, empty_msg, msg_len + 1);
     }
 
-    return buffer;
+    request->walk.filtered = all >= 0 ? !all : request->walk.maxDepth != 1;
+    *storage = copy;
+    return 0;
+}
+
+static char* agentToolListDir(const char *argument, char **error_out) {
+    FileSearchOptions request;
+    char *storage = NULL;
+    if (parseWalkRequest(argument, 0, &request, &storage, error_out) != 0) {
+        return NULL;
+    }
+    char *listing = fileWalkList(&request.walk, error_out);
+    free(storage);
+    return listing;
+}
+
+static char* agentToolSearchFiles(const char *argument, char **error_out) {
+    FileSearchOptions request;
+    char *storage = NULL;
+    if (parseWalkRequest(argument, 1, &request, &storage, error_out) != 0) {
+        return NULL;
+    }
+    char *matches = fileSearchRun(&request, error_out);
+    free(storage);
+    return matches;
 }
 
 static int ensureDirectoryExists(const char *path) {
@@ -283,7 +630,7 @@ static char* joinAiDir(const char *relative, char **error_out) {
     return fullPath;
 }
 
-static char* escapeJsonString(const char *src) {
+char* toolsEscapeJson(const char *src) {
     if (!src) {
         return duplicateString("");
     }
@@ -334,36 +681,6 @@ static char* escapeJsonString(const char *src) {
     return out;
 }
 
-static char* readFileIfExists(const char *path) {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        return NULL;
-    }
-
-    fseek(f, 0, SEEK_END);
-    long len = ftell(f);
-    if (len < 0) {
-        fclose(f);
-        return NULL;
-    }
-    fseek(f, 0, SEEK_SET);
-
-    char *buf = malloc((size_t)len + 1);
-    if (!buf) {
-        fclose(f);
-        return NULL;
-    }
-
-    size_t read = fread(buf, 1, (size_t)len, f);
-    fclose(f);
-    if (read != (size_t)len) {
-        free(buf);
-        return NULL;
-    }
-    buf[len] = '\0';
-    return buf;
-}
-
 static char* createTimestampedName(const char *prefix, const char *extension) {
     time_t now = time(NULL);
     struct tm tm_now;
@@ -400,10 +717,17 @@ static char* runCommandInAiDir(const char *command, int *exitCode, char **error_
         return NULL;
     }
 
-    FILE *pipe = popen(shellCmd, "r");
+    /* Its own process group, so a deadline or Ctrl-C takes down everything the command started. */
+    int outFd = -1;
+    pid_t child = deadlineSpawnShell(shellCmd, &outFd);
     free(shellCmd);
+    FILE *pipe = child > 0 ? fdopen(outFd, "r") : NULL;
     if (!pipe) {
-        if (error_out) *error_out = duplicateString("Failed to execute command with popen.");
+        if (child > 0) {
+            close(outFd);
+            deadlineWaitChild(child, NULL);
+        }
+        if (error_out) *error_out = duplicateString("Failed to execute command.");
         return NULL;
     }
 
@@ -411,7 +735,8 @@ static char* runCommandInAiDir(const char *command, int *exitCode, char **error_
     size_t len = 0;
     char *output = malloc(cap);
     if (!output) {
-        pclose(pipe);
+        fclose(pipe);
+        deadlineWaitChild(child, NULL);
         if (error_out) *error_out = duplicateString("Out of memory capturing command output.");
         return NULL;
     }
@@ -423,7 +748,8 @@ static char* runCommandInAiDir(const char *command, int *exitCode, char **error_
             char *resized = realloc(output, cap);
             if (!resized) {
                 free(output);
-                pclose(pipe);
+                fclose(pipe);
+                deadlineWaitChild(child, NULL);
                 if (error_out) *error_out = duplicateString("Out of memory capturing command output.");
                 return NULL;
             }
@@ -433,9 +759,10 @@ static char* runCommandInAiDir(const char *command, int *exitCode, char **error_
     }
     output[len] = '\0';
 
-    int status = pclose(pipe);
+    fclose(pipe);
+    int status = 0;
     int code = -1;
-    if (status == -1) {
+    if (deadlineWaitChild(child, &status) != 0) {
         if (error_out) *error_out = duplicateString("Failed to retrieve command status.");
         free(output);
         return NULL;
@@ -547,139 +874,228 @@ static char* agentToolSaveMemory(const char *argument, char **error_out) {
         return NULL;
     }
 
-    char *escaped = escapeJsonString(memoryText);
+    char *escaped = toolsEscapeJson(memoryText);
     free(memoryText);
     if (!escaped) {
         if (error_out) *error_out = duplicateString("Failed to prepare JSON payload for memory entry.");
         return NULL;
     }
 
-    time_t now = time(NULL);
-    struct tm tm_now;
-    localtime_r(&now, &tm_now);
-    char timestamp[64];
-    if (strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S%z", &tm_now) == 0) {
-        snprintf(timestamp, sizeof(timestamp), "%ld", (long)now);
+    uint64_t id = 0;
+    int64_t epoch = 0;
+    if (memoryStoreAppend(escaped, &id, &epoch, error_out) != 0) {
+        free(escaped);
+        return NULL;
     }
 
-    char *entry = formatString("  {\"timestamp\":\"%s\",\"memory\":\"%s\"}", timestamp, escaped);
-    free(escaped);
-    if (!entry) {
-        if (error_out) *error_out = duplicateString("Failed to format memory entry.");
-        return NULL;
+    float *vector = NULL;
+    uint32_t dim = 0;
+    char *embedError = NULL;
+    if (memoryEmbed(escaped, &vector, &dim, &embedError) == 0) {
+        memoryStoreAttachEmbedding(id, epoch, vector, dim, &embedError);
+        free(vector);
     }
+    free(escaped);
 
-    char *aiDir = ensureAiDirPath(error_out);
-    if (!aiDir) {
-        free(entry);
-        return NULL;
+    char *message = formatString("Memory #%llu saved to ~/.gipwrap/memory.log.%s%s", (unsigned long long)id,
+                                 embedError ? " Keyword search only: " : "", embedError ? embedError : "");
+    free(embedError);
+    return message;
+}
+
+static int64_t parseTimeBound(const char *value, time_t now) {
+    char *end = NULL;
+    long long amount = strtoll(value, &end, 10);
+    if (end != value && end && *end && !end[1]) {
+        switch (*end) {
+            case 'm': return (int64_t)now - amount * 60;
+            case 'h': return (int64_t)now - amount * 3600;
+            case 'd': return (int64_t)now - amount * 86400;
+            case 'w': return (int64_t)now - amount * 7 * 86400;
+            default: break;
+        }
+    }
+    if (end != value && end && !*end) {
+        return (int64_t)amount;
     }
 
-    char *memoryPath = formatString("%s/memory.json", aiDir);
-    free(aiDir);
-    if (!memoryPath) {
-        free(entry);
-        if (error_out) *error_out = duplicateString("Failed to build memory file path.");
-        return NULL;
+    struct tm tm_bound;
+    memset(&tm_bound, 0, sizeof(tm_bound));
+    if (sscanf(value, "%d-%d-%d", &tm_bound.tm_year, &tm_bound.tm_mon, &tm_bound.tm_mday) == 3) {
+        tm_bound.tm_year -= 1900;
+        tm_bound.tm_mon -= 1;
+        tm_bound.tm_isdst = -1;
+        return (int64_t)mktime(&tm_bound);
     }
+    return -1;
+}
 
-    char *existing = readFileIfExists(memoryPath);
-    char *newFile = NULL;
+/*
+ * Input is either a bare query or key=value lines: query=, since=, until=
+ * (7d / 12h / 2w ago, YYYY-MM-DD, or epoch seconds), mode=hybrid|keyword|semantic and limit=.
+ */
+static int parseMemoryQuery(const char *argument, MemoryQuery *query, char **queryText, int *keywordOnly, char **error_out) {
+    memset(query, 0, sizeof(*query));
+    query->limit = 10;
+    *queryText = NULL;
+    *keywordOnly = 0;
+
+    char *copy = duplicateString(argument ? argument : "");
+    if (!copy) {
+        if (error_out) *error_out = duplicateString("Out of memory while parsing memory query.");
+        return -1;
+    }
 
-    if (!existing) {
-        newFile = formatString("[\n%s\n]\n", entry);
-    } else {
-        size_t len = strlen(existing);
-        if (len < 2 || existing[0] != '[') {
-            newFile = formatString("[\n%s\n]\n", entry);
-        } else {
-            char *body = NULL;
-            if (len >= 2) {
-                body = malloc(len - 1);
-                if (body) {
-                    memcpy(body, existing + 1, len - 2);
-                    body[len - 2] = '\0';
-                    trimWhitespaceInPlace(body);
-                }
+    time_t now = time(NULL);
+    char *text = NULL;
+    char *save = NULL;
+    for (char *line = strtok_r(copy, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        trimWhitespaceInPlace(line);
+        if (!*line) continue;
+
+        const char *value = strchr(line, '=');
+        if (value && strncasecmp(line, "query=", 6) == 0) {
+            free(text);
+            text = duplicateTrimmed(value + 1);
+        } else if (value && (strncasecmp(line, "since=", 6) == 0 || strncasecmp(line, "until=", 6) == 0)) {
+            int64_t bound = parseTimeBound(value + 1, now);
+            if (bound < 0) {
+                if (error_out) *error_out = formatString("Unrecognized time bound '%s'. Use 7d, 12h, 2w, YYYY-MM-DD or epoch seconds.", value + 1);
+                free(text);
+                free(copy);
+                return -1;
             }
-
-            if (!body) {
-                newFile = formatString("[\n%s\n]\n", entry);
-            } else if (*body) {
-                newFile = formatString("[\n%s,\n%s\n]\n", body, entry);
+            if (tolower((unsigned char)line[0]) == 's') {
+                query->since = bound;
             } else {
-                newFile = formatString("[\n%s\n]\n", entry);
+                query->until = bound;
             }
-
-            if (body) free(body);
+        } else if (value && strncasecmp(line, "mode=", 5) == 0) {
+            if (strcasecmp(value + 1, "keyword") == 0) {
+                *keywordOnly = 1;
+            } else if (strcasecmp(value + 1, "semantic") == 0) {
+                query->semanticOnly = 1;
+            }
+        } else if (value && strncasecmp(line, "limit=", 6) == 0) {
+            long limit = strtol(value + 1, NULL, 10);
+            query->limit = limit < 1 ? 1 : (limit > 100 ? 100 : (size_t)limit);
+        } else if (!text) {
+            text = duplicateString(line);
         }
-        free(existing);
     }
+    free(copy);
 
-    if (!newFile) {
-        free(entry);
-        free(memoryPath);
-        if (error_out) *error_out = duplicateString("Failed to build updated memory document.");
+    *queryText = text;
+    query->text = text;
+    return 0;
+}
+
+static char* agentToolGetMemories(const char *argument, char **error_out) {
+    MemoryQuery query;
+    char *queryText = NULL;
+    int keywordOnly = 0;
+    if (parseMemoryQuery(argument, &query, &queryText, &keywordOnly, error_out) != 0) {
         return NULL;
     }
 
-    FILE *f = fopen(memoryPath, "w");
-    if (!f) {
-        char *msg = formatString("Failed to open %s for writing: %s", memoryPath, strerror(errno));
-        free(entry);
-        free(memoryPath);
-        free(newFile);
-        if (error_out) {
-            *error_out = msg ? msg : duplicateString("Failed to open memory file for writing.");
-        } else if (msg) {
-            free(msg);
+    if (!keywordOnly && query.text) {
+        char *escaped = toolsEscapeJson(query.text);
+        if (escaped && memoryEmbed(escaped, &query.embedding, &query.embeddingDim, NULL) != 0) {
+            query.embedding = NULL;
+            query.embeddingDim = 0;
         }
-        return NULL;
+        free(escaped);
     }
 
-    fputs(newFile, f);
-    fclose(f);
-
-    free(entry);
-    free(memoryPath);
-    free(newFile);
-
-    return duplicateString("Memory saved to ~/.gipwrap/memory.json.");
-}
-
-static char* agentToolGetMemories(const char *argument, char **error_out) {
-    (void)argument;
-
-    char *aiDir = ensureAiDirPath(error_out);
-    if (!aiDir) {
+    MemoryEntry *entries = NULL;
+    size_t count = 0;
+    int ret = memoryStoreSearch(&query, &entries, &count, error_out);
+    free(query.embedding);
+    free(queryText);
+    if (ret != 0) {
         return NULL;
     }
 
-    char *memoryPath = formatString("%s/memory.json", aiDir);
-    free(aiDir);
-    if (!memoryPath) {
-        if (error_out) *error_out = duplicateString("Failed to build memory path.");
+    if (count == 0) {
+        memoryStoreFreeEntries(entries, count);
+        int filtered = query.text || query.since || query.until;
+        return duplicateString(filtered ? "No matching memories." : "No memories stored yet.");
+    }
+
+    size_t cap = 256;
+    size_t len = 0;
+    char *buffer = malloc(cap);
+    if (!buffer) {
+        memoryStoreFreeEntries(entries, count);
+        if (error_out) *error_out = duplicateString("Out of memory while formatting memories.");
         return NULL;
     }
+    len += (size_t)sprintf(buffer, "[\n");
 
-    char *contents = readFileIfExists(memoryPath);
-    free(memoryPath);
+    for (size_t i = 0; i < count; ++i) {
+        char *escaped = toolsEscapeJson(entries[i].text);
+        char *line = escaped ? formatString("  {\"id\":%llu,\"timestamp\":\"%s\",\"memory\":\"%s\",\"score\":%.3f}%s\n",
+                                            (unsigned long long)entries[i].id,
+                                            entries[i].timestamp ? entries[i].timestamp : "",
+                                            escaped, entries[i].score, i + 1 < count ? "," : "") : NULL;
+        free(escaped);
+        if (!line) {
+            free(buffer);
+            memoryStoreFreeEntries(entries, count);
+            if (error_out) *error_out = duplicateString("Out of memory while formatting memories.");
+            return NULL;
+        }
 
-    if (!contents) {
-        return duplicateString("No memories stored yet.");
+        size_t lineLen = strlen(line);
+        if (len + lineLen + 3 > cap) {
+            while (len + lineLen + 3 > cap) {
+                cap *= 2;
+            }
+            char *resized = realloc(buffer, cap);
+            if (!resized) {
+                free(line);
+                free(buffer);
+                memoryStoreFreeEntries(entries, count);
+                if (error_out) *error_out = duplicateString("Out of memory while formatting memories.");
+                return NULL;
+            }
+            buffer = resized;
+        }
+        memcpy(buffer + len, line, lineLen);
+        len += lineLen;
+        free(line);
     }
+    memcpy(buffer + len, "]\n", 3);
 
-    return contents;
+    memoryStoreFreeEntries(entries, count);
+    return buffer;
 }
 
-static int synthesizeSpeechFile(const char *text, const char *requestedName, char **relativeOut, char **commandOutput, char **error_out) {
-    char *trimmedText = duplicateTrimmed(text);
-    if (!trimmedText || !*trimmedText) {
-        if (trimmedText) free(trimmedText);
-        if (error_out) *error_out = duplicateString("Provide text to synthesize.");
+static int copyFile(const char *from, const char *to) {
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        close(in);
         return -1;
     }
 
+    char buffer[65536];
+    ssize_t got;
+    int ret = 0;
+    while ((got = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, (size_t)got) != got) {
+            ret = -1;
+            break;
+        }
+    }
+    if (got < 0) ret = -1;
+    close(in);
+    if (close(out) != 0) ret = -1;
+    return ret;
+}
+
+static int prepareAudioOutput(const char *requestedName, char **relativeOut, char **absoluteOut, char **error_out) {
     char *relative = NULL;
     if (requestedName && *requestedName) {
         relative = duplicateTrimmed(requestedName);
@@ -688,90 +1104,75 @@ static int synthesizeSpeechFile(const char *text, const char *requestedName, cha
     }
 
     if (!relative) {
-        free(trimmedText);
         if (error_out) *error_out = duplicateString("Failed to prepare output filename.");
         return -1;
     }
 
     if (!isSafeRelativePath(relative)) {
         if (error_out) *error_out = formatString("Invalid audio path '%s'. Use a relative path inside ~/.gipwrap.", relative);
-        free(trimmedText);
         free(relative);
         return -1;
     }
 
     char *absolute = joinAiDir(relative, error_out);
     if (!absolute) {
-        free(trimmedText);
         free(relative);
         return -1;
     }
 
     if (ensureParentDirectories(absolute) != 0) {
         if (error_out) *error_out = formatString("Failed to prepare directories for %s: %s", absolute, strerror(errno));
-        free(trimmedText);
         free(relative);
         free(absolute);
         return -1;
     }
 
-    char tmpTemplate[] = "/tmp/gipwrap_tts_XXXXXX";
-    int fd = mkstemp(tmpTemplate);
-    if (fd == -1) {
-        if (error_out) *error_out = duplicateString("Failed to create temporary file for TTS input.");
-        free(trimmedText);
-        free(relative);
-        free(absolute);
+    *relativeOut = relative;
+    *absoluteOut = absolute;
+    return 0;
+}
+
+static int synthesizeSpeechFile(const char *text, const char *requestedName, char **relativeOut, char **commandOutput, char **error_out) {
+    char *trimmedText = duplicateTrimmed(text);
+    if (!trimmedText || !*trimmedText) {
+        if (trimmedText) free(trimmedText);
+        if (error_out) *error_out = duplicateString("Provide text to synthesize.");
         return -1;
     }
 
-    FILE *tmpFile = fdopen(fd, "w");
-    if (!tmpFile) {
-        if (error_out) *error_out = duplicateString("Failed to open temporary file stream for TTS.");
-        close(fd);
-        unlink(tmpTemplate);
+    char *relative = NULL;
+    char *absolute = NULL;
+    if (prepareAudioOutput(requestedName, &relative, &absolute, error_out) != 0) {
         free(trimmedText);
-        free(relative);
-        free(absolute);
         return -1;
     }
 
-    fputs(trimmedText, tmpFile);
-    fclose(tmpFile);
+    char *cachePath = NULL;
+    char *summary = NULL;
+    int ret = speechSynthesizeCached(trimmedText, &cachePath, &summary, error_out);
     free(trimmedText);
-
-    char *command = formatString("text2wave -eval \"(voice_cmu_us_slt_arctic_hts)\" '%s' -o '%s'", tmpTemplate, absolute);
-    if (!command) {
-        if (error_out) *error_out = duplicateString("Failed to construct text-to-speech command.");
-        unlink(tmpTemplate);
+    if (ret != 0) {
         free(relative);
         free(absolute);
         return -1;
     }
 
-    int status = 0;
-    char *cmdOutput = runCommandInAiDir(command, &status, error_out);
-    free(command);
-    unlink(tmpTemplate);
-
-    if (!cmdOutput) {
-        free(relative);
-        free(absolute);
-        return -1;
-    }
-
-    if (access(absolute, F_OK) != 0) {
-        if (error_out) *error_out = formatString("Audio file was not created at %s.", absolute);
-        free(cmdOutput);
+    /* Hard-link the cached WAV into place; copy when linking is not possible. */
+    unlink(absolute);
+    if (link(cachePath, absolute) != 0 && copyFile(cachePath, absolute) != 0) {
+        if (error_out) *error_out = formatString("Failed to write audio to %s: %s", absolute, strerror(errno));
+        free(cachePath);
+        free(summary);
         free(relative);
         free(absolute);
         return -1;
     }
+    free(cachePath);
 
     if (commandOutput) {
-        *commandOutput = cmdOutput;
+        *commandOutput = summary;
     } else {
-        free(cmdOutput);
+        free(summary);
     }
 
     if (relativeOut) {
@@ -842,24 +1243,16 @@ static char* agentToolPlayAudio(const char *argument, char **error_out) {
         return NULL;
     }
 
-    char *command = formatString("mpv --no-video --loop-playlist=0 --speed=1.0 '%s'", relative);
+    char *reply = NULL;
+    int ret = playerEnqueueFile(absolute, 1.0, &reply, error_out);
     free(absolute);
-    if (!command) {
-        if (error_out) *error_out = duplicateString("Failed to build mpv command.");
-        free(relative);
-        return NULL;
-    }
-
-    int status = 0;
-    char *output = runCommandInAiDir(command, &status, error_out);
-    free(command);
-    if (!output) {
+    if (ret != 0) {
         free(relative);
         return NULL;
     }
 
-    char *message = formatString("Playback command executed for %s.\n%s", relative, output);
-    free(output);
+    char *message = formatString("%s: %s", relative, reply);
+    free(reply);
     free(relative);
     if (!message && error_out) {
         *error_out = duplicateString("Failed to build playback result message.");
@@ -867,6 +1260,22 @@ static char* agentToolPlayAudio(const char *argument, char **error_out) {
     return message;
 }
 
+static char* agentToolAudioControl(const char *argument, char **error_out) {
+    char *command = duplicateTrimmed(argument && *argument ? argument : "status");
+    if (!command) {
+        if (error_out) *error_out = duplicateString("Out of memory while parsing playback command.");
+        return NULL;
+    }
+    for (char *p = command; *p; ++p) {
+        *p = (char)tolower((unsigned char)*p);
+    }
+
+    char *reply = NULL;
+    int ret = playerControl(*command ? command : "status", &reply, error_out);
+    free(command);
+    return ret == 0 ? reply : NULL;
+}
+
 static char* agentToolGenerateImage(const char *argument, char **error_out) {
     char *outputName = NULL;
     char *body = NULL;
@@ -958,32 +1367,25 @@ static char* agentToolPlayTts(const char *argument, char **error_out) {
     }
 
     char *relative = NULL;
-    if (synthesizeSpeechFile(text, outputName, &relative, NULL, error_out) != 0) {
-        if (outputName) free(outputName);
+    char *absolute = NULL;
+    int ret = prepareAudioOutput(outputName, &relative, &absolute, error_out);
+    free(outputName);
+    if (ret != 0) {
         free(text);
         return NULL;
     }
 
+    char *reply = NULL;
+    ret = playerEnqueueSpeech(text, 2.0, absolute, &reply, error_out);
     free(text);
-    if (outputName) free(outputName);
-
-    char *command = formatString("mpv --no-video --speed=2.0 '%s'", relative);
-    if (!command) {
-        if (error_out) *error_out = duplicateString("Failed to construct mpv command for TTS playback.");
-        free(relative);
-        return NULL;
-    }
-
-    int status = 0;
-    char *output = runCommandInAiDir(command, &status, error_out);
-    free(command);
-    if (!output) {
+    free(absolute);
+    if (ret != 0) {
         free(relative);
         return NULL;
     }
 
-    char *message = formatString("Generated and played audio at 2x speed from %s.\n%s", relative, output);
-    free(output);
+    char *message = formatString("Speech queued at 2x speed; audio will be saved to %s.\n%s", relative, reply);
+    free(reply);
     free(relative);
     if (!message && error_out) {
         *error_out = duplicateString("Failed to build TTS playback message.");
@@ -991,15 +1393,21 @@ static char* agentToolPlayTts(const char *argument, char **error_out) {
     return message;
 }
 
+/*
+ * Only the read-only tools may start early: a streamed call can still fail or
+ * be repaired after the tool started, and then its result is thrown away.
+ */
 static const AgentTool fileTools[] = {
-    { "readFile", "Read the contents of a UTF-8 text file.", agentToolReadFile },
-    { "listDir", "List files within a directory as newline separated entries.", agentToolListDir },
-    { "saveMemory", "Append a timestamped memory entry to ~/.gipwrap/memory.json.", agentToolSaveMemory },
-    { "getMemories", "Retrieve all stored memory entries from ~/.gipwrap/memory.json.", agentToolGetMemories },
-    { "generateImage", "Use ImageMagick. Optional first line: output=<relative path>. Body: convert arguments or full command.", agentToolGenerateImage },
-    { "generateAudio", "Create speech audio with festival. Optional first line output=<relative path>. Body: text to speak.", agentToolGenerateAudio },
-    { "playAudio", "Play an audio file or directory inside ~/.gipwrap using mpv.", agentToolPlayAudio },
-    { "playTts", "Generate speech and play it immediately at 2x speed. Optional first line output=<relative path>.", agentToolPlayTts }
+    { "readFile", "Read a file slice. Input: a path, or lines path=, offset=/length= (bytes), lines=START-END, max= (default 64k; longer output keeps head and tail). Binary files get a hex preview.", agentToolReadFile, 1 },
+    { "listDir", "List a directory, one entry per line (dirs end in /). Input: a path, or lines path=, depth=N|recursive=1, glob=*.c, max=, all=1 (include hidden/gitignored).", agentToolListDir, 1 },
+    { "searchFiles", "Search file contents under a directory tree (parallel, gitignore-aware). Input: a regex, or lines pattern=, path=, glob=, fixed=1, case=insensitive, max= (default 200). Returns path:line: text.", agentToolSearchFiles, 1 },
+    { "saveMemory", "Append a timestamped memory entry (with an embedding when available) to the ~/.gipwrap memory store.", agentToolSaveMemory, 0 },
+    { "getMemories", "Search stored memories (BM25 + embedding top-k). Input: query text, or lines query=, since=7d|YYYY-MM-DD, until=, mode=hybrid|keyword|semantic, limit= (default 10). Empty input returns the newest.", agentToolGetMemories, 0 },
+    { "generateImage", "Use ImageMagick. Optional first line: output=<relative path>. Body: convert arguments or full command.", agentToolGenerateImage, 0 },
+    { "generateAudio", "Create speech audio with festival (cached by text). Optional first line output=<relative path>. Body: text to speak.", agentToolGenerateAudio, 0 },
+    { "playAudio", "Queue an audio file or directory inside ~/.gipwrap for background playback with mpv; returns immediately.", agentToolPlayAudio, 0 },
+    { "audioControl", "Control background audio playback. Input: status (default), skip or stop.", agentToolAudioControl, 0 },
+    { "playTts", "Queue text to be spoken at 2x speed in the background, sentence by sentence as it is synthesized; returns immediately. Optional first line output=<relative path> for the WAV.", agentToolPlayTts, 0 }
 };
 
 const AgentTool* getAgentTools(size_t *count) {
@@ -0,0 +1,797 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "tools/fileSearch.h"
+
+#define FILE_WALK_MAX_THREADS 8
+#define FILE_WALK_DIRENT_BUFFER 32768
+#define FILE_SEARCH_SNIFF_BYTES 8192
+#define FILE_SEARCH_CHUNK (1024 * 1024)
+#define FILE_SEARCH_MAX_FILE (256u * 1024u * 1024u)
+#define FILE_SEARCH_MAX_LINE 240
+#define FILE_GITIGNORE_MAX (1024 * 1024)
+
+struct linuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct {
+    char *pattern;
+    int negate;
+    int dirOnly;
+    int anchored;
+} IgnoreRule;
+
+/* One .gitignore; rules chain to the enclosing directories' files. */
+typedef struct IgnoreRules {
+    struct IgnoreRules *parent;
+    char *base;
+    IgnoreRule *rules;
+    size_t count;
+    int refs;
+} IgnoreRules;
+
+typedef struct {
+    char *rel;
+    int depth;
+    IgnoreRules *ignore;
+} WalkJob;
+
+typedef struct {
+    char *path;
+    size_t line;
+    char *text;
+} WalkResult;
+
+typedef struct {
+    const FileWalkOptions *options;
+    const FileSearchOptions *search;
+    const char *literal;
+    size_t literalLen;
+    int needsRegex;
+    int rootFd;
+    const char *prefix;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    WalkJob *jobs;
+    size_t jobCount;
+    size_t jobCap;
+    int active;
+    int stop;
+    int failed;
+
+    WalkResult *results;
+    size_t resultCount;
+    size_t resultCap;
+    size_t filesScanned;
+} FileWalker;
+
+typedef struct {
+    FileWalker *walker;
+    regex_t regex;
+    int hasRegex;
+    char *line;
+    size_t lineCap;
+    char *dirents;
+    char *file;
+    size_t fileCap;
+} WalkWorker;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static char* formatString(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0) {
+        return NULL;
+    }
+
+    char *buffer = malloc((size_t)needed + 1);
+    if (!buffer) return NULL;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, (size_t)needed + 1, fmt, args);
+    va_end(args);
+
+    return buffer;
+}
+
+static char* joinRelative(const char *dir, const char *name) {
+    return *dir ? formatString("%s/%s", dir, name) : duplicateString(name);
+}
+
+static void ignoreRetain(IgnoreRules *rules) {
+    if (rules) __atomic_add_fetch(&rules->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void ignoreRelease(IgnoreRules *rules) {
+    while (rules && __atomic_sub_fetch(&rules->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        IgnoreRules *parent = rules->parent;
+        for (size_t i = 0; i < rules->count; ++i) {
+            free(rules->rules[i].pattern);
+        }
+        free(rules->rules);
+        free(rules->base);
+        free(rules);
+        rules = parent;
+    }
+}
+
+static IgnoreRules* loadGitignore(int dirFd, const char *rel, IgnoreRules *parent) {
+    int fd = openat(dirFd, ".gitignore", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    char *text = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size < FILE_GITIGNORE_MAX) {
+        text = malloc((size_t)st.st_size + 1);
+        if (text && pread(fd, text, (size_t)st.st_size, 0) == st.st_size) {
+            text[st.st_size] = '\0';
+        } else {
+            free(text);
+            text = NULL;
+        }
+    }
+    close(fd);
+    if (!text) return NULL;
+
+    IgnoreRules *rules = calloc(1, sizeof(IgnoreRules));
+    size_t cap = 0;
+    char *save = NULL;
+    for (char *line = rules ? strtok_r(text, "\n", &save) : NULL; line; line = strtok_r(NULL, "\n", &save)) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ')) line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+
+        IgnoreRule rule = { 0 };
+        if (line[0] == '!') {
+            rule.negate = 1;
+            line++;
+            len--;
+        }
+        if (len > 0 && line[len - 1] == '/') {
+            rule.dirOnly = 1;
+            line[--len] = '\0';
+        }
+        if (strncmp(line, "**/", 3) == 0 && !strchr(line + 3, '/')) {
+            line += 3;
+        }
+        if (line[0] == '/') {
+            rule.anchored = 1;
+            line++;
+        } else if (strchr(line, '/')) {
+            rule.anchored = 1;
+        }
+        if (!*line) continue;
+
+        if (rules->count == cap) {
+            size_t newCap = cap ? cap * 2 : 16;
+            IgnoreRule *resized = realloc(rules->rules, newCap * sizeof(IgnoreRule));
+            if (!resized) break;
+            rules->rules = resized;
+            cap = newCap;
+        }
+        rule.pattern = duplicateString(line);
+        if (rule.pattern) rules->rules[rules->count++] = rule;
+    }
+    free(text);
+
+    if (!rules || rules->count == 0) {
+        if (rules) free(rules->rules);
+        free(rules);
+        return NULL;
+    }
+    rules->base = duplicateString(rel);
+    rules->refs = 1;
+    rules->parent = parent;
+    ignoreRetain(parent);
+    return rules;
+}
+
+/* The innermost .gitignore decides first, and within a file the last matching rule wins. */
+static int isIgnored(const IgnoreRules *rules, const char *rel, const char *name, int isDir) {
+    for (; rules; rules = rules->parent) {
+        size_t baseLen = strlen(rules->base);
+        const char *local = baseLen ? rel + baseLen + 1 : rel;
+        for (size_t i = rules->count; i-- > 0;) {
+            const IgnoreRule *rule = &rules->rules[i];
+            if (rule->dirOnly && !isDir) continue;
+            int hit = rule->anchored
+                ? fnmatch(rule->pattern, local, FNM_PATHNAME) == 0
+                : fnmatch(rule->pattern, name, 0) == 0;
+            if (hit) return !rule->negate;
+        }
+    }
+    return 0;
+}
+
+static int globMatches(const char *glob, const char *rel, const char *name) {
+    if (!glob || !*glob) return 1;
+    return strchr(glob, '/') ? fnmatch(glob, rel, FNM_PATHNAME) == 0 : fnmatch(glob, name, 0) == 0;
+}
+
+/* Returns 0 if a result was stored, 1 once the cap is reached. */
+static int addResult(FileWalker *walker, char *path, size_t line, char *text) {
+    pthread_mutex_lock(&walker->lock);
+    int full = walker->stop;
+    if (!full && walker->resultCount == walker->resultCap) {
+        size_t newCap = walker->resultCap ? walker->resultCap * 2 : 64;
+        WalkResult *resized = realloc(walker->results, newCap * sizeof(WalkResult));
+        if (resized) {
+            walker->results = resized;
+            walker->resultCap = newCap;
+        } else {
+            walker->failed = 1;
+            __atomic_store_n(&walker->stop, 1, __ATOMIC_RELAXED);
+            full = 1;
+        }
+    }
+    if (!full) {
+        walker->results[walker->resultCount].path = path;
+        walker->results[walker->resultCount].line = line;
+        walker->results[walker->resultCount].text = text;
+        if (++walker->resultCount >= walker->options->maxEntries) {
+            __atomic_store_n(&walker->stop, 1, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&walker->lock);
+
+    if (full) {
+        free(path);
+        free(text);
+    }
+    return full;
+}
+
+static void pushJob(FileWalker *walker, char *rel, int depth, IgnoreRules *ignore) {
+    pthread_mutex_lock(&walker->lock);
+    if (walker->jobCount == walker->jobCap) {
+        size_t newCap = walker->jobCap ? walker->jobCap * 2 : 64;
+        WalkJob *resized = realloc(walker->jobs, newCap * sizeof(WalkJob));
+        if (!resized) {
+            walker->failed = 1;
+            pthread_mutex_unlock(&walker->lock);
+            free(rel);
+            return;
+        }
+        walker->jobs = resized;
+        walker->jobCap = newCap;
+    }
+    ignoreRetain(ignore);
+    walker->jobs[walker->jobCount].rel = rel;
+    walker->jobs[walker->jobCount].depth = depth;
+    walker->jobs[walker->jobCount].ignore = ignore;
+    walker->jobCount++;
+    pthread_cond_signal(&walker->wake);
+    pthread_mutex_unlock(&walker->lock);
+}
+
+static const char* findLiteral(const char *hay, size_t len, const char *needle, size_t needleLen, int ignoreCase) {
+    if (!ignoreCase) return memmem(hay, len, needle, needleLen);
+
+    unsigned char lower = (unsigned char)tolower((unsigned char)needle[0]);
+    unsigned char upper = (unsigned char)toupper((unsigned char)needle[0]);
+    while (len >= needleLen) {
+        size_t window = len - needleLen + 1;
+        const char *a = memchr(hay, lower, window);
+        const char *b = upper != lower ? memchr(hay, upper, a ? (size_t)(a - hay) : window) : NULL;
+        const char *hit = b ? b : a;
+        if (!hit) return NULL;
+        if (strncasecmp(hit, needle, needleLen) == 0) return hit;
+        len -= (size_t)(hit - hay) + 1;
+        hay = hit + 1;
+    }
+    return NULL;
+}
+
+/*
+ * Picks the longest run of characters every match of an ERE must contain, so
+ * whole files and most lines are rejected by memmem before regexec runs.
+ * Alternation or grouping anywhere disables the prefilter.
+ */
+static size_t requiredLiteral(const char *pattern, char *out, size_t outCap) {
+    char run[256];
+    size_t runLen = 0;
+    size_t bestLen = 0;
+    out[0] = '\0';
+
+    for (const char *p = pattern; ; ++p) {
+        char c = *p;
+        int literal = 0;
+        int brk = 0;
+        if (c == '\0') {
+            brk = 1;
+        } else if (c == '|' || c == '(' || c == ')') {
+            out[0] = '\0';
+            return 0;
+        } else if (c == '\\' && p[1] && ispunct((unsigned char)p[1]) && !strchr("<>`'", p[1])) {
+            c = *++p;
+            literal = 1;
+        } else if (c == '\\') {
+            /* Classes like \w and the GNU anchors \< \> \` \' match no fixed text. */
+            if (p[1]) p++;
+            brk = 1;
+        } else if (c == '[') {
+            p++;
+            if (*p == '^') p++;
+            if (*p == ']') p++;
+            while (*p && *p != ']') p++;
+            if (!*p) p--;
+            brk = 1;
+        } else if (c == '*' || c == '?' || c == '{') {
+            /* The quantified character is optional; an interval {m,n} is skipped whole. */
+            if (runLen > 0) runLen--;
+            if (c == '{') {
+                while (p[1] && p[1] != '}') p++;
+                if (p[1]) p++;
+            }
+            brk = 1;
+        } else if (c == '+' || c == '.' || c == '^' || c == '$') {
+            brk = 1;
+        } else {
+            literal = 1;
+        }
+
+        if (literal && runLen + 1 < sizeof(run)) {
+            run[runLen++] = c;
+        } else {
+            brk = 1;
+        }
+
+        if (brk) {
+            if (runLen > bestLen && runLen < outCap) {
+                memcpy(out, run, runLen);
+                out[runLen] = '\0';
+                bestLen = runLen;
+            }
+            runLen = 0;
+            if (c == '\0') break;
+            if (literal) run[runLen++] = c;
+        }
+    }
+    return bestLen;
+}
+
+static int isFixedPattern(const char *pattern) {
+    return strpbrk(pattern, ".[]()*+?{}|^$\\") == NULL;
+}
+
+/*
+ * Matches the whole lines in data[0, size), the first of which is line
+ * lineNo. Returns the line number after the buffer, or 0 once the search
+ * should stop.
+ */
+static size_t searchLines(WalkWorker *worker, const char *rel, const char *data, size_t size, size_t lineNo) {
+    FileWalker *walker = worker->walker;
+    const char *end = data + size;
+    const char *pos = data;
+    const char *counted = data;
+    while (pos < end && !__atomic_load_n(&walker->stop, __ATOMIC_RELAXED)) {
+        const char *lineStart = pos;
+        if (walker->literalLen) {
+            const char *hit = findLiteral(pos, (size_t)(end - pos), walker->literal, walker->literalLen, walker->search->ignoreCase);
+            if (!hit) break;
+            const char *nl = memrchr(pos, '\n', (size_t)(hit - pos));
+            lineStart = nl ? nl + 1 : pos;
+        }
+        const char *lineEnd = memchr(lineStart, '\n', (size_t)(end - lineStart));
+        if (!lineEnd) lineEnd = end;
+
+        const char *nl;
+        while ((nl = memchr(counted, '\n', (size_t)(lineStart - counted))) != NULL) {
+            lineNo++;
+            counted = nl + 1;
+        }
+
+        size_t lineLen = (size_t)(lineEnd - lineStart);
+        if (lineLen > 0 && lineStart[lineLen - 1] == '\r') lineLen--;
+        int matched = 1;
+        if (worker->hasRegex) {
+            if (lineLen + 1 > worker->lineCap) {
+                size_t newCap = lineLen + 1 > 256 ? lineLen + 1 : 256;
+                char *resized = realloc(worker->line, newCap);
+                if (!resized) return 0;
+                worker->line = resized;
+                worker->lineCap = newCap;
+            }
+            memcpy(worker->line, lineStart, lineLen);
+            worker->line[lineLen] = '\0';
+            matched = regexec(&worker->regex, worker->line, 0, NULL, 0) == 0;
+        }
+
+        if (matched) {
+            size_t shown = lineLen > FILE_SEARCH_MAX_LINE ? FILE_SEARCH_MAX_LINE : lineLen;
+            char *text = formatString("%.*s%s", (int)shown, lineStart, shown < lineLen ? " ..." : "");
+            char *path = formatString("%s%s", walker->prefix, rel);
+            if (!text || !path) {
+                free(text);
+                free(path);
+                return 0;
+            }
+            if (addResult(walker, path, lineNo, text)) return 0;
+        }
+        pos = lineEnd + 1;
+    }
+    if (__atomic_load_n(&walker->stop, __ATOMIC_RELAXED)) return 0;
+
+    const char *nl;
+    while ((nl = memchr(counted, '\n', (size_t)(end - counted))) != NULL) {
+        lineNo++;
+        counted = nl + 1;
+    }
+    return lineNo;
+}
+
+/*
+ * Reads the file in FILE_SEARCH_CHUNK preads into the worker's buffer and
+ * searches the whole lines of each chunk, carrying a partial last line over.
+ * Nothing is mapped, so a log rotated or truncated mid-search just ends early
+ * instead of raising SIGBUS.
+ */
+static void searchFile(WalkWorker *worker, int dirFd, const char *name, const char *rel) {
+    FileWalker *walker = worker->walker;
+    int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || (uint64_t)st.st_size > FILE_SEARCH_MAX_FILE) {
+        close(fd);
+        return;
+    }
+    if (!worker->file) {
+        worker->file = malloc(FILE_SEARCH_CHUNK);
+        worker->fileCap = worker->file ? FILE_SEARCH_CHUNK : 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    size_t offset = 0;
+    size_t have = 0;
+    size_t lineNo = 1;
+    int first = 1;
+    while (worker->file && lineNo) {
+        if (have == worker->fileCap) {
+            /* One line fills the buffer: grow it rather than split the line. */
+            char *resized = realloc(worker->file, worker->fileCap * 2);
+            if (!resized) break;
+            worker->file = resized;
+            worker->fileCap *= 2;
+        }
+        size_t want = worker->fileCap - have;
+        if (want > size - offset) want = size - offset;
+        ssize_t got = want ? pread(fd, worker->file + have, want, (off_t)offset) : 0;
+        if (got < 0 && errno == EINTR) continue;
+        int eof = got <= 0 || offset + (size_t)got >= size;
+        if (got > 0) {
+            offset += (size_t)got;
+            have += (size_t)got;
+        }
+        if (have == 0) break;
+
+        if (first) {
+            first = 0;
+            if (memchr(worker->file, '\0', have < FILE_SEARCH_SNIFF_BYTES ? have : FILE_SEARCH_SNIFF_BYTES)) break;
+            __atomic_add_fetch(&walker->filesScanned, 1, __ATOMIC_RELAXED);
+        }
+
+        const char *lastNl = eof ? NULL : memrchr(worker->file, '\n', have);
+        if (!eof && !lastNl) continue;
+        size_t whole = eof ? have : (size_t)(lastNl - worker->file) + 1;
+        lineNo = searchLines(worker, rel, worker->file, whole, lineNo);
+        if (eof) break;
+        memmove(worker->file, worker->file + whole, have - whole);
+        have -= whole;
+    }
+    close(fd);
+    if (worker->fileCap > FILE_SEARCH_CHUNK) {
+        free(worker->file);
+        worker->file = NULL;
+        worker->fileCap = 0;
+    }
+}
+
+static void walkDirectory(WalkWorker *worker, const WalkJob *job) {
+    FileWalker *walker = worker->walker;
+    const FileWalkOptions *options = walker->options;
+    int dirFd = openat(walker->rootFd, *job->rel ? job->rel : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) return;
+
+    IgnoreRules *ignore = options->filtered ? loadGitignore(dirFd, job->rel, job->ignore) : NULL;
+    if (!ignore) {
+        ignore = job->ignore;
+        ignoreRetain(ignore);
+    }
+
+    int childDepth = job->depth + 1;
+    for (;;) {
+        long read = syscall(SYS_getdents64, dirFd, worker->dirents, FILE_WALK_DIRENT_BUFFER);
+        if (read <= 0) break;
+
+        for (long off = 0; off < read;) {
+            struct linuxDirent64 *entry = (struct linuxDirent64 *)(void *)(worker->dirents + off);
+            off += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+            if (options->filtered && name[0] == '.') continue;
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+            }
+            int isDir = type == DT_DIR;
+
+            char *rel = joinRelative(job->rel, name);
+            if (!rel) continue;
+            if (ignore && isIgnored(ignore, rel, name, isDir)) {
+                free(rel);
+                continue;
+            }
+
+            if (!walker->search && globMatches(options->glob, rel, name) && (!isDir || !options->glob)) {
+                char *path = formatString("%s%s%s", walker->prefix, rel, isDir ? "/" : type == DT_LNK ? "@" : "");
+                if (!path || addResult(walker, path, 0, NULL)) {
+                    free(rel);
+                    break;
+                }
+            } else if (walker->search && type == DT_REG && globMatches(options->glob, rel, name)) {
+                searchFile(worker, dirFd, name, rel);
+            }
+
+            if (isDir && (options->maxDepth <= 0 || childDepth < options->maxDepth)) {
+                pushJob(walker, rel, childDepth, ignore);
+            } else {
+                free(rel);
+            }
+            if (__atomic_load_n(&walker->stop, __ATOMIC_RELAXED)) break;
+        }
+        if (__atomic_load_n(&walker->stop, __ATOMIC_RELAXED)) break;
+    }
+
+    ignoreRelease(ignore);
+    close(dirFd);
+}
+
+static void* walkWorkerMain(void *arg) {
+    WalkWorker *worker = arg;
+    FileWalker *walker = worker->walker;
+    for (;;) {
+        pthread_mutex_lock(&walker->lock);
+        while (walker->jobCount == 0 && walker->active > 0 && !walker->stop) {
+            pthread_cond_wait(&walker->wake, &walker->lock);
+        }
+        if (walker->jobCount == 0 || walker->stop) {
+            pthread_cond_broadcast(&walker->wake);
+            pthread_mutex_unlock(&walker->lock);
+            break;
+        }
+        WalkJob job = walker->jobs[--walker->jobCount];
+        walker->active++;
+        pthread_mutex_unlock(&walker->lock);
+
+        walkDirectory(worker, &job);
+        free(job.rel);
+        ignoreRelease(job.ignore);
+
+        pthread_mutex_lock(&walker->lock);
+        walker->active--;
+        if (walker->active == 0 && walker->jobCount == 0) {
+            pthread_cond_broadcast(&walker->wake);
+        }
+        pthread_mutex_unlock(&walker->lock);
+    }
+    return NULL;
+}
+
+static int compareResults(const void *a, const void *b) {
+    const WalkResult *left = a;
+    const WalkResult *right = b;
+    int cmp = strcmp(left->path, right->path);
+    if (cmp != 0) return cmp;
+    return left->line < right->line ? -1 : left->line > right->line;
+}
+
+static int workerCount(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus > FILE_WALK_MAX_THREADS ? FILE_WALK_MAX_THREADS : (int)cpus;
+}
+
+static int runWalk(FileWalker *walker, char **error_out) {
+    const char *root = walker->options->root && *walker->options->root ? walker->options->root : ".";
+    walker->rootFd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walker->rootFd < 0) {
+        if (error_out) *error_out = formatString("Failed to open directory '%s': %s", root, strerror(errno));
+        return -1;
+    }
+
+    size_t rootLen = strlen(root);
+    while (rootLen > 1 && root[rootLen - 1] == '/') rootLen--;
+    char *prefix = strcmp(root, ".") == 0 ? duplicateString("")
+                 : formatString("%.*s%s", (int)rootLen, root, root[rootLen - 1] == '/' ? "" : "/");
+    walker->prefix = prefix;
+    pthread_mutex_init(&walker->lock, NULL);
+    pthread_cond_init(&walker->wake, NULL);
+    pushJob(walker, duplicateString(""), 0, NULL);
+
+    int threads = workerCount();
+    WalkWorker workers[FILE_WALK_MAX_THREADS];
+    pthread_t ids[FILE_WALK_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < threads; ++i) {
+        WalkWorker *worker = &workers[i];
+        memset(worker, 0, sizeof(*worker));
+        worker->walker = walker;
+        worker->dirents = malloc(FILE_WALK_DIRENT_BUFFER);
+        if (walker->needsRegex) {
+            /* One compiled regex per thread: glibc serializes regexec on a shared regex_t. */
+            int flags = REG_EXTENDED | REG_NOSUB | (walker->search->ignoreCase ? REG_ICASE : 0);
+            worker->hasRegex = regcomp(&worker->regex, walker->search->pattern, flags) == 0;
+        }
+        if (!worker->dirents || (walker->needsRegex && !worker->hasRegex)) {
+            free(worker->dirents);
+            if (worker->hasRegex) regfree(&worker->regex);
+            break;
+        }
+        if (i == 0 || pthread_create(&ids[i], NULL, walkWorkerMain, worker) == 0) {
+            started++;
+        } else {
+            free(worker->dirents);
+            if (worker->hasRegex) regfree(&worker->regex);
+            break;
+        }
+    }
+    if (started > 0) {
+        walkWorkerMain(&workers[0]);
+    }
+    for (int i = 0; i < started; ++i) {
+        if (i > 0) pthread_join(ids[i], NULL);
+        free(workers[i].dirents);
+        free(workers[i].line);
+        free(workers[i].file);
+        if (workers[i].hasRegex) regfree(&workers[i].regex);
+    }
+
+    for (size_t i = 0; i < walker->jobCount; ++i) {
+        free(walker->jobs[i].rel);
+        ignoreRelease(walker->jobs[i].ignore);
+    }
+    free(walker->jobs);
+    pthread_cond_destroy(&walker->wake);
+    pthread_mutex_destroy(&walker->lock);
+    close(walker->rootFd);
+    free(prefix);
+    walker->prefix = NULL;
+
+    if (started == 0 || walker->failed) {
+        if (error_out) *error_out = duplicateString("Out of memory while walking the directory tree.");
+        return -1;
+    }
+    qsort(walker->results, walker->resultCount, sizeof(WalkResult), compareResults);
+    return 0;
+}
+
+static void freeResults(FileWalker *walker) {
+    for (size_t i = 0; i < walker->resultCount; ++i) {
+        free(walker->results[i].path);
+        free(walker->results[i].text);
+    }
+    free(walker->results);
+}
+
+static char* renderResults(FileWalker *walker, const char *emptyMessage, const char *truncatedFmt) {
+    size_t total = 1;
+    for (size_t i = 0; i < walker->resultCount; ++i) {
+        total += strlen(walker->results[i].path) + 24 + (walker->results[i].text ? strlen(walker->results[i].text) : 0);
+    }
+    char *footer = walker->stop ? formatString(truncatedFmt, walker->resultCount) : NULL;
+    if (footer) total += strlen(footer);
+
+    char *out = malloc(total + strlen(emptyMessage));
+    if (!out) {
+        free(footer);
+        return NULL;
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < walker->resultCount; ++i) {
+        const WalkResult *result = &walker->results[i];
+        len += result->text
+            ? (size_t)sprintf(out + len, "%s:%zu: %s\n", result->path, result->line, result->text)
+            : (size_t)sprintf(out + len, "%s\n", result->path);
+    }
+    if (len == 0) {
+        len += (size_t)sprintf(out, "%s", emptyMessage);
+    }
+    if (footer) {
+        len += (size_t)sprintf(out + len, "%s", footer);
+        free(footer);
+    }
+    out[len] = '\0';
+    return out;
+}
+
+char* fileWalkList(const FileWalkOptions *options, char **error_out) {
+    FileWalker walker;
+    memset(&walker, 0, sizeof(walker));
+    walker.options = options;
+    if (runWalk(&walker, error_out) != 0) {
+        freeResults(&walker);
+        return NULL;
+    }
+
+    char *out = renderResults(&walker, "(empty directory)\n", "[listing stopped at %zu entries; narrow it with depth= or glob=]\n");
+    freeResults(&walker);
+    if (!out && error_out) *error_out = duplicateString("Out of memory while finalizing directory listing.");
+    return out;
+}
+
+char* fileSearchRun(const FileSearchOptions *options, char **error_out) {
+    if (!options->pattern || !*options->pattern) {
+        if (error_out) *error_out = duplicateString("searchFiles requires a pattern.");
+        return NULL;
+    }
+
+    char literal[256];
+    FileWalker walker;
+    memset(&walker, 0, sizeof(walker));
+    walker.options = &options->walk;
+    walker.search = options;
+    if (options->fixedString || isFixedPattern(options->pattern)) {
+        walker.literal = options->pattern;
+        walker.literalLen = strlen(options->pattern);
+    } else {
+        regex_t probe;
+        int status = regcomp(&probe, options->pattern, REG_EXTENDED | REG_NOSUB);
+        if (status != 0) {
+            char message[256];
+            regerror(status, &probe, message, sizeof(message));
+            if (error_out) *error_out = formatString("Invalid pattern '%s': %s", options->pattern, message);
+            return NULL;
+        }
+        regfree(&probe);
+        walker.needsRegex = 1;
+        walker.literalLen = requiredLiteral(options->pattern, literal, sizeof(literal));
+        walker.literal = literal;
+    }
+
+    if (runWalk(&walker, error_out) != 0) {
+        freeResults(&walker);
+        return NULL;
+    }
+
+    char *empty = formatString("No matches in %zu files.\n", walker.filesScanned);
+    char *out = renderResults(&walker, empty ? empty : "No matches.\n", "[stopped after %zu matches; narrow the pattern, path= or glob=]\n");
+    free(empty);
+    freeResults(&walker);
+    if (!out && error_out) *error_out = duplicateString("Out of memory while formatting search results.");
+    return out;
+}
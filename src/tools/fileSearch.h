@@ -0,0 +1,30 @@
+#ifndef TOOLS_FILE_SEARCH_H
+#define TOOLS_FILE_SEARCH_H
+
+#include <stddef.h>
+
+/*
+ * Directory walks run on a small pthread pool: each worker pops a directory,
+ * reads it with getdents64 (using d_type to avoid a stat per entry) and pushes
+ * subdirectories back onto the shared queue. Output is sorted, so it does not
+ * depend on scheduling unless the entry or match cap is hit.
+ */
+typedef struct {
+    const char *root;
+    const char *glob;      /* fnmatch on the file name, or the relative path if it contains '/' */
+    int maxDepth;          /* 1 lists only the root's entries; 0 is unlimited */
+    int filtered;          /* skip hidden entries, .git and paths matched by .gitignore files */
+    size_t maxEntries;
+} FileWalkOptions;
+
+typedef struct {
+    FileWalkOptions walk;
+    const char *pattern;   /* POSIX extended regex unless fixedString */
+    int fixedString;
+    int ignoreCase;
+} FileSearchOptions;
+
+char* fileWalkList(const FileWalkOptions *options, char **error_out);
+char* fileSearchRun(const FileSearchOptions *options, char **error_out);
+
+#endif
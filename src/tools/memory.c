@@ -0,0 +1,922 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "ai_core/core.h"
+#include "tools/memory.h"
+#include "tools/memoryIndex.h"
+#include "tools/memoryVector.h"
+
+/* Past this many bytes of un-compacted log, the next save forks a compaction. */
+#define MEMORY_COMPACT_BYTES (256 * 1024)
+#define MEMORY_QUERY_TERMS 32
+/* Each ranking contributes this many candidates per requested result before fusion. */
+#define MEMORY_FUSION_POOL 3
+#define MEMORY_RRF_K 60.0
+
+typedef enum {
+    MEMORY_FSYNC_ALWAYS,
+    MEMORY_FSYNC_COMPACT,
+    MEMORY_FSYNC_NEVER
+} MemoryFsyncPolicy;
+
+typedef struct {
+    char *logPath;
+    char *snapshotPath;
+    char *lockPath;
+    char *legacyPath;
+    char *indexPath;
+    char *vecPath;
+} MemoryPaths;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static char* formatString(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0) {
+        return NULL;
+    }
+
+    char *buffer = malloc((size_t)needed + 1);
+    if (!buffer) return NULL;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, (size_t)needed + 1, fmt, args);
+    va_end(args);
+
+    return buffer;
+}
+
+/* GIPWRAP_MEMORY_FSYNC=always|compact|never; always syncs every save, compact only snapshots. */
+static MemoryFsyncPolicy memoryFsyncPolicy(void) {
+    const char *value = getenv("GIPWRAP_MEMORY_FSYNC");
+    if (value && strcmp(value, "never") == 0) return MEMORY_FSYNC_NEVER;
+    if (value && strcmp(value, "compact") == 0) return MEMORY_FSYNC_COMPACT;
+    return MEMORY_FSYNC_ALWAYS;
+}
+
+static void freeMemoryPaths(MemoryPaths *paths) {
+    free(paths->logPath);
+    free(paths->snapshotPath);
+    free(paths->lockPath);
+    free(paths->legacyPath);
+    free(paths->indexPath);
+    free(paths->vecPath);
+    memset(paths, 0, sizeof(*paths));
+}
+
+static int resolveMemoryPaths(MemoryPaths *paths, char **error_out) {
+    memset(paths, 0, sizeof(*paths));
+    char *aiDir = get_ai_dir(NULL);
+    if (!aiDir) {
+        if (error_out) *error_out = formatString("Failed to prepare ~/.gipwrap: %s", strerror(errno));
+        return -1;
+    }
+
+    paths->logPath = formatString("%s/memory.log", aiDir);
+    paths->snapshotPath = formatString("%s/memory.snapshot", aiDir);
+    paths->lockPath = formatString("%s/memory.lock", aiDir);
+    paths->legacyPath = formatString("%s/memory.json", aiDir);
+    paths->indexPath = formatString("%s/memory.bm25", aiDir);
+    paths->vecPath = formatString("%s/memory.vec", aiDir);
+    free(aiDir);
+
+    if (!paths->logPath || !paths->snapshotPath || !paths->lockPath || !paths->legacyPath || !paths->indexPath || !paths->vecPath) {
+        freeMemoryPaths(paths);
+        if (error_out) *error_out = duplicateString("Failed to build memory store paths.");
+        return -1;
+    }
+    return 0;
+}
+
+static int lockMemoryStore(const MemoryPaths *paths, int operation) {
+    int fd = open(paths->lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    while (flock(fd, operation) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static void unlockMemoryStore(int lockFd) {
+    flock(lockFd, LOCK_UN);
+    close(lockFd);
+}
+
+static int writeFull(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static char* readWholeFile(const char *path, size_t *lenOut) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char *buf = malloc(len + 1);
+    if (!buf) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, buf + got, len - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+
+    buf[got] = '\0';
+    if (lenOut) *lenOut = got;
+    return buf;
+}
+
+static int parseUintField(const char *line, const char *key, uint64_t *value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *pos = strstr(line, pattern);
+    if (!pos) return -1;
+    char *end = NULL;
+    unsigned long long parsed = strtoull(pos + strlen(pattern), &end, 10);
+    if (end == pos + strlen(pattern)) return -1;
+    *value = (uint64_t)parsed;
+    return 0;
+}
+
+/* Offset just past the last '\n' strictly before end, scanning backwards in blocks. */
+static off_t findLineStart(int fd, off_t end) {
+    char block[4096];
+    off_t pos = end;
+    while (pos > 0) {
+        size_t want = pos < (off_t)sizeof(block) ? (size_t)pos : sizeof(block);
+        off_t blockStart = pos - (off_t)want;
+        if (pread(fd, block, want, blockStart) != (ssize_t)want) return -1;
+        for (size_t i = want; i > 0; --i) {
+            if (block[i - 1] == '\n') {
+                return blockStart + (off_t)i;
+            }
+        }
+        pos = blockStart;
+    }
+    return 0;
+}
+
+/* Drops a partially written last line left by a crash mid-append; returns the log size. */
+static off_t repairLogTail(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    if (st.st_size == 0) return 0;
+
+    char last = 0;
+    if (pread(fd, &last, 1, st.st_size - 1) != 1) return -1;
+    if (last == '\n') return st.st_size;
+
+    off_t start = findLineStart(fd, st.st_size);
+    if (start < 0 || ftruncate(fd, start) != 0) return -1;
+    return start;
+}
+
+static uint64_t snapshotLastId(const char *snapshotPath) {
+    FILE *f = fopen(snapshotPath, "r");
+    if (!f) return 0;
+    char header[256];
+    uint64_t lastId = 0;
+    if (fgets(header, sizeof(header), f)) {
+        parseUintField(header, "lastId", &lastId);
+    }
+    fclose(f);
+    return lastId;
+}
+
+static uint64_t lastRecordId(int logFd, off_t logSize, const char *snapshotPath) {
+    uint64_t lastId = snapshotLastId(snapshotPath);
+    if (logSize <= 0) return lastId;
+
+    off_t start = findLineStart(logFd, logSize - 1);
+    char prefix[64];
+    ssize_t n = start >= 0 ? pread(logFd, prefix, sizeof(prefix) - 1, start) : -1;
+    if (n <= 0) return lastId;
+    prefix[n] = '\0';
+
+    uint64_t id = 0;
+    if (parseUintField(prefix, "id", &id) == 0 && id > lastId) {
+        lastId = id;
+    }
+    return lastId;
+}
+
+static void currentTimestamp(char *buffer, size_t size, int64_t *epochOut) {
+    time_t now = time(NULL);
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    if (strftime(buffer, size, "%Y-%m-%dT%H:%M:%S%z", &tm_now) == 0) {
+        snprintf(buffer, size, "%ld", (long)now);
+    }
+    *epochOut = (int64_t)now;
+}
+
+/* Raw (still escaped) JSON string value for key, so it can be copied into a new line verbatim. */
+static char* findRawJsonString(const char *json, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *pos = strstr(json, pattern);
+    if (!pos) return NULL;
+    pos = strchr(pos + strlen(pattern), '"');
+    if (!pos) return NULL;
+    const char *start = ++pos;
+    while (*pos && *pos != '"') {
+        if (*pos == '\\' && *(pos + 1)) pos++;
+        pos++;
+    }
+    size_t len = (size_t)(pos - start);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, start, len);
+    out[len] = '\0';
+    return out;
+}
+
+/* One-time import of the old rewrite-in-place memory.json, under the exclusive lock. */
+static void migrateLegacyMemory(const MemoryPaths *paths, int logFd) {
+    struct stat st;
+    if (fstat(logFd, &st) != 0 || st.st_size != 0) return;
+    if (access(paths->snapshotPath, F_OK) == 0) return;
+
+    char *legacy = readWholeFile(paths->legacyPath, NULL);
+    if (!legacy) return;
+
+    uint64_t id = 0;
+    char *line = legacy;
+    while (line && *line) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        char *timestamp = findRawJsonString(line, "timestamp");
+        char *memory = findRawJsonString(line, "memory");
+        if (timestamp && memory) {
+            struct tm tm_entry;
+            memset(&tm_entry, 0, sizeof(tm_entry));
+            int64_t epoch = strptime(timestamp, "%Y-%m-%dT%H:%M:%S", &tm_entry) ? (int64_t)mktime(&tm_entry) : 0;
+            char *record = formatString("{\"id\":%llu,\"epoch\":%lld,\"timestamp\":\"%s\",\"memory\":\"%s\"}\n",
+                                        (unsigned long long)++id, (long long)epoch, timestamp, memory);
+            if (record) {
+                writeFull(logFd, record, strlen(record));
+                free(record);
+            }
+        }
+        free(timestamp);
+        free(memory);
+        line = next;
+    }
+    free(legacy);
+
+    if (fsync(logFd) == 0) {
+        char *migrated = formatString("%s.migrated", paths->legacyPath);
+        if (migrated) {
+            rename(paths->legacyPath, migrated);
+            free(migrated);
+        }
+    }
+}
+
+/* Folds memory.log into memory.snapshot: write tmp, fsync, rename, then truncate the log. */
+static int compactMemoryStore(const MemoryPaths *paths) {
+    int lockFd = lockMemoryStore(paths, LOCK_EX);
+    if (lockFd < 0) return -1;
+
+    int ret = -1;
+    size_t snapshotLen = 0;
+    size_t logLen = 0;
+    char *snapshot = readWholeFile(paths->snapshotPath, &snapshotLen);
+    char *log = readWholeFile(paths->logPath, &logLen);
+    char *tmpPath = formatString("%s.tmp", paths->snapshotPath);
+    int out = -1;
+    if (!log || !tmpPath) goto done;
+
+    uint64_t lastId = 0;
+    const char *snapshotBody = "";
+    if (snapshot) {
+        char *headerEnd = strchr(snapshot, '\n');
+        parseUintField(snapshot, "lastId", &lastId);
+        snapshotBody = headerEnd ? headerEnd + 1 : "";
+    }
+
+    uint64_t newLastId = lastId;
+    for (char *line = log; *line;) {
+        char *next = strchr(line, '\n');
+        if (!next) break;
+        uint64_t id = 0;
+        if (parseUintField(line, "id", &id) == 0 && id > newLastId) {
+            newLastId = id;
+        }
+        line = next + 1;
+    }
+
+    out = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out < 0) goto done;
+
+    char header[128];
+    int headerLen = snprintf(header, sizeof(header), "{\"snapshot\":1,\"lastId\":%llu}\n", (unsigned long long)newLastId);
+    if (writeFull(out, header, (size_t)headerLen) != 0) goto done;
+    if (writeFull(out, snapshotBody, strlen(snapshotBody)) != 0) goto done;
+
+    for (char *line = log; *line;) {
+        char *next = strchr(line, '\n');
+        if (!next) break;
+        uint64_t id = 0;
+        if (parseUintField(line, "id", &id) == 0 && id > lastId) {
+            if (writeFull(out, line, (size_t)(next - line) + 1) != 0) goto done;
+        }
+        line = next + 1;
+    }
+
+    if (memoryFsyncPolicy() != MEMORY_FSYNC_NEVER && fsync(out) != 0) goto done;
+    if (rename(tmpPath, paths->snapshotPath) != 0) goto done;
+    if (memoryIndexBuild(paths->snapshotPath, paths->indexPath) != 0) {
+        /* Searches notice the stale lastId and fall back to scanning the snapshot. */
+        unlink(paths->indexPath);
+    }
+    /* A crash here leaves compacted lines in the log; readers skip them via lastId. */
+    if (truncate(paths->logPath, 0) != 0) goto done;
+    ret = 0;
+
+done:
+    if (out >= 0) close(out);
+    if (ret != 0 && tmpPath) unlink(tmpPath);
+    free(tmpPath);
+    free(snapshot);
+    free(log);
+    unlockMemoryStore(lockFd);
+    return ret;
+}
+
+/* Double fork so the compaction outlives a short agent run without leaving a zombie. */
+static void compactInBackground(const MemoryPaths *paths) {
+    fflush(NULL);
+    pid_t child = fork();
+    if (child < 0) return;
+    if (child == 0) {
+        if (fork() == 0) {
+            setsid();
+            _exit(compactMemoryStore(paths) == 0 ? 0 : 1);
+        }
+        _exit(0);
+    }
+    waitpid(child, NULL, 0);
+}
+
+int memoryStoreAppend(const char *escapedText, uint64_t *idOut, int64_t *epochOut, char **error_out) {
+    MemoryPaths paths;
+    if (resolveMemoryPaths(&paths, error_out) != 0) {
+        return -1;
+    }
+
+    int lockFd = lockMemoryStore(&paths, LOCK_EX);
+    if (lockFd < 0) {
+        if (error_out) *error_out = formatString("Failed to lock memory store: %s", strerror(errno));
+        freeMemoryPaths(&paths);
+        return -1;
+    }
+
+    int ret = -1;
+    char *record = NULL;
+    int logFd = open(paths.logPath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (logFd < 0) {
+        if (error_out) *error_out = formatString("Failed to open %s: %s", paths.logPath, strerror(errno));
+        goto done;
+    }
+
+    migrateLegacyMemory(&paths, logFd);
+
+    off_t logSize = repairLogTail(logFd);
+    if (logSize < 0) {
+        if (error_out) *error_out = formatString("Failed to read %s: %s", paths.logPath, strerror(errno));
+        goto done;
+    }
+
+    uint64_t id = lastRecordId(logFd, logSize, paths.snapshotPath) + 1;
+    char timestamp[64];
+    int64_t epoch = 0;
+    currentTimestamp(timestamp, sizeof(timestamp), &epoch);
+
+    record = formatString("{\"id\":%llu,\"epoch\":%lld,\"timestamp\":\"%s\",\"memory\":\"%s\"}\n",
+                          (unsigned long long)id, (long long)epoch, timestamp, escapedText);
+    if (!record) {
+        if (error_out) *error_out = duplicateString("Failed to format memory entry.");
+        goto done;
+    }
+
+    size_t recordLen = strlen(record);
+    if (writeFull(logFd, record, recordLen) != 0) {
+        if (error_out) *error_out = formatString("Failed to append to %s: %s", paths.logPath, strerror(errno));
+        goto done;
+    }
+    if (memoryFsyncPolicy() == MEMORY_FSYNC_ALWAYS && fdatasync(logFd) != 0) {
+        if (error_out) *error_out = formatString("Failed to sync %s: %s", paths.logPath, strerror(errno));
+        goto done;
+    }
+
+    if (idOut) *idOut = id;
+    if (epochOut) *epochOut = epoch;
+    ret = 0;
+
+    if (logSize + (off_t)recordLen > MEMORY_COMPACT_BYTES) {
+        unlockMemoryStore(lockFd);
+        lockFd = -1;
+        compactInBackground(&paths);
+    }
+
+done:
+    if (logFd >= 0) close(logFd);
+    if (lockFd >= 0) unlockMemoryStore(lockFd);
+    free(record);
+    freeMemoryPaths(&paths);
+    return ret;
+}
+
+int memoryStoreAttachEmbedding(uint64_t id, int64_t epoch, float *vector, uint32_t dim, char **error_out) {
+    MemoryPaths paths;
+    if (resolveMemoryPaths(&paths, error_out) != 0) {
+        return -1;
+    }
+
+    int lockFd = lockMemoryStore(&paths, LOCK_EX);
+    if (lockFd < 0) {
+        if (error_out) *error_out = formatString("Failed to lock memory store: %s", strerror(errno));
+        freeMemoryPaths(&paths);
+        return -1;
+    }
+
+    int ret = memoryVectorAppend(paths.vecPath, id, epoch, vector, dim, error_out);
+    unlockMemoryStore(lockFd);
+    freeMemoryPaths(&paths);
+    return ret;
+}
+
+static int parseEntryLine(const char *line, MemoryEntry *entry) {
+    memset(entry, 0, sizeof(*entry));
+    uint64_t epoch = 0;
+    if (parseUintField(line, "id", &entry->id) != 0) return -1;
+    if (parseUintField(line, "epoch", &epoch) == 0) entry->epoch = (int64_t)epoch;
+    entry->timestamp = find_json_string(line, "timestamp");
+    entry->text = find_json_string(line, "memory");
+    if (!entry->text) {
+        free(entry->timestamp);
+        return -1;
+    }
+    return 0;
+}
+
+static int appendEntriesFromBuffer(char *buffer, uint64_t minId, MemoryEntry **entries, size_t *count, size_t *cap) {
+    for (char *line = buffer; line && *line;) {
+        char *next = strchr(line, '\n');
+        if (!next) break;
+        *next = '\0';
+
+        MemoryEntry entry;
+        if (parseEntryLine(line, &entry) == 0) {
+            if (entry.id <= minId) {
+                free(entry.timestamp);
+                free(entry.text);
+            } else {
+                if (*count == *cap) {
+                    size_t newCap = *cap ? *cap * 2 : 64;
+                    MemoryEntry *resized = realloc(*entries, newCap * sizeof(MemoryEntry));
+                    if (!resized) {
+                        free(entry.timestamp);
+                        free(entry.text);
+                        return -1;
+                    }
+                    *entries = resized;
+                    *cap = newCap;
+                }
+                (*entries)[(*count)++] = entry;
+            }
+        }
+        line = next + 1;
+    }
+    return 0;
+}
+
+static void migrateIfNeeded(const MemoryPaths *paths) {
+    if (access(paths->legacyPath, F_OK) != 0 || access(paths->snapshotPath, F_OK) == 0) {
+        return;
+    }
+    int lockFd = lockMemoryStore(paths, LOCK_EX);
+    if (lockFd < 0) return;
+    int logFd = open(paths->logPath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (logFd >= 0) {
+        migrateLegacyMemory(paths, logFd);
+        close(logFd);
+    }
+    unlockMemoryStore(lockFd);
+}
+
+/* Snapshots written before memory.bm25 existed (or a failed build) get their index built once. */
+static void ensureIndexFresh(const MemoryPaths *paths) {
+    if (access(paths->snapshotPath, F_OK) != 0) {
+        return;
+    }
+
+    MemoryIndex index;
+    if (memoryIndexOpen(&index, paths->indexPath) == 0) {
+        uint64_t indexed = index.lastId;
+        memoryIndexClose(&index);
+        if (indexed == snapshotLastId(paths->snapshotPath)) return;
+    }
+
+    int lockFd = lockMemoryStore(paths, LOCK_EX);
+    if (lockFd < 0) return;
+    memoryIndexBuild(paths->snapshotPath, paths->indexPath);
+    unlockMemoryStore(lockFd);
+}
+
+typedef struct {
+    double score;
+    uint64_t id;
+    int fromIndex;
+    size_t slot;
+} MemoryCandidate;
+
+static int compareCandidates(const void *a, const void *b) {
+    const MemoryCandidate *left = a;
+    const MemoryCandidate *right = b;
+    if (left->score != right->score) return left->score < right->score ? 1 : -1;
+    if (left->id != right->id) return left->id < right->id ? 1 : -1;
+    return 0;
+}
+
+static int inWindow(const MemoryQuery *query, int64_t epoch) {
+    if (query->since && epoch < query->since) return 0;
+    if (query->until && epoch > query->until) return 0;
+    return 1;
+}
+
+static size_t collectQueryTerms(const char *text, char terms[][MEMORY_TOKEN_MAX], size_t *lens, size_t max) {
+    size_t count = 0;
+    char token[MEMORY_TOKEN_MAX];
+    size_t len = 0;
+    for (const char *p = text ? memoryNextToken(text, token, &len) : NULL; p && count < max; p = memoryNextToken(p, token, &len)) {
+        int seen = 0;
+        for (size_t i = 0; i < count && !seen; ++i) {
+            seen = lens[i] == len && memcmp(terms[i], token, len) == 0;
+        }
+        if (!seen) {
+            memcpy(terms[count], token, len + 1);
+            lens[count++] = len;
+        }
+    }
+    return count;
+}
+
+static int pushCandidate(MemoryCandidate **candidates, size_t *count, size_t *cap, MemoryCandidate candidate) {
+    if (*count == *cap) {
+        size_t newCap = *cap ? *cap * 2 : 64;
+        MemoryCandidate *resized = realloc(*candidates, newCap * sizeof(MemoryCandidate));
+        if (!resized) return -1;
+        *candidates = resized;
+        *cap = newCap;
+    }
+    (*candidates)[(*count)++] = candidate;
+    return 0;
+}
+
+/*
+ * BM25 over the mmap'ed snapshot index plus the un-compacted log tail. The
+ * tail is bounded by MEMORY_COMPACT_BYTES, so query cost tracks the number
+ * of postings for the query terms rather than the total number of memories.
+ */
+static int scoreCandidates(const MemoryQuery *query, const MemoryIndex *index, MemoryEntry *extra, size_t extraCount,
+                           MemoryCandidate **candidatesOut, size_t *countOut) {
+    char terms[MEMORY_QUERY_TERMS][MEMORY_TOKEN_MAX];
+    size_t lens[MEMORY_QUERY_TERMS];
+    size_t termCount = collectQueryTerms(query->text, terms, lens, MEMORY_QUERY_TERMS);
+
+    MemoryCandidate *candidates = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+
+    if (termCount == 0) {
+        for (size_t i = extraCount; i > 0 && count < query->limit; --i) {
+            if (!inWindow(query, extra[i - 1].epoch)) continue;
+            MemoryCandidate candidate = { 0.0, extra[i - 1].id, 0, i - 1 };
+            if (pushCandidate(&candidates, &count, &cap, candidate) != 0) goto fail;
+        }
+        for (size_t i = index->docCount; i > 0 && count < query->limit; --i) {
+            if (!inWindow(query, index->docs[i - 1].epoch)) continue;
+            MemoryCandidate candidate = { 0.0, index->docs[i - 1].id, 1, i - 1 };
+            if (pushCandidate(&candidates, &count, &cap, candidate) != 0) goto fail;
+        }
+        *candidatesOut = candidates;
+        *countOut = count;
+        return 0;
+    }
+
+    uint32_t *extraTf = calloc(extraCount * termCount + 1, sizeof(uint32_t));
+    uint32_t *extraLen = calloc(extraCount + 1, sizeof(uint32_t));
+    float *indexScores = index->docCount ? calloc(index->docCount, sizeof(float)) : NULL;
+    double *extraScores = calloc(extraCount + 1, sizeof(double));
+    if (!extraTf || !extraLen || !extraScores || (index->docCount && !indexScores)) {
+        free(extraTf);
+        free(extraLen);
+        free(indexScores);
+        free(extraScores);
+        goto fail;
+    }
+
+    uint64_t totalLen = index->totalDocLen;
+    for (size_t d = 0; d < extraCount; ++d) {
+        char token[MEMORY_TOKEN_MAX];
+        size_t len = 0;
+        for (const char *p = memoryNextToken(extra[d].text, token, &len); p; p = memoryNextToken(p, token, &len)) {
+            extraLen[d]++;
+            for (size_t t = 0; t < termCount; ++t) {
+                if (lens[t] == len && memcmp(terms[t], token, len) == 0) {
+                    extraTf[d * termCount + t]++;
+                    break;
+                }
+            }
+        }
+        totalLen += extraLen[d];
+    }
+
+    const double k1 = 1.2;
+    const double b = 0.75;
+    double docTotal = (double)index->docCount + (double)extraCount;
+    double avgdl = docTotal > 0 && totalLen > 0 ? (double)totalLen / docTotal : 1.0;
+
+    for (size_t t = 0; t < termCount; ++t) {
+        const MemoryIndexPosting *postings = NULL;
+        uint32_t postingCount = memoryIndexLookup(index, terms[t], lens[t], &postings);
+        size_t df = postingCount;
+        for (size_t d = 0; d < extraCount; ++d) {
+            if (extraTf[d * termCount + t]) df++;
+        }
+        if (df == 0) continue;
+
+        double idf = log(1.0 + (docTotal - (double)df + 0.5) / ((double)df + 0.5));
+        for (uint32_t i = 0; i < postingCount; ++i) {
+            const MemoryIndexDoc *doc = &index->docs[postings[i].doc];
+            double tf = postings[i].tf;
+            indexScores[postings[i].doc] += (float)(idf * tf * (k1 + 1.0) / (tf + k1 * (1.0 - b + b * doc->docLen / avgdl)));
+        }
+        for (size_t d = 0; d < extraCount; ++d) {
+            double tf = extraTf[d * termCount + t];
+            if (tf == 0) continue;
+            extraScores[d] += idf * tf * (k1 + 1.0) / (tf + k1 * (1.0 - b + b * extraLen[d] / avgdl));
+        }
+    }
+
+    int failed = 0;
+    for (uint32_t d = 0; d < index->docCount && !failed; ++d) {
+        if (indexScores[d] <= 0.0f || !inWindow(query, index->docs[d].epoch)) continue;
+        MemoryCandidate candidate = { indexScores[d], index->docs[d].id, 1, d };
+        failed = pushCandidate(&candidates, &count, &cap, candidate) != 0;
+    }
+    for (size_t d = 0; d < extraCount && !failed; ++d) {
+        if (extraScores[d] <= 0.0 || !inWindow(query, extra[d].epoch)) continue;
+        MemoryCandidate candidate = { extraScores[d], extra[d].id, 0, d };
+        failed = pushCandidate(&candidates, &count, &cap, candidate) != 0;
+    }
+
+    free(extraTf);
+    free(extraLen);
+    free(indexScores);
+    free(extraScores);
+    if (failed) goto fail;
+
+    qsort(candidates, count, sizeof(MemoryCandidate), compareCandidates);
+    if (count > query->limit) count = query->limit;
+    *candidatesOut = candidates;
+    *countOut = count;
+    return 0;
+
+fail:
+    free(candidates);
+    return -1;
+}
+
+/* Reciprocal rank fusion of the BM25 ranking and the embedding ranking. */
+static int fuseRankings(const MemoryCandidate *keyword, size_t keywordCount, const MemoryVectorHit *hits, size_t hitCount,
+                        size_t limit, MemoryCandidate **fusedOut, size_t *countOut) {
+    MemoryCandidate *fused = malloc((keywordCount + hitCount + 1) * sizeof(MemoryCandidate));
+    if (!fused) return -1;
+
+    size_t count = 0;
+    for (size_t i = 0; i < keywordCount; ++i) {
+        fused[count] = keyword[i];
+        fused[count++].score = 1.0 / (MEMORY_RRF_K + (double)i + 1.0);
+    }
+    for (size_t i = 0; i < hitCount; ++i) {
+        double contribution = 1.0 / (MEMORY_RRF_K + (double)i + 1.0);
+        size_t j = 0;
+        while (j < count && fused[j].id != hits[i].id) j++;
+        if (j < count) {
+            fused[j].score += contribution;
+        } else {
+            MemoryCandidate candidate = { contribution, hits[i].id, 2, 0 };
+            fused[count++] = candidate;
+        }
+    }
+
+    qsort(fused, count, sizeof(MemoryCandidate), compareCandidates);
+    *fusedOut = fused;
+    *countOut = count < limit ? count : limit;
+    return 0;
+}
+
+static int readIndexedEntry(int snapshotFd, const MemoryIndexDoc *doc, MemoryEntry *entry) {
+    char *line = malloc((size_t)doc->length + 1);
+    if (!line) return -1;
+    if (pread(snapshotFd, line, doc->length, (off_t)doc->offset) != (ssize_t)doc->length) {
+        free(line);
+        return -1;
+    }
+    line[doc->length] = '\0';
+    int ret = parseEntryLine(line, entry);
+    free(line);
+    return ret;
+}
+
+/* Vector-only hits carry just an id; point them at the log tail entry or the indexed snapshot line. */
+static int resolveCandidateById(MemoryCandidate *candidate, const MemoryIndex *index, const MemoryEntry *extra, size_t extraCount) {
+    for (size_t i = 0; i < extraCount; ++i) {
+        if (extra[i].text && extra[i].id == candidate->id) {
+            candidate->fromIndex = 0;
+            candidate->slot = i;
+            return 1;
+        }
+    }
+
+    size_t lo = 0;
+    size_t hi = index->docCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->docs[mid].id == candidate->id) {
+            candidate->fromIndex = 1;
+            candidate->slot = mid;
+            return 1;
+        }
+        if (index->docs[mid].id < candidate->id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+int memoryStoreSearch(const MemoryQuery *query, MemoryEntry **entriesOut, size_t *countOut, char **error_out) {
+    *entriesOut = NULL;
+    *countOut = 0;
+
+    MemoryPaths paths;
+    if (resolveMemoryPaths(&paths, error_out) != 0) {
+        return -1;
+    }
+
+    migrateIfNeeded(&paths);
+    ensureIndexFresh(&paths);
+
+    int lockFd = lockMemoryStore(&paths, LOCK_SH);
+    if (lockFd < 0) {
+        if (error_out) *error_out = formatString("Failed to lock memory store: %s", strerror(errno));
+        freeMemoryPaths(&paths);
+        return -1;
+    }
+
+    MemoryIndex index;
+    memset(&index, 0, sizeof(index));
+    uint64_t lastId = snapshotLastId(paths.snapshotPath);
+    int haveIndex = memoryIndexOpen(&index, paths.indexPath) == 0 && index.lastId == lastId;
+    if (!haveIndex) {
+        memoryIndexClose(&index);
+    }
+
+    /* Without a matching index the whole snapshot is scored like the log tail. */
+    char *snapshot = haveIndex ? NULL : readWholeFile(paths.snapshotPath, NULL);
+    int snapshotFd = haveIndex ? open(paths.snapshotPath, O_RDONLY | O_CLOEXEC) : -1;
+    char *log = readWholeFile(paths.logPath, NULL);
+    unlockMemoryStore(lockFd);
+
+    MemoryEntry *extra = NULL;
+    size_t extraCount = 0;
+    size_t extraCap = 0;
+    int ret = 0;
+    if (snapshot) {
+        char *body = strchr(snapshot, '\n');
+        if (body && appendEntriesFromBuffer(body + 1, 0, &extra, &extraCount, &extraCap) != 0) ret = -1;
+    }
+    if (ret == 0 && log && appendEntriesFromBuffer(log, lastId, &extra, &extraCount, &extraCap) != 0) ret = -1;
+    free(snapshot);
+    free(log);
+
+    MemoryCandidate *candidates = NULL;
+    size_t candidateCount = 0;
+    int semantic = query->embedding && query->embeddingDim && query->text && *query->text;
+    if (ret == 0 && !semantic) {
+        ret = scoreCandidates(query, &index, extra, extraCount, &candidates, &candidateCount);
+    } else if (ret == 0) {
+        MemoryQuery pooled = *query;
+        pooled.limit = query->limit * MEMORY_FUSION_POOL;
+        MemoryCandidate *keyword = NULL;
+        size_t keywordCount = 0;
+        MemoryVectorHit *hits = calloc(pooled.limit, sizeof(MemoryVectorHit));
+        if (!hits) ret = -1;
+        if (ret == 0 && !query->semanticOnly) {
+            ret = scoreCandidates(&pooled, &index, extra, extraCount, &keyword, &keywordCount);
+        }
+        if (ret == 0) {
+            size_t hitCount = memoryVectorSearch(paths.vecPath, query->embedding, query->embeddingDim,
+                                                 query->since, query->until, hits, pooled.limit);
+            ret = fuseRankings(keyword, keywordCount, hits, hitCount, query->limit, &candidates, &candidateCount);
+        }
+        free(keyword);
+        free(hits);
+    }
+
+    MemoryEntry *results = NULL;
+    size_t resultCount = 0;
+    if (ret == 0 && candidateCount > 0) {
+        results = calloc(candidateCount, sizeof(MemoryEntry));
+        if (!results) ret = -1;
+    }
+    for (size_t i = 0; ret == 0 && i < candidateCount; ++i) {
+        MemoryEntry *entry = &results[resultCount];
+        if (candidates[i].fromIndex == 2 && !resolveCandidateById(&candidates[i], &index, extra, extraCount)) {
+            continue;
+        }
+        if (candidates[i].fromIndex == 1) {
+            if (snapshotFd < 0 || readIndexedEntry(snapshotFd, &index.docs[candidates[i].slot], entry) != 0) continue;
+        } else {
+            *entry = extra[candidates[i].slot];
+            memset(&extra[candidates[i].slot], 0, sizeof(MemoryEntry));
+        }
+        entry->score = candidates[i].score;
+        resultCount++;
+    }
+
+    free(candidates);
+    memoryStoreFreeEntries(extra, extraCount);
+    memoryIndexClose(&index);
+    if (snapshotFd >= 0) close(snapshotFd);
+    freeMemoryPaths(&paths);
+
+    if (ret != 0) {
+        memoryStoreFreeEntries(results, resultCount);
+        if (error_out) *error_out = duplicateString("Out of memory while searching memories.");
+        return -1;
+    }
+
+    *entriesOut = results;
+    *countOut = resultCount;
+    return 0;
+}
+
+void memoryStoreFreeEntries(MemoryEntry *entries, size_t count) {
+    if (!entries) return;
+    for (size_t i = 0; i < count; ++i) {
+        free(entries[i].timestamp);
+        free(entries[i].text);
+    }
+    free(entries);
+}
@@ -0,0 +1,43 @@
+#ifndef TOOLS_MEMORY_H
+#define TOOLS_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Memory entries live in ~/.gipwrap as JSON lines:
+ *   memory.log       append-only, one {"id","epoch","timestamp","memory"} per line
+ *   memory.snapshot  compacted entries, first line {"snapshot":1,"lastId":N}
+ *   memory.lock      flock target serializing writers and compaction
+ *   memory.bm25      inverted index over the snapshot (see memoryIndex.h)
+ *   memory.vec       optional embeddings keyed by id (see memoryVector.h)
+ * Log lines with an id at or below the snapshot's lastId are already compacted.
+ */
+typedef struct {
+    uint64_t id;
+    int64_t epoch;
+    char *timestamp;
+    char *text;
+    double score;
+} MemoryEntry;
+
+/*
+ * An empty text returns the newest entries; since/until are epoch bounds, 0 when open.
+ * With an embedding, BM25 and cosine rankings are fused (or cosine alone if semanticOnly).
+ */
+typedef struct {
+    const char *text;
+    int64_t since;
+    int64_t until;
+    size_t limit;
+    float *embedding;
+    uint32_t embeddingDim;
+    int semanticOnly;
+} MemoryQuery;
+
+int memoryStoreAppend(const char *escapedText, uint64_t *idOut, int64_t *epochOut, char **error_out);
+int memoryStoreAttachEmbedding(uint64_t id, int64_t epoch, float *vector, uint32_t dim, char **error_out);
+int memoryStoreSearch(const MemoryQuery *query, MemoryEntry **entriesOut, size_t *countOut, char **error_out);
+void memoryStoreFreeEntries(MemoryEntry *entries, size_t count);
+
+#endif
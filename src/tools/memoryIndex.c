@@ -0,0 +1,385 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ai_core/core.h"
+#include "tools/memoryIndex.h"
+
+#define MEMORY_INDEX_MAGIC 0x58424d47u
+#define MEMORY_INDEX_VERSION 1u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t docCount;
+    uint32_t termCount;
+    uint64_t lastId;
+    uint64_t totalDocLen;
+    uint64_t docsOffset;
+    uint64_t termsOffset;
+    uint64_t postingsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsLen;
+} MemoryIndexHeader;
+
+typedef struct {
+    uint32_t strOffset;
+    uint32_t strLen;
+    uint32_t postingStart;
+    uint32_t postingCount;
+} MemoryIndexTerm;
+
+typedef struct {
+    uint32_t strOffset;
+    uint32_t strLen;
+    uint32_t hash;
+    uint32_t count;
+    uint32_t cap;
+    MemoryIndexPosting *postings;
+} BuildTerm;
+
+typedef struct {
+    BuildTerm *slots;
+    size_t slotCount;
+    size_t used;
+    char *strings;
+    size_t stringsLen;
+    size_t stringsCap;
+} BuildTable;
+
+static int isTokenByte(unsigned char c) {
+    return isalnum(c) || c >= 0x80;
+}
+
+/* Lowercased alphanumeric runs (UTF-8 bytes kept as word characters); single ASCII letters are skipped. */
+const char* memoryNextToken(const char *text, char *token, size_t *lenOut) {
+    const unsigned char *p = (const unsigned char *)text;
+    while (*p) {
+        while (*p && !isTokenByte(*p)) p++;
+        if (!*p) break;
+
+        size_t len = 0;
+        while (*p && isTokenByte(*p)) {
+            if (len < MEMORY_TOKEN_MAX - 1) {
+                token[len++] = (char)tolower(*p);
+            }
+            p++;
+        }
+        if (len == 1 && (unsigned char)token[0] < 0x80) {
+            continue;
+        }
+        token[len] = '\0';
+        *lenOut = len;
+        return (const char *)p;
+    }
+    return NULL;
+}
+
+static uint32_t hashToken(const char *token, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)token[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int growTable(BuildTable *table) {
+    size_t newCount = table->slotCount ? table->slotCount * 2 : 1024;
+    BuildTerm *slots = calloc(newCount, sizeof(BuildTerm));
+    if (!slots) return -1;
+
+    for (size_t i = 0; i < table->slotCount; ++i) {
+        BuildTerm *term = &table->slots[i];
+        if (!term->postings) continue;
+        size_t pos = term->hash & (newCount - 1);
+        while (slots[pos].postings) pos = (pos + 1) & (newCount - 1);
+        slots[pos] = *term;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slotCount = newCount;
+    return 0;
+}
+
+static int addPosting(BuildTable *table, const char *token, size_t len, uint32_t doc) {
+    if ((table->used + 1) * 2 > table->slotCount && growTable(table) != 0) return -1;
+
+    uint32_t hash = hashToken(token, len);
+    size_t pos = hash & (table->slotCount - 1);
+    while (table->slots[pos].postings) {
+        BuildTerm *term = &table->slots[pos];
+        if (term->hash == hash && term->strLen == len && memcmp(table->strings + term->strOffset, token, len) == 0) {
+            if (term->postings[term->count - 1].doc == doc) {
+                term->postings[term->count - 1].tf++;
+                return 0;
+            }
+            if (term->count == term->cap) {
+                uint32_t cap = term->cap * 2;
+                MemoryIndexPosting *resized = realloc(term->postings, cap * sizeof(MemoryIndexPosting));
+                if (!resized) return -1;
+                term->postings = resized;
+                term->cap = cap;
+            }
+            term->postings[term->count].doc = doc;
+            term->postings[term->count].tf = 1;
+            term->count++;
+            return 0;
+        }
+        pos = (pos + 1) & (table->slotCount - 1);
+    }
+
+    if (table->stringsLen + len > table->stringsCap) {
+        size_t cap = table->stringsCap ? table->stringsCap * 2 : 65536;
+        while (table->stringsLen + len > cap) cap *= 2;
+        char *resized = realloc(table->strings, cap);
+        if (!resized) return -1;
+        table->strings = resized;
+        table->stringsCap = cap;
+    }
+
+    BuildTerm *term = &table->slots[pos];
+    term->postings = malloc(4 * sizeof(MemoryIndexPosting));
+    if (!term->postings) return -1;
+    term->strOffset = (uint32_t)table->stringsLen;
+    term->strLen = (uint32_t)len;
+    term->hash = hash;
+    term->cap = 4;
+    term->count = 1;
+    term->postings[0].doc = doc;
+    term->postings[0].tf = 1;
+    memcpy(table->strings + table->stringsLen, token, len);
+    table->stringsLen += len;
+    table->used++;
+    return 0;
+}
+
+static void freeTable(BuildTable *table) {
+    for (size_t i = 0; i < table->slotCount; ++i) {
+        free(table->slots[i].postings);
+    }
+    free(table->slots);
+    free(table->strings);
+}
+
+static const char *sortStrings;
+
+static int compareBuildTerms(const void *a, const void *b) {
+    const BuildTerm *left = *(const BuildTerm * const *)a;
+    const BuildTerm *right = *(const BuildTerm * const *)b;
+    size_t common = left->strLen < right->strLen ? left->strLen : right->strLen;
+    int cmp = memcmp(sortStrings + left->strOffset, sortStrings + right->strOffset, common);
+    if (cmp != 0) return cmp;
+    return (int)left->strLen - (int)right->strLen;
+}
+
+static uint64_t parseUintAfter(const char *line, const char *pattern) {
+    const char *pos = strstr(line, pattern);
+    return pos ? strtoull(pos + strlen(pattern), NULL, 10) : 0;
+}
+
+static int writeAll(FILE *f, const void *data, size_t size) {
+    return size == 0 || fwrite(data, 1, size, f) == size ? 0 : -1;
+}
+
+/* Rebuilds memory.bm25 from the snapshot; callers hold the store's exclusive lock. */
+int memoryIndexBuild(const char *snapshotPath, const char *indexPath) {
+    FILE *in = fopen(snapshotPath, "rb");
+    if (!in) return -1;
+
+    BuildTable table;
+    memset(&table, 0, sizeof(table));
+    MemoryIndexDoc *docs = NULL;
+    size_t docCap = 0;
+    uint32_t docCount = 0;
+    uint64_t totalDocLen = 0;
+    uint64_t lastId = 0;
+    int ret = -1;
+
+    char *line = NULL;
+    size_t lineCap = 0;
+    ssize_t lineLen;
+    uint64_t offset = 0;
+    int first = 1;
+    while ((lineLen = getline(&line, &lineCap, in)) > 0) {
+        uint64_t lineOffset = offset;
+        offset += (uint64_t)lineLen;
+        if (first) {
+            first = 0;
+            lastId = parseUintAfter(line, "\"lastId\":");
+            continue;
+        }
+
+        char *text = find_json_string(line, "memory");
+        if (!text) continue;
+
+        if (docCount == docCap) {
+            docCap = docCap ? docCap * 2 : 256;
+            MemoryIndexDoc *resized = realloc(docs, docCap * sizeof(MemoryIndexDoc));
+            if (!resized) {
+                free(text);
+                goto done;
+            }
+            docs = resized;
+        }
+
+        MemoryIndexDoc *doc = &docs[docCount];
+        doc->id = parseUintAfter(line, "\"id\":");
+        doc->epoch = (int64_t)parseUintAfter(line, "\"epoch\":");
+        doc->offset = lineOffset;
+        doc->length = (uint32_t)lineLen;
+        doc->docLen = 0;
+
+        char token[MEMORY_TOKEN_MAX];
+        size_t tokenLen = 0;
+        for (const char *p = memoryNextToken(text, token, &tokenLen); p; p = memoryNextToken(p, token, &tokenLen)) {
+            if (addPosting(&table, token, tokenLen, docCount) != 0) {
+                free(text);
+                goto done;
+            }
+            doc->docLen++;
+        }
+        totalDocLen += doc->docLen;
+        docCount++;
+        free(text);
+    }
+
+    BuildTerm **sorted = malloc((table.used ? table.used : 1) * sizeof(BuildTerm *));
+    if (!sorted) goto done;
+    size_t termCount = 0;
+    uint64_t postingTotal = 0;
+    for (size_t i = 0; i < table.slotCount; ++i) {
+        if (table.slots[i].postings) {
+            sorted[termCount++] = &table.slots[i];
+            postingTotal += table.slots[i].count;
+        }
+    }
+    sortStrings = table.strings;
+    qsort(sorted, termCount, sizeof(BuildTerm *), compareBuildTerms);
+
+    MemoryIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MEMORY_INDEX_MAGIC;
+    header.version = MEMORY_INDEX_VERSION;
+    header.docCount = docCount;
+    header.termCount = (uint32_t)termCount;
+    header.lastId = lastId;
+    header.totalDocLen = totalDocLen;
+    header.docsOffset = sizeof(header);
+    header.termsOffset = header.docsOffset + (uint64_t)docCount * sizeof(MemoryIndexDoc);
+    header.postingsOffset = header.termsOffset + (uint64_t)termCount * sizeof(MemoryIndexTerm);
+    header.stringsOffset = header.postingsOffset + postingTotal * sizeof(MemoryIndexPosting);
+    header.stringsLen = table.stringsLen;
+
+    size_t tmpLen = strlen(indexPath) + 5;
+    char *tmpPath = malloc(tmpLen);
+    FILE *out = NULL;
+    if (tmpPath) {
+        snprintf(tmpPath, tmpLen, "%s.tmp", indexPath);
+        out = fopen(tmpPath, "wb");
+    }
+
+    int failed = !out;
+    if (!failed) failed = writeAll(out, &header, sizeof(header)) != 0;
+    if (!failed) failed = writeAll(out, docs, (size_t)docCount * sizeof(MemoryIndexDoc)) != 0;
+
+    uint32_t postingStart = 0;
+    for (size_t i = 0; i < termCount && !failed; ++i) {
+        MemoryIndexTerm term = { sorted[i]->strOffset, sorted[i]->strLen, postingStart, sorted[i]->count };
+        failed = writeAll(out, &term, sizeof(term)) != 0;
+        postingStart += sorted[i]->count;
+    }
+    for (size_t i = 0; i < termCount && !failed; ++i) {
+        failed = writeAll(out, sorted[i]->postings, sorted[i]->count * sizeof(MemoryIndexPosting)) != 0;
+    }
+    if (!failed) failed = writeAll(out, table.strings, table.stringsLen) != 0;
+    if (!failed) failed = fflush(out) != 0 || fsync(fileno(out)) != 0;
+    if (out && fclose(out) != 0) failed = 1;
+    if (!failed) failed = rename(tmpPath, indexPath) != 0;
+    if (failed && tmpPath) unlink(tmpPath);
+
+    free(tmpPath);
+    free(sorted);
+    ret = failed ? -1 : 0;
+
+done:
+    free(line);
+    fclose(in);
+    free(docs);
+    freeTable(&table);
+    return ret;
+}
+
+int memoryIndexOpen(MemoryIndex *index, const char *indexPath) {
+    memset(index, 0, sizeof(*index));
+    int fd = open(indexPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MemoryIndexHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const MemoryIndexHeader *header = map;
+    if (header->magic != MEMORY_INDEX_MAGIC || header->version != MEMORY_INDEX_VERSION ||
+        header->stringsOffset + header->stringsLen > (uint64_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    const char *base = map;
+    index->map = map;
+    index->mapLen = (size_t)st.st_size;
+    index->lastId = header->lastId;
+    index->totalDocLen = header->totalDocLen;
+    index->docCount = header->docCount;
+    index->termCount = header->termCount;
+    index->docs = (const MemoryIndexDoc *)(base + header->docsOffset);
+    index->terms = base + header->termsOffset;
+    index->postings = (const MemoryIndexPosting *)(base + header->postingsOffset);
+    index->strings = base + header->stringsOffset;
+    return 0;
+}
+
+void memoryIndexClose(MemoryIndex *index) {
+    if (index->map) {
+        munmap(index->map, index->mapLen);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+uint32_t memoryIndexLookup(const MemoryIndex *index, const char *term, size_t termLen, const MemoryIndexPosting **postingsOut) {
+    const MemoryIndexTerm *terms = index->terms;
+    size_t lo = 0;
+    size_t hi = index->termCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const MemoryIndexTerm *candidate = &terms[mid];
+        size_t common = candidate->strLen < termLen ? candidate->strLen : termLen;
+        int cmp = memcmp(index->strings + candidate->strOffset, term, common);
+        if (cmp == 0) cmp = (int)candidate->strLen - (int)termLen;
+        if (cmp == 0) {
+            *postingsOut = index->postings + candidate->postingStart;
+            return candidate->postingCount;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *postingsOut = NULL;
+    return 0;
+}
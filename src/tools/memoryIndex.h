@@ -0,0 +1,46 @@
+#ifndef TOOLS_MEMORY_INDEX_H
+#define TOOLS_MEMORY_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMORY_TOKEN_MAX 64
+
+/*
+ * memory.bm25 is an immutable inverted index over memory.snapshot, rebuilt
+ * by every compaction. It is mmap'ed read-only; terms are sorted so a lookup
+ * is a binary search, and each doc records where its line sits in the snapshot.
+ */
+typedef struct {
+    uint64_t id;
+    int64_t epoch;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t docLen;
+} MemoryIndexDoc;
+
+typedef struct {
+    uint32_t doc;
+    uint32_t tf;
+} MemoryIndexPosting;
+
+typedef struct {
+    void *map;
+    size_t mapLen;
+    uint64_t lastId;
+    uint64_t totalDocLen;
+    uint32_t docCount;
+    uint32_t termCount;
+    const MemoryIndexDoc *docs;
+    const void *terms;
+    const MemoryIndexPosting *postings;
+    const char *strings;
+} MemoryIndex;
+
+const char* memoryNextToken(const char *text, char *token, size_t *lenOut);
+int memoryIndexBuild(const char *snapshotPath, const char *indexPath);
+int memoryIndexOpen(MemoryIndex *index, const char *indexPath);
+void memoryIndexClose(MemoryIndex *index);
+uint32_t memoryIndexLookup(const MemoryIndex *index, const char *term, size_t termLen, const MemoryIndexPosting **postingsOut);
+
+#endif
@@ -0,0 +1,607 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "tools/memoryVector.h"
+
+#define MEMORY_VECTOR_MAGIC 0x43455647u
+#define MEMORY_VECTOR_VERSION 1u
+#define MEMORY_VECTOR_BITS_VERSION 2u
+#define MEMORY_VECTOR_MAX_DIM 8192
+#define MEMORY_VECTOR_EXACT_LIMIT 4096
+#define MEMORY_VECTOR_RERANK_FACTOR 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dim;
+    uint32_t reserved;
+} MemoryVectorHeader;
+
+typedef struct {
+    uint64_t id;
+    int64_t epoch;
+} MemoryVectorRecord;
+
+typedef float MemoryVec8 __attribute__((vector_size(32)));
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static char* formatString(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0) {
+        return NULL;
+    }
+
+    char *buffer = malloc((size_t)needed + 1);
+    if (!buffer) return NULL;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, (size_t)needed + 1, fmt, args);
+    va_end(args);
+
+    return buffer;
+}
+
+static const char* envOr(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    return value && *value ? value : fallback;
+}
+
+static char* readStream(FILE *f) {
+    size_t cap = 8192;
+    size_t len = 0;
+    char *buf = malloc(cap);
+    if (!buf) return NULL;
+
+    size_t n;
+    while ((n = fread(buf + len, 1, cap - len - 1, f)) > 0) {
+        len += n;
+        if (len + 1 == cap) {
+            cap *= 2;
+            char *resized = realloc(buf, cap);
+            if (!resized) {
+                free(buf);
+                return NULL;
+            }
+            buf = resized;
+        }
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+/* Accepts "embedding":[...] (ollama /api/embeddings, OpenAI data[0]) and "embeddings":[[...]] (/api/embed). */
+static float* parseEmbedding(const char *json, uint32_t *dimOut) {
+    const char *pos = json;
+    const char *array = NULL;
+    while ((pos = strstr(pos, "\"embedding")) != NULL) {
+        const char *p = pos + strlen("\"embedding");
+        if (*p == 's') p++;
+        if (*p++ != '"') {
+            pos = p;
+            continue;
+        }
+        while (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r') p++;
+        if (*p == ':') {
+            p++;
+            while (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r' || *p == '[') p++;
+            array = p;
+            break;
+        }
+        pos = p;
+    }
+    if (!array) return NULL;
+
+    size_t cap = 1024;
+    uint32_t dim = 0;
+    float *vector = malloc(cap * sizeof(float));
+    if (!vector) return NULL;
+
+    const char *p = array;
+    while (*p && *p != ']' && dim < MEMORY_VECTOR_MAX_DIM) {
+        char *end = NULL;
+        float value = strtof(p, &end);
+        if (end == p) break;
+        if (dim == cap) {
+            cap *= 2;
+            float *resized = realloc(vector, cap * sizeof(float));
+            if (!resized) {
+                free(vector);
+                return NULL;
+            }
+            vector = resized;
+        }
+        vector[dim++] = value;
+        p = end;
+        while (*p == ',' || *p == ' ' || *p == '\n' || *p == '\t' || *p == '\r') p++;
+    }
+
+    if (dim == 0) {
+        free(vector);
+        return NULL;
+    }
+    *dimOut = dim;
+    return vector;
+}
+
+static void normalizeVector(float *vector, uint32_t dim) {
+    double norm = 0.0;
+    for (uint32_t i = 0; i < dim; ++i) {
+        norm += (double)vector[i] * vector[i];
+    }
+    if (norm <= 0.0) return;
+    float scale = (float)(1.0 / sqrt(norm));
+    for (uint32_t i = 0; i < dim; ++i) {
+        vector[i] *= scale;
+    }
+}
+
+/*
+ * GIPWRAP_EMBED_PROVIDER=ollama|openai|off selects the request shape,
+ * GIPWRAP_EMBED_URL / GIPWRAP_EMBED_MODEL the endpoint and model, and
+ * GIPWRAP_EMBED_KEY an optional bearer token for OpenAI-compatible servers.
+ */
+int memoryEmbed(const char *escapedText, float **vectorOut, uint32_t *dimOut, char **error_out) {
+    const char *provider = envOr("GIPWRAP_EMBED_PROVIDER", "ollama");
+    if (strcmp(provider, "off") == 0) {
+        if (error_out) *error_out = duplicateString("Embeddings are disabled.");
+        return -1;
+    }
+
+    int openai = strcmp(provider, "openai") == 0;
+    const char *url = envOr("GIPWRAP_EMBED_URL", openai ? "https://api.openai.com/v1/embeddings" : "http://localhost:11434/api/embeddings");
+    const char *model = envOr("GIPWRAP_EMBED_MODEL", openai ? "text-embedding-3-small" : "nomic-embed-text");
+    const char *key = getenv("GIPWRAP_EMBED_KEY");
+
+    char *body = formatString(openai ? "{\"model\":\"%s\",\"input\":\"%s\"}" : "{\"model\":\"%s\",\"prompt\":\"%s\"}", model, escapedText);
+    char *headers = key && *key
+        ? formatString("-H 'Content-Type: application/json' -H 'Authorization: Bearer %s'", key)
+        : duplicateString("-H 'Content-Type: application/json'");
+    FILE *tmp = tmpfile();
+    if (!body || !headers || !tmp) {
+        free(body);
+        free(headers);
+        if (tmp) fclose(tmp);
+        if (error_out) *error_out = duplicateString("Failed to prepare embedding request.");
+        return -1;
+    }
+
+    int ret = http_post(url, headers, body, tmp);
+    free(body);
+    free(headers);
+    if (ret != 0) {
+        fclose(tmp);
+        if (error_out) *error_out = formatString("Embedding request to %s failed.", url);
+        return -1;
+    }
+
+    rewind(tmp);
+    char *json = readStream(tmp);
+    fclose(tmp);
+
+    uint32_t dim = 0;
+    float *vector = json ? parseEmbedding(json, &dim) : NULL;
+    free(json);
+    if (!vector) {
+        if (error_out) *error_out = formatString("No embedding returned by %s (model %s).", url, model);
+        return -1;
+    }
+
+    normalizeVector(vector, dim);
+    *vectorOut = vector;
+    *dimOut = dim;
+    return 0;
+}
+
+static size_t signWords(uint32_t dim) {
+    return ((size_t)dim + 63) / 64;
+}
+
+static size_t signHeaderSize(uint32_t dim) {
+    return sizeof(MemoryVectorHeader) + (size_t)dim * sizeof(float);
+}
+
+/*
+ * Signs are taken around the store's mean: embedding models share a large
+ * common offset, so raw coordinate signs barely differ between memories and
+ * the Hamming prefilter missed most true neighbors.
+ */
+static void signBits(const float *vector, const float *center, uint32_t dim, uint64_t *bits) {
+    memset(bits, 0, signWords(dim) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < dim; ++i) {
+        if (vector[i] > center[i]) {
+            bits[i / 64] |= 1ull << (i % 64);
+        }
+    }
+}
+
+static char* sidecarPath(const char *vecPath) {
+    return formatString("%s.bits", vecPath);
+}
+
+/*
+ * Keeps memory.vec.bits in step with the vector file, backfilling after a
+ * crash between the two appends. The sidecar is
+ *   header {magic, version, dim, words} float center[dim]
+ *   records {int64 epoch, uint64 signs[words]} in memory.vec order
+ * and is only built once the store reaches MEMORY_VECTOR_EXACT_LIMIT records;
+ * center is the mean of those records. A sidecar of another version is
+ * rebuilt. Returns 1 and fills center when the sidecar exists, 0 when it is
+ * not needed yet, -1 on error.
+ */
+static int syncSignFile(int vecFd, int bitsFd, uint32_t dim, size_t vecCount, float *center) {
+    size_t words = signWords(dim);
+    size_t vecRecord = sizeof(MemoryVectorRecord) + (size_t)dim * sizeof(float);
+    size_t bitsRecord = sizeof(int64_t) + words * sizeof(uint64_t);
+    size_t headerSize = signHeaderSize(dim);
+
+    struct stat st;
+    if (fstat(bitsFd, &st) != 0) return -1;
+    MemoryVectorHeader header;
+    int valid = (size_t)st.st_size >= headerSize && pread(bitsFd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                header.magic == MEMORY_VECTOR_MAGIC && header.version == MEMORY_VECTOR_BITS_VERSION && header.dim == dim &&
+                pread(bitsFd, center, (size_t)dim * sizeof(float), sizeof(header)) == (ssize_t)(dim * sizeof(float));
+    if (!valid && vecCount < MEMORY_VECTOR_EXACT_LIMIT) {
+        return st.st_size == 0 || ftruncate(bitsFd, 0) == 0 ? 0 : -1;
+    }
+
+    char *vecBuf = malloc(vecRecord);
+    char *bitsBuf = malloc(bitsRecord);
+    int ret = vecBuf && bitsBuf ? 0 : -1;
+    if (ret == 0 && !valid) {
+        double *sum = calloc(dim, sizeof(double));
+        if (!sum) ret = -1;
+        for (size_t r = 0; ret == 0 && r < vecCount; ++r) {
+            if (pread(vecFd, vecBuf, vecRecord, (off_t)(sizeof(MemoryVectorHeader) + r * vecRecord)) != (ssize_t)vecRecord) {
+                ret = -1;
+                break;
+            }
+            for (uint32_t i = 0; i < dim; ++i) {
+                float value;
+                memcpy(&value, vecBuf + sizeof(MemoryVectorRecord) + (size_t)i * sizeof(float), sizeof(value));
+                sum[i] += value;
+            }
+        }
+        for (uint32_t i = 0; ret == 0 && i < dim; ++i) {
+            center[i] = (float)(sum[i] / (double)vecCount);
+        }
+        free(sum);
+
+        header.magic = MEMORY_VECTOR_MAGIC;
+        header.version = MEMORY_VECTOR_BITS_VERSION;
+        header.dim = dim;
+        header.reserved = (uint32_t)words;
+        if (ret == 0 && (ftruncate(bitsFd, 0) != 0 || pwrite(bitsFd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+                         pwrite(bitsFd, center, (size_t)dim * sizeof(float), sizeof(header)) != (ssize_t)(dim * sizeof(float)))) {
+            ret = -1;
+        }
+        st.st_size = (off_t)headerSize;
+    }
+
+    size_t bitsCount = ((size_t)st.st_size - headerSize) / bitsRecord;
+    if (bitsCount > vecCount) bitsCount = vecCount;
+    if (ret == 0 && ftruncate(bitsFd, (off_t)(headerSize + bitsCount * bitsRecord)) != 0) ret = -1;
+
+    for (size_t r = bitsCount; ret == 0 && r < vecCount; ++r) {
+        off_t vecOffset = (off_t)(sizeof(MemoryVectorHeader) + r * vecRecord);
+        off_t bitsOffset = (off_t)(headerSize + r * bitsRecord);
+        MemoryVectorRecord meta;
+        if (pread(vecFd, vecBuf, vecRecord, vecOffset) != (ssize_t)vecRecord) {
+            ret = -1;
+            break;
+        }
+        memcpy(&meta, vecBuf, sizeof(meta));
+        memcpy(bitsBuf, &meta.epoch, sizeof(int64_t));
+        float *values = malloc((size_t)dim * sizeof(float));
+        if (!values) {
+            ret = -1;
+            break;
+        }
+        memcpy(values, vecBuf + sizeof(meta), (size_t)dim * sizeof(float));
+        signBits(values, center, dim, (uint64_t *)(void *)(bitsBuf + sizeof(int64_t)));
+        free(values);
+        if (pwrite(bitsFd, bitsBuf, bitsRecord, bitsOffset) != (ssize_t)bitsRecord) ret = -1;
+    }
+    free(vecBuf);
+    free(bitsBuf);
+    return ret == 0 ? 1 : -1;
+}
+
+/*
+ * Callers serialize appends with the memory store lock. The exclusive flock on
+ * memory.vec keeps searches from mapping either file while a torn tail is cut.
+ */
+int memoryVectorAppend(const char *vecPath, uint64_t id, int64_t epoch, float *vector, uint32_t dim, char **error_out) {
+    int fd = open(vecPath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        if (error_out) *error_out = formatString("Failed to open %s: %s", vecPath, strerror(errno));
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            if (error_out) *error_out = formatString("Failed to lock %s: %s", vecPath, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+
+    struct stat st;
+    MemoryVectorHeader header;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        if (error_out) *error_out = formatString("Failed to stat %s: %s", vecPath, strerror(errno));
+        return -1;
+    }
+
+    size_t recordSize = sizeof(MemoryVectorRecord) + (size_t)dim * sizeof(float);
+    size_t count = 0;
+    ssize_t headerRead = 0;
+    if (st.st_size == 0) {
+        header.magic = MEMORY_VECTOR_MAGIC;
+        header.version = MEMORY_VECTOR_VERSION;
+        header.dim = dim;
+        header.reserved = 0;
+        if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            close(fd);
+            if (error_out) *error_out = formatString("Failed to write %s: %s", vecPath, strerror(errno));
+            return -1;
+        }
+    } else if ((headerRead = pread(fd, &header, sizeof(header), 0)) != (ssize_t)sizeof(header)) {
+        if (error_out) *error_out = headerRead < 0 ? formatString("Failed to read %s: %s", vecPath, strerror(errno))
+                                                   : formatString("%s is shorter than its header.", vecPath);
+        close(fd);
+        return -1;
+    } else if (header.magic != MEMORY_VECTOR_MAGIC) {
+        close(fd);
+        if (error_out) *error_out = formatString("%s is not a memory vector file.", vecPath);
+        return -1;
+    } else if (header.dim != dim) {
+        close(fd);
+        if (error_out) *error_out = formatString("%s holds %u-dim vectors; the embedding model now returns %u.", vecPath, header.dim, dim);
+        return -1;
+    } else {
+        /* Drop a record torn by a crash so the array stays fixed-stride. */
+        off_t body = st.st_size - (off_t)sizeof(header);
+        off_t whole = body - body % (off_t)recordSize;
+        if (whole != body && ftruncate(fd, (off_t)sizeof(header) + whole) != 0) {
+            close(fd);
+            if (error_out) *error_out = formatString("Failed to repair %s: %s", vecPath, strerror(errno));
+            return -1;
+        }
+        count = (size_t)whole / recordSize;
+    }
+
+    char *bitsPath = sidecarPath(vecPath);
+    int bitsFd = bitsPath ? open(bitsPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600) : -1;
+    free(bitsPath);
+    size_t words = signWords(dim);
+    size_t bitsRecord = sizeof(int64_t) + words * sizeof(uint64_t);
+    char *buffer = malloc(recordSize > bitsRecord ? recordSize : bitsRecord);
+    float *center = malloc((size_t)dim * sizeof(float));
+    int haveSigns = bitsFd >= 0 && buffer && center ? syncSignFile(fd, bitsFd, dim, count, center) : -1;
+    if (haveSigns < 0) {
+        if (bitsFd >= 0) close(bitsFd);
+        free(buffer);
+        free(center);
+        close(fd);
+        if (error_out) *error_out = formatString("Failed to update %s.bits: %s", vecPath, strerror(errno));
+        return -1;
+    }
+
+    MemoryVectorRecord record = { id, epoch };
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), vector, (size_t)dim * sizeof(float));
+    ssize_t written = write(fd, buffer, recordSize);
+
+    if (written != (ssize_t)recordSize) {
+        close(bitsFd);
+        close(fd);
+        free(buffer);
+        free(center);
+        if (error_out) *error_out = formatString("Failed to append to %s: %s", vecPath, strerror(errno));
+        return -1;
+    }
+
+    if (haveSigns) {
+        memcpy(buffer, &epoch, sizeof(epoch));
+        signBits(vector, center, dim, (uint64_t *)(void *)(buffer + sizeof(int64_t)));
+        off_t bitsOffset = (off_t)(signHeaderSize(dim) + count * bitsRecord);
+        if (pwrite(bitsFd, buffer, bitsRecord, bitsOffset) != (ssize_t)bitsRecord) {
+            /* The next append backfills the missing sign record from memory.vec. */
+        }
+    }
+    close(bitsFd);
+    close(fd);
+    free(buffer);
+    free(center);
+    return 0;
+}
+
+/* Eight-lane dot product via GCC vector extensions; lowers to SSE/AVX/NEON as the target allows. */
+static float dotProduct(const float *a, const float *b, uint32_t dim) {
+    MemoryVec8 acc0 = { 0 };
+    MemoryVec8 acc1 = { 0 };
+    uint32_t i = 0;
+    for (; i + 16 <= dim; i += 16) {
+        MemoryVec8 a0, a1, b0, b1;
+        memcpy(&a0, a + i, sizeof(a0));
+        memcpy(&a1, a + i + 8, sizeof(a1));
+        memcpy(&b0, b + i, sizeof(b0));
+        memcpy(&b1, b + i + 8, sizeof(b1));
+        acc0 += a0 * b0;
+        acc1 += a1 * b1;
+    }
+    acc0 += acc1;
+
+    float sum = 0.0f;
+    for (int lane = 0; lane < 8; ++lane) {
+        sum += acc0[lane];
+    }
+    for (; i < dim; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void insertHit(MemoryVectorHit *hits, size_t *found, size_t maxHits, uint64_t id, float similarity) {
+    if (*found == maxHits && similarity <= hits[*found - 1].similarity) return;
+
+    size_t pos = *found < maxHits ? (*found)++ : maxHits - 1;
+    while (pos > 0 && hits[pos - 1].similarity < similarity) {
+        hits[pos] = hits[pos - 1];
+        pos--;
+    }
+    hits[pos].id = id;
+    hits[pos].similarity = similarity;
+}
+
+typedef struct {
+    uint32_t distance;
+    uint32_t record;
+} MemorySignCandidate;
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target_clones("popcnt", "default")))
+#endif
+static size_t scanSignBits(const char *records, size_t count, size_t words, const uint64_t *queryBits,
+                           int64_t since, int64_t until, MemorySignCandidate *best, size_t maxBest) {
+    size_t stride = sizeof(int64_t) + words * sizeof(uint64_t);
+    size_t found = 0;
+    for (size_t r = 0; r < count; ++r) {
+        const char *record = records + r * stride;
+        int64_t epoch;
+        memcpy(&epoch, record, sizeof(epoch));
+        if ((since && epoch < since) || (until && epoch > until)) continue;
+
+        uint32_t distance = 0;
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t bits;
+            memcpy(&bits, record + sizeof(int64_t) + w * sizeof(uint64_t), sizeof(bits));
+            distance += (uint32_t)__builtin_popcountll(bits ^ queryBits[w]);
+        }
+        if (found == maxBest && distance >= best[found - 1].distance) continue;
+
+        size_t pos = found < maxBest ? found++ : maxBest - 1;
+        while (pos > 0 && best[pos - 1].distance > distance) {
+            best[pos] = best[pos - 1];
+            pos--;
+        }
+        best[pos].distance = distance;
+        best[pos].record = (uint32_t)r;
+    }
+    return found;
+}
+
+static void* mapFile(int fd, size_t *lenOut, int populate) {
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size <= sizeof(MemoryVectorHeader)) {
+        return NULL;
+    }
+
+    /* MAP_POPULATE maps the page-cached file in one pass instead of faulting it in 4 KiB at a time. */
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+    if (map == MAP_FAILED) return NULL;
+    *lenOut = (size_t)st.st_size;
+    return map;
+}
+
+/*
+ * Small stores are scanned exactly. Past MEMORY_VECTOR_EXACT_LIMIT records the
+ * sign-bit sidecar (dim/8 bytes per memory) is Hamming-scanned first and only
+ * the closest MEMORY_VECTOR_RERANK_FACTOR * maxHits records are reranked with
+ * full-precision dot products, so most of memory.vec is never touched. Both
+ * files are mapped and scanned under a shared flock on memory.vec, so an
+ * append cannot truncate them underneath the scan.
+ */
+size_t memoryVectorSearch(const char *vecPath, float *query, uint32_t dim, int64_t since, int64_t until,
+                          MemoryVectorHit *hits, size_t maxHits) {
+    if (maxHits == 0) return 0;
+
+    int vecFd = open(vecPath, O_RDONLY | O_CLOEXEC);
+    if (vecFd < 0) return 0;
+    while (flock(vecFd, LOCK_SH) != 0) {
+        if (errno != EINTR) {
+            close(vecFd);
+            return 0;
+        }
+    }
+
+    size_t vecLen = 0;
+    const char *vecMap = mapFile(vecFd, &vecLen, 0);
+    const MemoryVectorHeader *header = (const MemoryVectorHeader *)vecMap;
+    if (!vecMap || header->magic != MEMORY_VECTOR_MAGIC || header->dim != dim) {
+        if (vecMap) munmap((void *)vecMap, vecLen);
+        close(vecFd);
+        return 0;
+    }
+
+    normalizeVector(query, dim);
+    size_t recordSize = sizeof(MemoryVectorRecord) + (size_t)dim * sizeof(float);
+    size_t count = (vecLen - sizeof(MemoryVectorHeader)) / recordSize;
+    const char *records = vecMap + sizeof(MemoryVectorHeader);
+    size_t words = signWords(dim);
+    size_t found = 0;
+
+    size_t bitsLen = 0;
+    char *bitsPath = count > MEMORY_VECTOR_EXACT_LIMIT ? sidecarPath(vecPath) : NULL;
+    int bitsFd = bitsPath ? open(bitsPath, O_RDONLY | O_CLOEXEC) : -1;
+    free(bitsPath);
+    const char *bitsMap = mapFile(bitsFd, &bitsLen, 1);
+    if (bitsFd >= 0) close(bitsFd);
+    const MemoryVectorHeader *bitsHeader = (const MemoryVectorHeader *)bitsMap;
+    size_t headerSize = signHeaderSize(dim);
+    int bitsValid = bitsMap && bitsLen >= headerSize && bitsHeader->magic == MEMORY_VECTOR_MAGIC &&
+                    bitsHeader->version == MEMORY_VECTOR_BITS_VERSION && bitsHeader->dim == dim;
+    size_t bitsCount = bitsValid ? (bitsLen - headerSize) / (sizeof(int64_t) + words * sizeof(uint64_t)) : 0;
+
+    size_t maxBest = maxHits * MEMORY_VECTOR_RERANK_FACTOR;
+    MemorySignCandidate *best = bitsMap && bitsCount == count ? malloc(maxBest * sizeof(MemorySignCandidate)) : NULL;
+    uint64_t *queryBits = best ? malloc(words * sizeof(uint64_t)) : NULL;
+
+    if (best && queryBits) {
+        signBits(query, (const float *)(const void *)(bitsMap + sizeof(MemoryVectorHeader)), dim, queryBits);
+        size_t candidates = scanSignBits(bitsMap + headerSize, bitsCount, words, queryBits, since, until, best, maxBest);
+        for (size_t i = 0; i < candidates; ++i) {
+            const char *record = records + (size_t)best[i].record * recordSize;
+            MemoryVectorRecord meta;
+            memcpy(&meta, record, sizeof(meta));
+            insertHit(hits, &found, maxHits, meta.id, dotProduct(query, (const float *)(record + sizeof(meta)), dim));
+        }
+    } else {
+        madvise((void *)vecMap, vecLen, MADV_SEQUENTIAL);
+        for (size_t r = 0; r < count; ++r) {
+            const char *record = records + r * recordSize;
+            MemoryVectorRecord meta;
+            memcpy(&meta, record, sizeof(meta));
+            if ((since && meta.epoch < since) || (until && meta.epoch > until)) continue;
+            insertHit(hits, &found, maxHits, meta.id, dotProduct(query, (const float *)(record + sizeof(meta)), dim));
+        }
+    }
+
+    free(best);
+    free(queryBits);
+    if (bitsMap) munmap((void *)bitsMap, bitsLen);
+    munmap((void *)vecMap, vecLen);
+    close(vecFd);
+    return found;
+}
@@ -0,0 +1,25 @@
+#ifndef TOOLS_MEMORY_VECTOR_H
+#define TOOLS_MEMORY_VECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * memory.vec holds one unit-length embedding per memory id:
+ *   header {magic, version, dim, reserved}
+ *   records {uint64 id, int64 epoch, float v[dim]} in append order
+ * Cosine similarity is a plain dot product over the mmap'ed records.
+ * memory.vec.bits mirrors it with one sign bit per dimension, taken around
+ * the mean of the store, for prefiltering.
+ */
+typedef struct {
+    uint64_t id;
+    float similarity;
+} MemoryVectorHit;
+
+int memoryEmbed(const char *escapedText, float **vectorOut, uint32_t *dimOut, char **error_out);
+int memoryVectorAppend(const char *vecPath, uint64_t id, int64_t epoch, float *vector, uint32_t dim, char **error_out);
+size_t memoryVectorSearch(const char *vecPath, float *query, uint32_t dim, int64_t since, int64_t until,
+                          MemoryVectorHit *hits, size_t maxHits);
+
+#endif
@@ -0,0 +1,447 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "tools/player.h"
+#include "tools/speech.h"
+
+#define PLAYER_IDLE_EXIT_MS (5 * 60 * 1000)
+#define PLAYER_STARTUP_MS 3000
+#define PLAYER_REQUEST_MAX (1024 * 1024)
+
+typedef enum {
+    PLAYER_ITEM_FILE,
+    PLAYER_ITEM_SPEECH
+} PlayerItemKind;
+
+typedef struct PlayerItem {
+    PlayerItemKind kind;
+    double speed;
+    char *path;
+    char *text;
+    struct PlayerItem *next;
+} PlayerItem;
+
+typedef struct {
+    PlayerItem *head;
+    PlayerItem *tail;
+    size_t queued;
+    PlayerItem *current;
+    pid_t currentPid;
+    struct timespec currentStart;
+} PlayerQueue;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static char* formatString(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0) {
+        return NULL;
+    }
+
+    char *buffer = malloc((size_t)needed + 1);
+    if (!buffer) return NULL;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, (size_t)needed + 1, fmt, args);
+    va_end(args);
+
+    return buffer;
+}
+
+static double elapsedMs(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int playerPaths(struct sockaddr_un *addr, char **lockPathOut) {
+    char *dir = get_ai_dir("player");
+    if (!dir) return -1;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    int len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/player.sock", dir);
+    *lockPathOut = formatString("%s/player.lock", dir);
+    free(dir);
+    if (len < 0 || (size_t)len >= sizeof(addr->sun_path) || !*lockPathOut) {
+        free(*lockPathOut);
+        *lockPathOut = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void freeItem(PlayerItem *item) {
+    if (!item) return;
+    free(item->path);
+    free(item->text);
+    free(item);
+}
+
+static char* describeItem(const PlayerItem *item) {
+    if (item->kind == PLAYER_ITEM_FILE) {
+        return formatString("%s (%.1fx)", item->path, item->speed);
+    }
+    size_t len = strlen(item->text);
+    return formatString("speech \"%.*s%s\" (%.1fx)", len > 48 ? 48 : (int)len, item->text, len > 48 ? "..." : "", item->speed);
+}
+
+static void startNext(PlayerQueue *queue, const sigset_t *originalMask) {
+    while (!queue->current && queue->head) {
+        PlayerItem *item = queue->head;
+        queue->head = item->next;
+        if (!queue->head) queue->tail = NULL;
+        queue->queued--;
+        item->next = NULL;
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            setpgid(0, 0);
+            sigprocmask(SIG_SETMASK, originalMask, NULL);
+            if (item->kind == PLAYER_ITEM_FILE) {
+                char speed[48];
+                snprintf(speed, sizeof(speed), "--speed=%.2f", item->speed);
+                execlp("mpv", "mpv", "--no-video", "--really-quiet", "--loop-playlist=no", speed, item->path, (char *)NULL);
+                _exit(127);
+            }
+            _exit(speechPlayPipelined(item->text, item->speed, item->path, NULL, NULL) == 0 ? 0 : 1);
+        }
+        if (pid < 0) {
+            freeItem(item);
+            continue;
+        }
+        setpgid(pid, pid);
+        queue->current = item;
+        queue->currentPid = pid;
+        clock_gettime(CLOCK_MONOTONIC, &queue->currentStart);
+    }
+}
+
+static void stopCurrent(PlayerQueue *queue) {
+    if (queue->currentPid > 0) {
+        kill(-queue->currentPid, SIGTERM);
+    }
+}
+
+static char* renderStatus(const PlayerQueue *queue) {
+    char *text = queue->current
+        ? NULL
+        : formatString("Idle.%s\n", queue->queued ? "" : " Queue is empty.");
+    if (queue->current) {
+        char *desc = describeItem(queue->current);
+        text = formatString("Playing: %s, %.0f s in.\nQueued: %zu\n", desc ? desc : "?", elapsedMs(&queue->currentStart) / 1000.0, queue->queued);
+        free(desc);
+    }
+
+    size_t position = 1;
+    for (const PlayerItem *item = queue->head; item && text; item = item->next, ++position) {
+        char *desc = describeItem(item);
+        char *grown = formatString("%s  %zu. %s\n", text, position, desc ? desc : "?");
+        free(desc);
+        free(text);
+        text = grown;
+    }
+    return text;
+}
+
+/*
+ * Requests are "file\n<speed>\n<path>", "speech\n<speed>\n<savePath>\n<text>",
+ * "status", "skip" or "stop"; the reply is plain text.
+ */
+static char* handleRequest(PlayerQueue *queue, char *request, const sigset_t *originalMask) {
+    char *save = NULL;
+    char *command = strtok_r(request, "\n", &save);
+    if (!command) return duplicateString("Empty player request.\n");
+
+    if (strcmp(command, "status") == 0) {
+        return renderStatus(queue);
+    }
+    if (strcmp(command, "skip") == 0) {
+        if (!queue->current) return duplicateString("Nothing is playing.\n");
+        stopCurrent(queue);
+        return formatString("Skipped. %zu item%s queued.\n", queue->queued, queue->queued == 1 ? "" : "s");
+    }
+    if (strcmp(command, "stop") == 0) {
+        size_t dropped = queue->queued;
+        while (queue->head) {
+            PlayerItem *next = queue->head->next;
+            freeItem(queue->head);
+            queue->head = next;
+        }
+        queue->tail = NULL;
+        queue->queued = 0;
+        stopCurrent(queue);
+        return formatString("Stopped playback and cleared %zu queued item%s.\n", dropped, dropped == 1 ? "" : "s");
+    }
+
+    int isFile = strcmp(command, "file") == 0;
+    if (!isFile && strcmp(command, "speech") != 0) {
+        return formatString("Unknown player command '%s'.\n", command);
+    }
+    char *speed = strtok_r(NULL, "\n", &save);
+    char *path = strtok_r(NULL, isFile ? "" : "\n", &save);
+    char *text = isFile ? NULL : save;
+    PlayerItem *item = calloc(1, sizeof(PlayerItem));
+    if (!item || !speed || !path || (!isFile && (!text || !*text))) {
+        free(item);
+        return duplicateString("Malformed player request.\n");
+    }
+    item->kind = isFile ? PLAYER_ITEM_FILE : PLAYER_ITEM_SPEECH;
+    item->speed = atof(speed) > 0.0 ? atof(speed) : 1.0;
+    item->path = strcmp(path, "-") == 0 ? NULL : duplicateString(path);
+    item->text = text ? duplicateString(text) : NULL;
+
+    if (queue->tail) {
+        queue->tail->next = item;
+    } else {
+        queue->head = item;
+    }
+    queue->tail = item;
+    queue->queued++;
+    size_t ahead = queue->queued - 1 + (queue->current ? 1 : 0);
+    startNext(queue, originalMask);
+    return ahead ? formatString("Queued behind %zu item%s.\n", ahead, ahead == 1 ? "" : "s")
+                 : duplicateString("Playing now.\n");
+}
+
+static char* readAll(int fd, size_t limit) {
+    size_t cap = 1024;
+    size_t len = 0;
+    char *buffer = malloc(cap);
+    while (buffer) {
+        if (len + 1 == cap) {
+            if (cap >= limit) break;
+            char *resized = realloc(buffer, cap * 2);
+            if (!resized) break;
+            buffer = resized;
+            cap *= 2;
+        }
+        ssize_t got = read(fd, buffer + len, cap - len - 1);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            buffer[len] = '\0';
+            return got == 0 ? buffer : (free(buffer), NULL);
+        }
+        len += (size_t)got;
+    }
+    free(buffer);
+    return NULL;
+}
+
+static void serveOneClient(PlayerQueue *queue, int listenFd, const sigset_t *originalMask) {
+    int client = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+    if (client < 0) return;
+
+    struct timeval timeout = { 5, 0 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char *request = readAll(client, PLAYER_REQUEST_MAX);
+    char *reply = request ? handleRequest(queue, request, originalMask) : NULL;
+    if (reply) {
+        size_t len = strlen(reply);
+        if (send(client, reply, len, MSG_NOSIGNAL) < 0) {
+            /* Client went away; nothing to report to. */
+        }
+    }
+    free(reply);
+    free(request);
+    close(client);
+}
+
+/* The daemon is single-threaded: one poll over the socket and a SIGCHLD signalfd. */
+static void runDaemon(int listenFd, const char *socketPath) {
+    sigset_t childMask;
+    sigset_t originalMask;
+    sigemptyset(&childMask);
+    sigaddset(&childMask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childMask, &originalMask);
+    int childFd = signalfd(-1, &childMask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    PlayerQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    struct timespec idleSince;
+    clock_gettime(CLOCK_MONOTONIC, &idleSince);
+
+    for (;;) {
+        struct pollfd fds[2] = { { listenFd, POLLIN, 0 }, { childFd, POLLIN, 0 } };
+        int ready = poll(fds, childFd >= 0 ? 2 : 1, queue.current || childFd < 0 ? 1000 : PLAYER_IDLE_EXIT_MS);
+        if (ready < 0 && errno != EINTR) break;
+
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            struct signalfd_siginfo info;
+            while (read(childFd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+            }
+        }
+        pid_t done;
+        while ((done = waitpid(-1, NULL, WNOHANG)) > 0) {
+            if (done == queue.currentPid) {
+                freeItem(queue.current);
+                queue.current = NULL;
+                queue.currentPid = 0;
+                clock_gettime(CLOCK_MONOTONIC, &idleSince);
+            }
+        }
+        startNext(&queue, &originalMask);
+
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            serveOneClient(&queue, listenFd, &originalMask);
+            clock_gettime(CLOCK_MONOTONIC, &idleSince);
+        }
+        if (!queue.current && !queue.head && elapsedMs(&idleSince) >= PLAYER_IDLE_EXIT_MS) {
+            break;
+        }
+    }
+
+    unlink(socketPath);
+    _exit(0);
+}
+
+static int connectPlayer(const struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Double-forks the daemon under an flock so racing tools start only one. */
+static int spawnPlayer(const struct sockaddr_un *addr, const char *lockPath) {
+    int lockFd = open(lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX) != 0) {
+        if (lockFd >= 0) close(lockFd);
+        return -1;
+    }
+
+    int fd = connectPlayer(addr);
+    if (fd >= 0) {
+        close(lockFd);
+        return fd;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (fork() != 0) _exit(0);
+        setsid();
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            if (devnull > STDERR_FILENO) close(devnull);
+        }
+        for (int other = STDERR_FILENO + 1; other < 1024; ++other) {
+            close(other);
+        }
+
+        int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(addr->sun_path);
+        if (listenFd < 0 || bind(listenFd, (const struct sockaddr *)addr, sizeof(*addr)) != 0 || listen(listenFd, 16) != 0) {
+            _exit(1);
+        }
+        runDaemon(listenFd, addr->sun_path);
+    }
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while ((fd = connectPlayer(addr)) < 0 && elapsedMs(&start) < PLAYER_STARTUP_MS) {
+            struct timespec pause = { 0, 10 * 1000000L };
+            nanosleep(&pause, NULL);
+        }
+    }
+    close(lockFd);
+    return fd;
+}
+
+static int playerRequest(const char *request, int spawn, char **replyOut, char **error_out) {
+    struct sockaddr_un addr;
+    char *lockPath = NULL;
+    if (playerPaths(&addr, &lockPath) != 0) {
+        if (error_out) *error_out = duplicateString("Failed to prepare ~/.gipwrap/player.");
+        return -1;
+    }
+
+    int fd = connectPlayer(&addr);
+    if (fd < 0 && !spawn) {
+        free(lockPath);
+        *replyOut = duplicateString("Nothing is playing.\n");
+        return *replyOut ? 0 : -1;
+    }
+    if (fd < 0) fd = spawnPlayer(&addr, lockPath);
+    free(lockPath);
+    if (fd < 0) {
+        if (error_out) *error_out = duplicateString("Failed to start the background audio player.");
+        return -1;
+    }
+
+    size_t len = strlen(request);
+    char *reply = NULL;
+    if (send(fd, request, len, MSG_NOSIGNAL) == (ssize_t)len && shutdown(fd, SHUT_WR) == 0) {
+        reply = readAll(fd, PLAYER_REQUEST_MAX);
+    }
+    close(fd);
+    if (!reply) {
+        if (error_out) *error_out = duplicateString("The background audio player did not answer.");
+        return -1;
+    }
+    *replyOut = reply;
+    return 0;
+}
+
+int playerEnqueueFile(const char *path, double speed, char **replyOut, char **error_out) {
+    char *request = formatString("file\n%.2f\n%s", speed, path);
+    if (!request) {
+        if (error_out) *error_out = duplicateString("Out of memory while queueing audio.");
+        return -1;
+    }
+    int ret = playerRequest(request, 1, replyOut, error_out);
+    free(request);
+    return ret;
+}
+
+int playerEnqueueSpeech(const char *text, double speed, const char *savePath, char **replyOut, char **error_out) {
+    char *request = formatString("speech\n%.2f\n%s\n%s", speed, savePath && *savePath ? savePath : "-", text);
+    if (!request) {
+        if (error_out) *error_out = duplicateString("Out of memory while queueing speech.");
+        return -1;
+    }
+    int ret = playerRequest(request, 1, replyOut, error_out);
+    free(request);
+    return ret;
+}
+
+int playerControl(const char *command, char **replyOut, char **error_out) {
+    if (strcmp(command, "status") != 0 && strcmp(command, "skip") != 0 && strcmp(command, "stop") != 0) {
+        if (error_out) *error_out = formatString("Unknown playback command '%s'. Use status, skip or stop.", command);
+        return -1;
+    }
+    return playerRequest(command, 0, replyOut, error_out);
+}
@@ -0,0 +1,14 @@
+#ifndef TOOLS_PLAYER_H
+#define TOOLS_PLAYER_H
+
+/*
+ * Audio plays in a background daemon (started on demand, exits when idle)
+ * listening on ~/.gipwrap/player/player.sock, so tools return as soon as the
+ * item is queued. Items play one at a time in a process group that skip and
+ * stop can kill.
+ */
+int playerEnqueueFile(const char *path, double speed, char **replyOut, char **error_out);
+int playerEnqueueSpeech(const char *text, double speed, const char *savePath, char **replyOut, char **error_out);
+int playerControl(const char *command, char **replyOut, char **error_out);
+
+#endif
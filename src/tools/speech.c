@@ -0,0 +1,826 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "ai_core/deadline.h"
+#include "tools/speech.h"
+
+#define SPEECH_DEFAULT_VOICE "cmu_us_slt_arctic_hts"
+#define SPEECH_DEFAULT_PORT 1314
+#define SPEECH_SERVER_STARTUP_MS 15000
+#define SPEECH_SERVER_TIMEOUT_S 60
+#define SPEECH_FILE_KEY "ft_StUfF_key"
+#define SPEECH_CACHE_DEFAULT_MB 256
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static char* formatString(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0) {
+        return NULL;
+    }
+
+    char *buffer = malloc((size_t)needed + 1);
+    if (!buffer) return NULL;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, (size_t)needed + 1, fmt, args);
+    va_end(args);
+
+    return buffer;
+}
+
+static double elapsedMs(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static const char* speechVoice(void) {
+    const char *voice = getenv("GIPWRAP_TTS_VOICE");
+    return voice && *voice ? voice : SPEECH_DEFAULT_VOICE;
+}
+
+static int speechPort(void) {
+    const char *port = getenv("GIPWRAP_TTS_PORT");
+    int value = port ? atoi(port) : 0;
+    return value > 0 && value < 65536 ? value : SPEECH_DEFAULT_PORT;
+}
+
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static char* cachePathFor(const char *voice, const char *text) {
+    char *dir = get_ai_dir("tts");
+    if (!dir) return NULL;
+    char *cacheDir = formatString("%s/cache", dir);
+    free(dir);
+    if (!cacheDir || (mkdir(cacheDir, 0700) != 0 && errno != EEXIST)) {
+        free(cacheDir);
+        return NULL;
+    }
+
+    uint64_t hash = fnv1a(0xcbf29ce484222325ULL, voice, strlen(voice) + 1);
+    hash = fnv1a(hash, text, strlen(text));
+    char *path = formatString("%s/%016llx.wav", cacheDir, (unsigned long long)hash);
+    free(cacheDir);
+    return path;
+}
+
+typedef struct {
+    char *path;
+    off_t size;
+    time_t mtime;
+} CacheEntry;
+
+static int compareCacheAge(const void *a, const void *b) {
+    const CacheEntry *left = a;
+    const CacheEntry *right = b;
+    return left->mtime < right->mtime ? -1 : left->mtime > right->mtime ? 1 : 0;
+}
+
+/*
+ * Keeps the WAV cache under GIPWRAP_TTS_CACHE_MB (default 256; 0 disables
+ * the cap) by deleting the least recently used entries. Hits refresh the
+ * mtime, so it tracks last use. keepPath, the entry just stored, survives.
+ */
+static void trimCache(const char *keepPath) {
+    const char *limit = getenv("GIPWRAP_TTS_CACHE_MB");
+    long capMb = limit && *limit ? atol(limit) : SPEECH_CACHE_DEFAULT_MB;
+    if (capMb <= 0) return;
+    off_t cap = (off_t)capMb * 1024 * 1024;
+
+    const char *slash = strrchr(keepPath, '/');
+    char *dirPath = slash ? formatString("%.*s", (int)(slash - keepPath), keepPath) : NULL;
+    DIR *dir = dirPath ? opendir(dirPath) : NULL;
+    if (!dir) {
+        free(dirPath);
+        return;
+    }
+
+    CacheEntry *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    off_t total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t nameLen = strlen(entry->d_name);
+        if (nameLen < 4 || strcmp(entry->d_name + nameLen - 4, ".wav") != 0) continue;
+        char *path = formatString("%s/%s", dirPath, entry->d_name);
+        struct stat info;
+        if (!path || stat(path, &info) != 0) {
+            free(path);
+            continue;
+        }
+        if (count == capacity) {
+            size_t newCapacity = capacity ? capacity * 2 : 64;
+            CacheEntry *resized = realloc(entries, newCapacity * sizeof(CacheEntry));
+            if (!resized) {
+                free(path);
+                break;
+            }
+            entries = resized;
+            capacity = newCapacity;
+        }
+        entries[count].path = path;
+        entries[count].size = info.st_size;
+        entries[count].mtime = info.st_mtime;
+        count++;
+        total += info.st_size;
+    }
+    closedir(dir);
+
+    if (total > cap) {
+        qsort(entries, count, sizeof(CacheEntry), compareCacheAge);
+        for (size_t i = 0; i < count && total > cap; ++i) {
+            if (strcmp(entries[i].path, keepPath) == 0) continue;
+            if (unlink(entries[i].path) == 0) total -= entries[i].size;
+        }
+    }
+    for (size_t i = 0; i < count; ++i) free(entries[i].path);
+    free(entries);
+    free(dirPath);
+}
+
+static int connectServer(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    /* A wedged server must not hang the agent forever. */
+    struct timeval timeout = { SPEECH_SERVER_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+/*
+ * Starts festival detached (double fork + setsid) with the voice preloaded,
+ * under an flock so concurrent callers spawn one server, then waits for the
+ * port to accept. festival forks per client, so every request gets a warm voice.
+ */
+static int startServer(const char *voice, int port) {
+    char *dir = get_ai_dir("tts");
+    if (!dir) return -1;
+    char *lockPath = formatString("%s/server.lock", dir);
+    char *initPath = formatString("%s/server.scm", dir);
+    char *logPath = formatString("%s/server.log", dir);
+    free(dir);
+
+    char *initTmpPath = initPath ? formatString("%s.XXXXXX", initPath) : NULL;
+    int lockFd = lockPath ? open(lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600) : -1;
+    FILE *init = NULL;
+    int fd = -1;
+    if (lockFd < 0 || !initTmpPath || !logPath || flock(lockFd, LOCK_EX) != 0) {
+        goto done;
+    }
+
+    fd = connectServer(port);
+    if (fd >= 0) {
+        goto done;
+    }
+
+    /* Written aside and renamed under the lock, so a festival still loading the old file never reads a truncated one. */
+    int initFd = mkstemp(initTmpPath);
+    init = initFd >= 0 ? fdopen(initFd, "w") : NULL;
+    if (!init) {
+        if (initFd >= 0) close(initFd);
+        goto done;
+    }
+    fprintf(init, "(set! server_port %d)\n(set! server_access_list '(\"localhost\" \"127.0.0.1\"))\n(voice_%s)\n", port, voice);
+    int written = fclose(init) == 0;
+    init = NULL;
+    if (!written || rename(initTmpPath, initPath) != 0) {
+        unlink(initTmpPath);
+        goto done;
+    }
+
+    /* The grandchild reports its pid, then exec failure (if any) over a close-on-exec pipe. */
+    int report[2];
+    if (pipe2(report, O_CLOEXEC) != 0) {
+        goto done;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(report[0]);
+        if (fork() != 0) _exit(0);
+        setsid();
+        pid_t self = getpid();
+        if (write(report[1], &self, sizeof(self)) != (ssize_t)sizeof(self)) _exit(127);
+        int devnull = open("/dev/null", O_RDONLY);
+        int log = open(logPath, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (devnull >= 0) dup2(devnull, STDIN_FILENO);
+        if (log >= 0) {
+            dup2(log, STDOUT_FILENO);
+            dup2(log, STDERR_FILENO);
+        }
+        execlp("festival", "festival", "--server", initPath, (char *)NULL);
+        int err = errno;
+        if (write(report[1], &err, sizeof(err)) < 0) _exit(127);
+        _exit(127);
+    }
+    close(report[1]);
+    pid_t server = -1;
+    int execError = 0;
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        if (read(report[0], &server, sizeof(server)) != (ssize_t)sizeof(server)) server = -1;
+        if (server > 0 && read(report[0], &execError, sizeof(execError)) > 0) server = -1;
+    }
+    close(report[0]);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (server > 0 && fd < 0 && elapsedMs(&start) < SPEECH_SERVER_STARTUP_MS) {
+        struct timespec pause = { 0, 50 * 1000000L };
+        nanosleep(&pause, NULL);
+        fd = connectServer(port);
+        if (fd < 0 && kill(server, 0) != 0) break;
+    }
+
+done:
+    if (init) fclose(init);
+    if (lockFd >= 0) close(lockFd);
+    free(lockPath);
+    free(initPath);
+    free(initTmpPath);
+    free(logPath);
+    return fd;
+}
+
+/* Reads a festival file payload, undoing the 'X' stuffing of in-band key bytes. */
+static int readStuffedPayload(FILE *in, FILE *out) {
+    const char *key = SPEECH_FILE_KEY;
+    size_t keyLen = strlen(key);
+    size_t matched = 0;
+    int c;
+    while ((c = getc_unlocked(in)) != EOF) {
+        if ((char)c == key[matched]) {
+            if (++matched == keyLen) return 0;
+            continue;
+        }
+        if (c == 'X' && matched + 1 == keyLen) {
+            fwrite(key, 1, matched, out);
+            matched = 0;
+            continue;
+        }
+        /* No rematch of c against key[0]: the server's stuffing scan restarts the same way. */
+        fwrite(key, 1, matched, out);
+        matched = 0;
+        putc_unlocked(c, out);
+    }
+    return -1;
+}
+
+static void writeLispString(FILE *out, const char *text) {
+    putc('"', out);
+    for (const char *p = text; *p; ++p) {
+        if (*p == '"' || *p == '\\') putc('\\', out);
+        putc(*p, out);
+    }
+    putc('"', out);
+}
+
+/* Sends one utterance and copies the RIFF reply into out; acks are WV, LP, ER and OK. */
+static int synthesizeWithServer(const char *voice, const char *text, FILE *out, char **error_out) {
+    int port = speechPort();
+    int fd = connectServer(port);
+    if (fd < 0) fd = startServer(voice, port);
+    if (fd < 0) {
+        if (error_out) *error_out = formatString("festival server unavailable on port %d.", port);
+        return -1;
+    }
+
+    char *request = NULL;
+    size_t requestLen = 0;
+    FILE *requestStream = open_memstream(&request, &requestLen);
+    if (requestStream) {
+        fprintf(requestStream, "(Parameter.set 'Wavefiletype 'riff)\n(utt.send.wave.client (utt.synth (Utterance Text ");
+        writeLispString(requestStream, text);
+        fprintf(requestStream, ")))\n");
+        fclose(requestStream);
+    }
+    /* MSG_NOSIGNAL: a server that died mid-request must not SIGPIPE the agent. */
+    int sent = request && send(fd, request, requestLen, MSG_NOSIGNAL) == (ssize_t)requestLen;
+    free(request);
+    FILE *conn = sent ? fdopen(fd, "r") : NULL;
+    if (!conn) {
+        close(fd);
+        if (error_out) *error_out = duplicateString("Failed to send the festival request.");
+        return -1;
+    }
+
+    int commands = 2;
+    int gotWave = 0;
+    int ret = 0;
+    char ack[4] = { 0 };
+    while (commands > 0 && ret == 0) {
+        if (fread(ack, 1, 3, conn) != 3) {
+            ret = -1;
+            break;
+        }
+        if (strncmp(ack, "WV\n", 3) == 0) {
+            ret = readStuffedPayload(conn, out);
+            gotWave = ret == 0;
+        } else if (strncmp(ack, "LP\n", 3) == 0) {
+            FILE *sink = fopen("/dev/null", "w");
+            ret = sink ? readStuffedPayload(conn, sink) : -1;
+            if (sink) fclose(sink);
+        } else if (strncmp(ack, "OK\n", 3) == 0) {
+            commands--;
+        } else {
+            ret = -1;
+        }
+    }
+    fclose(conn);
+
+    if (ret != 0 || !gotWave) {
+        if (error_out) *error_out = duplicateString("festival server did not return audio.");
+        return -1;
+    }
+    return 0;
+}
+
+static int synthesizeWithText2Wave(const char *voice, const char *text, const char *outPath, char **error_out) {
+    char textPath[] = "/tmp/gipwrap_tts_XXXXXX";
+    int fd = mkstemp(textPath);
+    if (fd < 0) {
+        if (error_out) *error_out = duplicateString("Failed to create temporary file for TTS input.");
+        return -1;
+    }
+    deadlineTrackPath(textPath);
+    size_t len = strlen(text);
+    ssize_t written = write(fd, text, len);
+    close(fd);
+    if (written != (ssize_t)len) {
+        deadlineUntrackPath(textPath);
+        unlink(textPath);
+        if (error_out) *error_out = duplicateString("Failed to write TTS input.");
+        return -1;
+    }
+
+    char *voiceExpr = formatString("(voice_%s)", voice);
+    pid_t pid = voiceExpr ? fork() : -1;
+    if (pid == 0) {
+        setpgid(0, 0);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        execlp("text2wave", "text2wave", "-eval", voiceExpr, textPath, "-o", outPath, (char *)NULL);
+        _exit(127);
+    }
+
+    if (pid > 0) {
+        setpgid(pid, pid);
+        deadlineTrackChild(pid);
+    }
+
+    int status = 0;
+    int ok = pid > 0 && deadlineWaitChild(pid, &status) == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    free(voiceExpr);
+    deadlineUntrackPath(textPath);
+    unlink(textPath);
+    if (!ok) {
+        if (error_out) *error_out = duplicateString("text2wave failed; is festival installed?");
+        return -1;
+    }
+    return 0;
+}
+
+int speechSynthesizeCached(const char *text, char **wavPathOut, char **summaryOut, char **error_out) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const char *voice = speechVoice();
+    char *cachePath = cachePathFor(voice, text);
+    if (!cachePath) {
+        if (error_out) *error_out = duplicateString("Failed to prepare the TTS cache directory.");
+        return -1;
+    }
+
+    const char *engine = "cache";
+    if (access(cachePath, R_OK) != 0) {
+        char *tmpPath = formatString("%s.%ld.tmp", cachePath, (long)getpid());
+        char *failure = NULL;
+        int ret = -1;
+        FILE *out = tmpPath ? fopen(tmpPath, "wb") : NULL;
+        if (out) {
+            engine = "festival server";
+            ret = synthesizeWithServer(voice, text, out, &failure);
+            if (fclose(out) != 0) ret = -1;
+        }
+        if (ret != 0 && tmpPath) {
+            free(failure);
+            failure = NULL;
+            engine = "text2wave";
+            ret = synthesizeWithText2Wave(voice, text, tmpPath, &failure);
+        }
+        if (ret == 0 && rename(tmpPath, cachePath) != 0) {
+            failure = formatString("Failed to store %s: %s", cachePath, strerror(errno));
+            ret = -1;
+        }
+        if (ret != 0) {
+            if (tmpPath) unlink(tmpPath);
+            if (error_out) {
+                *error_out = failure ? failure : duplicateString("Speech synthesis failed.");
+            } else {
+                free(failure);
+            }
+            free(tmpPath);
+            free(cachePath);
+            return -1;
+        }
+        free(tmpPath);
+        trimCache(cachePath);
+    } else {
+        utimensat(AT_FDCWD, cachePath, NULL, 0);
+    }
+
+    if (summaryOut) {
+        *summaryOut = formatString("Synthesized via %s in %.0f ms.", engine, elapsedMs(&start));
+    }
+    *wavPathOut = cachePath;
+    return 0;
+}
+
+typedef struct {
+    uint32_t rate;
+    uint16_t channels;
+    uint16_t bits;
+    char *data;
+    size_t len;
+} SpeechPcm;
+
+static uint32_t readLe32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t readLe16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+/* Pulls the fmt and data chunks out of a RIFF/WAVE file. */
+static int loadWavPcm(const char *path, SpeechPcm *pcm) {
+    memset(pcm, 0, sizeof(*pcm));
+    FILE *in = fopen(path, "rb");
+    if (!in) return -1;
+
+    unsigned char header[12];
+    if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        fclose(in);
+        return -1;
+    }
+
+    unsigned char chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), in) == sizeof(chunk)) {
+        uint32_t size = readLe32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            unsigned char fmt[16];
+            if (fread(fmt, 1, sizeof(fmt), in) != sizeof(fmt)) break;
+            pcm->channels = readLe16(fmt + 2);
+            pcm->rate = readLe32(fmt + 4);
+            pcm->bits = readLe16(fmt + 14);
+            if (fseek(in, (long)(size - 16 + (size & 1)), SEEK_CUR) != 0) break;
+        } else if (memcmp(chunk, "data", 4) == 0 && pcm->rate) {
+            pcm->data = malloc(size ? size : 1);
+            if (!pcm->data) break;
+            /* festival may leave the data size unset when streaming; read what is there. */
+            pcm->len = fread(pcm->data, 1, size, in);
+            fclose(in);
+            return pcm->len > 0 ? 0 : -1;
+        } else if (fseek(in, (long)(size + (size & 1)), SEEK_CUR) != 0) {
+            break;
+        }
+    }
+    fclose(in);
+    free(pcm->data);
+    pcm->data = NULL;
+    return -1;
+}
+
+static void writeLe32(FILE *out, uint32_t value) {
+    unsigned char b[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+    fwrite(b, 1, 4, out);
+}
+
+static void writeLe16(FILE *out, uint16_t value) {
+    unsigned char b[2] = { (unsigned char)value, (unsigned char)(value >> 8) };
+    fwrite(b, 1, 2, out);
+}
+
+static int writeWav(const char *path, const SpeechPcm *format, const SpeechPcm *parts, size_t count) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; ++i) total += parts[i].len;
+    if (total > UINT32_MAX - 36) return -1;
+
+    FILE *out = fopen(path, "wb");
+    if (!out) return -1;
+    uint16_t blockAlign = (uint16_t)(format->channels * format->bits / 8);
+    fwrite("RIFF", 1, 4, out);
+    writeLe32(out, (uint32_t)(36 + total));
+    fwrite("WAVEfmt ", 1, 8, out);
+    writeLe32(out, 16);
+    writeLe16(out, 1);
+    writeLe16(out, format->channels);
+    writeLe32(out, format->rate);
+    writeLe32(out, format->rate * blockAlign);
+    writeLe16(out, blockAlign);
+    writeLe16(out, format->bits);
+    fwrite("data", 1, 4, out);
+    writeLe32(out, (uint32_t)total);
+    for (size_t i = 0; i < count; ++i) {
+        fwrite(parts[i].data, 1, parts[i].len, out);
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+/*
+ * Splits text after sentence punctuation or line breaks. The first chunk is a
+ * single sentence so audio starts early; later ones are merged up to
+ * SPEECH_CHUNK_TARGET bytes to amortize the per-request overhead.
+ */
+#define SPEECH_CHUNK_TARGET 240
+
+static char** splitSentences(const char *text, size_t *countOut) {
+    size_t cap = 8;
+    size_t count = 0;
+    char **chunks = malloc(cap * sizeof(char *));
+    if (!chunks) return NULL;
+
+    const char *p = text;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+        if (!*p) break;
+
+        const char *start = p;
+        const char *end = p;
+        for (;;) {
+            while (*end && *end != '\n' && !((*end == '.' || *end == '!' || *end == '?') &&
+                   (end[1] == '\0' || end[1] == ' ' || end[1] == '\n' || end[1] == '"' || end[1] == ')' || end[1] == '\''))) {
+                end++;
+            }
+            while (*end == '.' || *end == '!' || *end == '?' || *end == '"' || *end == ')' || *end == '\'') end++;
+            if (count == 0 || !*end || (size_t)(end - start) >= SPEECH_CHUNK_TARGET / 2) break;
+            const char *next = end;
+            while (*next == ' ' || *next == '\n') next++;
+            const char *probe = strpbrk(next, ".!?\n");
+            size_t nextLen = probe ? (size_t)(probe - next) + 1 : strlen(next);
+            if ((size_t)(next - start) + nextLen > SPEECH_CHUNK_TARGET) break;
+            end = next;
+        }
+
+        if (count == cap) {
+            cap *= 2;
+            char **resized = realloc(chunks, cap * sizeof(char *));
+            if (!resized) break;
+            chunks = resized;
+        }
+        chunks[count] = formatString("%.*s", (int)(end - start), start);
+        if (!chunks[count]) break;
+        count++;
+        p = end;
+    }
+
+    *countOut = count;
+    return chunks;
+}
+
+typedef struct {
+    char **chunks;
+    size_t count;
+    SpeechPcm *pcm;
+    int *state;
+    char *error;
+    int cancel;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} SpeechPipeline;
+
+static void* synthesizeChunks(void *arg) {
+    SpeechPipeline *pipeline = arg;
+    for (size_t i = 0; i < pipeline->count; ++i) {
+        pthread_mutex_lock(&pipeline->lock);
+        int cancel = pipeline->cancel;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (cancel) break;
+
+        char *wavPath = NULL;
+        char *error = NULL;
+        SpeechPcm pcm;
+        int ok = speechSynthesizeCached(pipeline->chunks[i], &wavPath, NULL, &error) == 0 && loadWavPcm(wavPath, &pcm) == 0;
+        free(wavPath);
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (ok) {
+            pipeline->pcm[i] = pcm;
+            pipeline->state[i] = 1;
+        } else {
+            pipeline->state[i] = -1;
+            pipeline->error = error ? error : formatString("Could not decode synthesized audio for \"%s\".", pipeline->chunks[i]);
+            error = NULL;
+        }
+        pthread_cond_signal(&pipeline->ready);
+        pthread_mutex_unlock(&pipeline->lock);
+        free(error);
+        if (!ok) break;
+    }
+    return NULL;
+}
+
+static pid_t startPcmPlayer(const SpeechPcm *format, double speed, int *stdinOut) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+
+    char rate[48];
+    char channels[48];
+    char speedArg[48];
+    snprintf(rate, sizeof(rate), "--demuxer-rawaudio-rate=%u", format->rate);
+    snprintf(channels, sizeof(channels), "--demuxer-rawaudio-channels=%u", format->channels);
+    snprintf(speedArg, sizeof(speedArg), "--speed=%.2f", speed);
+    const char *sampleFormat = format->bits == 8 ? "--demuxer-rawaudio-format=u8" : "--demuxer-rawaudio-format=s16le";
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[0], STDIN_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        execlp("mpv", "mpv", "--no-video", "--really-quiet", "--demuxer=rawaudio", rate, channels, sampleFormat,
+               speedArg, "-", (char *)NULL);
+        _exit(127);
+    }
+    close(fds[0]);
+    if (pid < 0) {
+        close(fds[1]);
+        return -1;
+    }
+    *stdinOut = fds[1];
+    return pid;
+}
+
+static int writeAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return -1;
+        data += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+int speechPlayPipelined(const char *text, double speed, const char *savePath, char **summaryOut, char **error_out) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    SpeechPipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.chunks = splitSentences(text, &pipeline.count);
+    if (!pipeline.chunks || pipeline.count == 0) {
+        free(pipeline.chunks);
+        if (error_out) *error_out = duplicateString("Provide text to synthesize.");
+        return -1;
+    }
+    pipeline.pcm = calloc(pipeline.count, sizeof(SpeechPcm));
+    pipeline.state = calloc(pipeline.count, sizeof(int));
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.ready, NULL);
+
+    pthread_t producer;
+    int started = pipeline.pcm && pipeline.state && pthread_create(&producer, NULL, synthesizeChunks, &pipeline) == 0;
+
+    /* A player that exits early must surface as EPIPE, not kill the process. */
+    struct sigaction ignorePipe;
+    struct sigaction previousPipe;
+    memset(&ignorePipe, 0, sizeof(ignorePipe));
+    ignorePipe.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignorePipe, &previousPipe);
+
+    pid_t player = -1;
+    int playerIn = -1;
+    double firstAudioMs = -1.0;
+    char *failure = NULL;
+    size_t played = 0;
+    for (size_t i = 0; started && i < pipeline.count; ++i) {
+        pthread_mutex_lock(&pipeline.lock);
+        while (pipeline.state[i] == 0) {
+            pthread_cond_wait(&pipeline.ready, &pipeline.lock);
+        }
+        int state = pipeline.state[i];
+        if (state < 0) {
+            failure = pipeline.error;
+            pipeline.error = NULL;
+        }
+        pthread_mutex_unlock(&pipeline.lock);
+        if (state < 0) break;
+
+        const SpeechPcm *pcm = &pipeline.pcm[i];
+        if (pcm->rate != pipeline.pcm[0].rate || pcm->channels != pipeline.pcm[0].channels || pcm->bits != pipeline.pcm[0].bits) {
+            failure = duplicateString("Synthesized chunks disagree on sample format.");
+            break;
+        }
+        if (player < 0) {
+            player = startPcmPlayer(pcm, speed, &playerIn);
+            if (player < 0) {
+                failure = duplicateString("Failed to start mpv.");
+                break;
+            }
+            firstAudioMs = elapsedMs(&start);
+        }
+        if (writeAll(playerIn, pcm->data, pcm->len) != 0) {
+            failure = duplicateString("mpv exited before playback finished; is it installed?");
+            break;
+        }
+        played++;
+    }
+
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.cancel = 1;
+    pthread_mutex_unlock(&pipeline.lock);
+    if (started) pthread_join(producer, NULL);
+
+    if (playerIn >= 0) close(playerIn);
+    if (player > 0) {
+        int status = 0;
+        waitpid(player, &status, 0);
+        if (!failure && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            failure = duplicateString("mpv failed to play the synthesized audio; is it installed?");
+        }
+    }
+    sigaction(SIGPIPE, &previousPipe, NULL);
+
+    if (!started && !failure) {
+        failure = duplicateString("Failed to start the synthesis thread.");
+    }
+    if (!failure && savePath && played > 0 && writeWav(savePath, &pipeline.pcm[0], pipeline.pcm, played) != 0) {
+        failure = formatString("Failed to write %s: %s", savePath, strerror(errno));
+    }
+    if (!failure && summaryOut) {
+        *summaryOut = formatString("Played %zu chunk%s; first audio after %.0f ms, done after %.0f ms.",
+                                   played, played == 1 ? "" : "s", firstAudioMs, elapsedMs(&start));
+    }
+
+    for (size_t i = 0; i < pipeline.count; ++i) {
+        free(pipeline.chunks[i]);
+        if (pipeline.pcm) free(pipeline.pcm[i].data);
+    }
+    free(pipeline.chunks);
+    free(pipeline.pcm);
+    free(pipeline.state);
+    free(pipeline.error);
+    pthread_cond_destroy(&pipeline.ready);
+    pthread_mutex_destroy(&pipeline.lock);
+
+    if (failure) {
+        if (error_out) *error_out = failure;
+        else free(failure);
+        return -1;
+    }
+    return 0;
+}
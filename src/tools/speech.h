@@ -0,0 +1,21 @@
+#ifndef TOOLS_SPEECH_H
+#define TOOLS_SPEECH_H
+
+/*
+ * Speech is synthesized by a long-lived `festival --server` started on
+ * demand (port GIPWRAP_TTS_PORT, default 1314), so the voice is loaded once
+ * instead of per call. Finished WAVs are cached in ~/.gipwrap/tts/cache under
+ * a hash of voice and text, least recently used first out past
+ * GIPWRAP_TTS_CACHE_MB. Without a reachable server, text2wave is used.
+ */
+int speechSynthesizeCached(const char *text, char **wavPathOut, char **summaryOut, char **error_out);
+
+/*
+ * Synthesizes sentence chunks on a worker thread while the calling thread
+ * streams finished PCM into a single mpv reading raw audio from a pipe, so the
+ * first sentence plays while the rest is still being synthesized. The joined
+ * audio is written to savePath when it is not NULL.
+ */
+int speechPlayPipelined(const char *text, double speed, const char *savePath, char **summaryOut, char **error_out);
+
+#endif
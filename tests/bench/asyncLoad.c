@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "ai.h"
+#include "ai_core/async.h"
+#include "ai_core/providers.h"
+
+/*
+ * Async core load test: starts mockProvider, builds N requests with a
+ * provider's AIRequestBuilder and drives them all from one thread through
+ * the epoll loop. Reports wall time, requests per second and latency
+ * percentiles as JSON on stdout and in --out.
+ */
+
+typedef struct {
+    double submittedMs;
+    double latencyMs;
+    int status;
+} LoadSlot;
+
+typedef struct {
+    size_t completed;
+    size_t failures;
+} LoadTotals;
+
+typedef struct {
+    LoadSlot *slot;
+    LoadTotals *totals;
+} LoadTicket;
+
+static double nowMs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e3 + (double)now.tv_nsec / 1e6;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double left = *(const double *)a;
+    double right = *(const double *)b;
+    return left < right ? -1 : left > right ? 1 : 0;
+}
+
+static double percentile(const double *sorted, size_t count, double fraction) {
+    if (count == 0) return 0;
+    size_t index = (size_t)(fraction * (double)(count - 1) + 0.5);
+    return sorted[index < count ? index : count - 1];
+}
+
+static pid_t startMock(const char *mockPath, int *portOut) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(mockPath, mockPath, "-p", "0", (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    char line[64] = { 0 };
+    ssize_t got = pid > 0 ? read(fds[0], line, sizeof(line) - 1) : -1;
+    close(fds[0]);
+    if (got <= 0 || sscanf(line, "port %d", portOut) != 1) {
+        if (pid > 0) kill(pid, SIGTERM);
+        return -1;
+    }
+    return pid;
+}
+
+static void onReply(void *user, int status, const char *response, size_t len) {
+    LoadTicket *ticket = user;
+    ticket->slot->latencyMs = nowMs() - ticket->slot->submittedMs;
+    ticket->slot->status = status;
+    ticket->totals->completed++;
+    if (status != 200 || len == 0) {
+        ticket->totals->failures++;
+        if (ticket->totals->failures == 1) fprintf(stderr, "asyncLoad: status %d: %.*s\n", status, (int)(len < 200 ? len : 200), response);
+    }
+}
+
+/* Thousands of sockets in flight need more than the default 1024 descriptors. */
+static void raiseFileLimit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: asyncLoad --mock PATH [--requests N] [--concurrency N] [--latency MS] [--provider NAME] [--out FILE]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *mock = NULL;
+    const char *outPath = NULL;
+    const char *providerName = "chatgpt";
+    size_t requests = 1000;
+    size_t concurrency = 0;
+    int latencyMs = 50;
+
+    static const struct option longOptions[] = {
+        { "mock", required_argument, NULL, 'm' },
+        { "requests", required_argument, NULL, 'n' },
+        { "concurrency", required_argument, NULL, 'c' },
+        { "latency", required_argument, NULL, 'l' },
+        { "provider", required_argument, NULL, 'p' },
+        { "out", required_argument, NULL, 'o' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:n:c:l:p:o:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'm': mock = optarg; break;
+            case 'n': requests = strtoul(optarg, NULL, 10); break;
+            case 'c': concurrency = strtoul(optarg, NULL, 10); break;
+            case 'l': latencyMs = atoi(optarg); break;
+            case 'p': providerName = optarg; break;
+            case 'o': outPath = optarg; break;
+            default: usage();
+        }
+    }
+    const AIProvider *provider = providerFind(providerName);
+    if (!mock || requests == 0 || !provider || !provider->builder) usage();
+
+    raiseFileLimit();
+    int port = 0;
+    pid_t mockPid = startMock(mock, &port);
+    if (mockPid < 0) {
+        fprintf(stderr, "asyncLoad: failed to start %s\n", mock);
+        return 1;
+    }
+
+    const char *path = provider->protocol == PROVIDER_OLLAMA ? "/api/generate" :
+                       provider->protocol == PROVIDER_ANTHROPIC ? "/v1/messages" : "/v1/chat/completions";
+    char url[256];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d%s?latency=%d&size=512", port, path, latencyMs);
+    AIConfig cfg = { 0 };
+    cfg.ai_type = provider->name;
+    cfg.provider = provider;
+    cfg.endpoint = url;
+    cfg.key_raw = "bench-key";
+
+    LoadSlot *slots = calloc(requests, sizeof(LoadSlot));
+    LoadTicket *tickets = calloc(requests, sizeof(LoadTicket));
+    double *samples = calloc(requests, sizeof(double));
+    AsyncLoop *loop = asyncLoopCreate(concurrency);
+    LoadTotals totals = { 0 };
+    int failed = !slots || !tickets || !samples || !loop;
+
+    double startMs = nowMs();
+    for (size_t i = 0; !failed && i < requests; ++i) {
+        tickets[i].slot = &slots[i];
+        tickets[i].totals = &totals;
+        slots[i].submittedMs = nowMs();
+        if (asyncSubmitCall(loop, &cfg, "Say hello from the load test.", "You are terse.", onReply, &tickets[i]) != 0) {
+            fprintf(stderr, "asyncLoad: submit %zu failed\n", i);
+            failed = 1;
+        }
+    }
+    if (!failed) asyncRun(loop);
+    double wallMs = nowMs() - startMs;
+    asyncLoopDestroy(loop);
+    kill(mockPid, SIGTERM);
+    waitpid(mockPid, NULL, 0);
+
+    size_t sampleCount = 0;
+    for (size_t i = 0; i < requests; ++i) {
+        if (slots[i].status == 200) samples[sampleCount++] = slots[i].latencyMs;
+    }
+    qsort(samples, sampleCount, sizeof(double), compareDoubles);
+
+    FILE *out = outPath ? fopen(outPath, "w") : NULL;
+    FILE *targets[] = { stdout, out };
+    for (size_t t = 0; t < 2; ++t) {
+        if (!targets[t]) continue;
+        fprintf(targets[t],
+            "{\"provider\":\"%s\",\"requests\":%zu,\"concurrency\":%zu,\"latencyMs\":%d,\"completed\":%zu,\"failures\":%zu,"
+            "\"wallMs\":%.1f,\"requestsPerSecond\":%.1f,\"p50Ms\":%.2f,\"p90Ms\":%.2f,\"p99Ms\":%.2f}\n",
+            provider->name, requests, concurrency, latencyMs, totals.completed, totals.failures,
+            wallMs, wallMs > 0 ? (double)totals.completed * 1000.0 / wallMs : 0.0,
+            percentile(samples, sampleCount, 0.5), percentile(samples, sampleCount, 0.9), percentile(samples, sampleCount, 0.99));
+    }
+    if (out) fclose(out);
+
+    free(slots);
+    free(tickets);
+    free(samples);
+    return failed || totals.failures || totals.completed != requests ? 1 : 0;
+}
@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * End-to-end benchmark: starts mockProvider, runs gipwrap against it for a
+ * fixed set of scenarios and reports latency percentiles, throughput with
+ * several runs in flight, peak RSS and syscall counts (one ptrace'd run,
+ * curl and sh included) as JSON on stdout and in --out.
+ */
+
+typedef struct {
+    const char *name;
+    const char *aiType;
+    const char *path;
+    int agent;
+    size_t inputBytes;
+    int latencyMs;
+    size_t payloadBytes;
+    int steps;
+} BenchScenario;
+
+typedef struct {
+    double *samplesMs;
+    size_t runs;
+    size_t failures;
+    long maxRssKb;
+    double throughput;
+    long syscalls;
+    int processes;
+} BenchResult;
+
+static const BenchScenario scenarios[] = {
+    { "standard-chatgpt", "chatgpt", "/v1/chat/completions", 0, 256, 0, 512, 0 },
+    { "standard-claude", "claude", "/v1/messages", 0, 256, 0, 512, 0 },
+    { "standard-deepseek", "deepseek", "/chat/completions", 0, 256, 0, 512, 0 },
+    { "standard-ollama", "ollama", "/api/generate", 0, 256, 0, 512, 0 },
+    { "standard-latency-50ms", "chatgpt", "/v1/chat/completions", 0, 256, 50, 512, 0 },
+    { "agent-3-steps", "ollama", "/api/generate", 1, 256, 0, 512, 3 },
+    { "large-input-24k", "chatgpt", "/v1/chat/completions", 0, 24576, 0, 512, 0 },
+    { "large-payload-1m", "ollama", "/api/generate", 0, 256, 0, 1048576, 0 },
+};
+
+static double nowMs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e3 + (double)now.tv_nsec / 1e6;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double left = *(const double *)a;
+    double right = *(const double *)b;
+    return left < right ? -1 : left > right ? 1 : 0;
+}
+
+static pid_t startMock(const char *mockPath, int *portOut) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(mockPath, mockPath, "-p", "0", (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    char line[64] = { 0 };
+    ssize_t got = pid > 0 ? read(fds[0], line, sizeof(line) - 1) : -1;
+    close(fds[0]);
+    if (got <= 0 || sscanf(line, "port %d", portOut) != 1) {
+        if (pid > 0) kill(pid, SIGTERM);
+        return -1;
+    }
+    return pid;
+}
+
+static char* writeInputFile(size_t bytes) {
+    char *path = strdup("/tmp/gipwrap_bench_XXXXXX");
+    int fd = path ? mkstemp(path) : -1;
+    if (fd < 0) {
+        free(path);
+        return NULL;
+    }
+
+    const char *words = "Summarise the following notes about latency budgets, \"quoted\" values and tabs\tin one line.\n";
+    size_t wordsLen = strlen(words);
+    char *text = malloc(bytes);
+    for (size_t i = 0; text && i < bytes; ++i) {
+        text[i] = words[i % wordsLen];
+    }
+    int ok = text && write(fd, text, bytes) == (ssize_t)bytes;
+    free(text);
+    close(fd);
+    if (!ok) {
+        unlink(path);
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+static pid_t spawnGipwrap(char *const argv[], const char *inputPath, int traced) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    int in = open(inputPath, O_RDONLY);
+    int devNull = open("/dev/null", O_WRONLY);
+    if (in < 0 || devNull < 0) _exit(127);
+    dup2(in, STDIN_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+    dup2(devNull, STDERR_FILENO);
+    if (traced) {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP);
+    }
+    execv(argv[0], argv);
+    _exit(127);
+}
+
+static int trackPid(pid_t **pids, size_t *count, size_t *cap, pid_t pid) {
+    for (size_t i = 0; i < *count; ++i) {
+        if ((*pids)[i] == pid) return 0;
+    }
+    if (*count == *cap) {
+        size_t newCap = *cap ? *cap * 2 : 16;
+        pid_t *resized = realloc(*pids, newCap * sizeof(pid_t));
+        if (!resized) return -1;
+        *pids = resized;
+        *cap = newCap;
+    }
+    (*pids)[(*count)++] = pid;
+    return 1;
+}
+
+/*
+ * Counts syscalls of the whole process tree (gipwrap, sh, curl) for one run.
+ * Tracees are tracked by pid because waitpid(-1) would also wait on the mock.
+ */
+static long countSyscalls(char *const argv[], const char *inputPath, int *processesOut) {
+    pid_t root = spawnGipwrap(argv, inputPath, 1);
+    int status;
+    if (root < 0 || waitpid(root, &status, 0) != root || !WIFSTOPPED(status)) return -1;
+
+    ptrace(PTRACE_SETOPTIONS, root, NULL, (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+           PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_SYSCALL, root, NULL, NULL);
+
+    pid_t *pids = NULL;
+    size_t pidCount = 0;
+    size_t pidCap = 0;
+    size_t exited = 0;
+    long stops = 0;
+    trackPid(&pids, &pidCount, &pidCap, root);
+    while (exited < pidCount) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        trackPid(&pids, &pidCount, &pidCap, pid);
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            exited++;
+            continue;
+        }
+        if (!WIFSTOPPED(status)) continue;
+
+        int signal = WSTOPSIG(status);
+        int event = status >> 16;
+        if (signal == (SIGTRAP | 0x80)) {
+            stops++;
+            signal = 0;
+        } else if (signal == SIGTRAP && event) {
+            unsigned long child = 0;
+            if ((event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK || event == PTRACE_EVENT_CLONE) &&
+                ptrace(PTRACE_GETEVENTMSG, pid, NULL, &child) == 0) {
+                trackPid(&pids, &pidCount, &pidCap, (pid_t)child);
+            }
+            signal = 0;
+        } else if (signal == SIGSTOP) {
+            /* Newly attached children start with a SIGSTOP. */
+            signal = 0;
+        }
+        ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)signal);
+    }
+
+    *processesOut = (int)pidCount;
+    free(pids);
+    return (stops + 1) / 2;
+}
+
+static int runScenario(const BenchScenario *scenario, const char *gipwrap, int port, size_t iterations, int concurrency, BenchResult *result) {
+    char *inputPath = writeInputFile(scenario->inputBytes);
+    if (!inputPath) return -1;
+
+    char url[256];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d%s?latency=%d&size=%zu&steps=%d",
+             port, scenario->path, scenario->latencyMs, scenario->payloadBytes, scenario->steps);
+    char *argv[] = {
+        (char *)gipwrap, "-a", (char *)scenario->aiType, "-u", url, "-K", "bench-key",
+        scenario->agent ? "-A" : NULL, NULL
+    };
+
+    memset(result, 0, sizeof(*result));
+    result->samplesMs = calloc(iterations, sizeof(double));
+    if (!result->samplesMs) {
+        unlink(inputPath);
+        free(inputPath);
+        return -1;
+    }
+
+    /* Warm the page cache and the mock before timing. */
+    int status;
+    pid_t warm = spawnGipwrap(argv, inputPath, 0);
+    if (warm > 0) waitpid(warm, &status, 0);
+
+    for (size_t i = 0; i < iterations; ++i) {
+        struct rusage usage;
+        double start = nowMs();
+        pid_t pid = spawnGipwrap(argv, inputPath, 0);
+        if (pid < 0 || wait4(pid, &status, 0, &usage) != pid) {
+            result->failures++;
+            continue;
+        }
+        double elapsed = nowMs() - start;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            result->failures++;
+            continue;
+        }
+        result->samplesMs[result->runs++] = elapsed;
+        if (usage.ru_maxrss > result->maxRssKb) result->maxRssKb = usage.ru_maxrss;
+    }
+
+    size_t started = 0;
+    size_t finished = 0;
+    int inFlight = 0;
+    double start = nowMs();
+    while (finished < iterations) {
+        while (inFlight < concurrency && started < iterations) {
+            if (spawnGipwrap(argv, inputPath, 0) > 0) inFlight++;
+            started++;
+        }
+        if (inFlight == 0) break;
+        if (wait(&status) > 0) {
+            inFlight--;
+            finished++;
+        }
+    }
+    double elapsed = nowMs() - start;
+    result->throughput = elapsed > 0 ? (double)finished * 1000.0 / elapsed : 0;
+
+    result->syscalls = countSyscalls(argv, inputPath, &result->processes);
+
+    unlink(inputPath);
+    free(inputPath);
+    return 0;
+}
+
+static double percentile(const double *sorted, size_t count, double fraction) {
+    if (count == 0) return 0;
+    size_t index = (size_t)(fraction * (double)(count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void writeResult(FILE *out, const BenchScenario *scenario, BenchResult *result, int last) {
+    qsort(result->samplesMs, result->runs, sizeof(double), compareDoubles);
+    double sum = 0;
+    for (size_t i = 0; i < result->runs; ++i) sum += result->samplesMs[i];
+    double mean = result->runs ? sum / (double)result->runs : 0;
+
+    fprintf(out,
+        "    {\"name\":\"%s\",\"provider\":\"%s\",\"agent\":%s,\"inputBytes\":%zu,\"latencyMs\":%d,\"payloadBytes\":%zu,"
+        "\"runs\":%zu,\"failures\":%zu,\"meanMs\":%.3f,\"minMs\":%.3f,\"p50Ms\":%.3f,\"p95Ms\":%.3f,\"maxMs\":%.3f,"
+        "\"throughputPerSec\":%.2f,\"maxRssKb\":%ld,\"syscalls\":%ld,\"processes\":%d}%s\n",
+        scenario->name, scenario->aiType, scenario->agent ? "true" : "false", scenario->inputBytes, scenario->latencyMs,
+        scenario->payloadBytes, result->runs, result->failures, mean,
+        result->runs ? result->samplesMs[0] : 0, percentile(result->samplesMs, result->runs, 0.5),
+        percentile(result->samplesMs, result->runs, 0.95), result->runs ? result->samplesMs[result->runs - 1] : 0,
+        result->throughput, result->maxRssKb, result->syscalls, result->processes, last ? "" : ",");
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: bench --gipwrap PATH --mock PATH [--iterations N] [--concurrency N] [--filter SUBSTRING] [--out FILE]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *gipwrap = NULL;
+    const char *mock = NULL;
+    const char *outPath = NULL;
+    const char *filter = NULL;
+    size_t iterations = 20;
+    int concurrency = 4;
+
+    static const struct option longOptions[] = {
+        { "gipwrap", required_argument, NULL, 'g' },
+        { "mock", required_argument, NULL, 'm' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "concurrency", required_argument, NULL, 'c' },
+        { "filter", required_argument, NULL, 'f' },
+        { "out", required_argument, NULL, 'o' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "g:m:n:c:f:o:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'g': gipwrap = optarg; break;
+            case 'm': mock = optarg; break;
+            case 'n': iterations = strtoul(optarg, NULL, 10); break;
+            case 'c': concurrency = atoi(optarg); break;
+            case 'f': filter = optarg; break;
+            case 'o': outPath = optarg; break;
+            default: usage();
+        }
+    }
+    if (!gipwrap || !mock || iterations == 0 || concurrency < 1) usage();
+
+    int port = 0;
+    pid_t mockPid = startMock(mock, &port);
+    if (mockPid < 0) {
+        fprintf(stderr, "bench: failed to start %s\n", mock);
+        return 1;
+    }
+
+    size_t scenarioCount = sizeof(scenarios) / sizeof(scenarios[0]);
+    BenchResult *results = calloc(scenarioCount, sizeof(BenchResult));
+    int *selected = calloc(scenarioCount, sizeof(int));
+    size_t selectedCount = 0;
+    int failed = !results || !selected;
+    for (size_t i = 0; !failed && i < scenarioCount; ++i) {
+        if (filter && !strstr(scenarios[i].name, filter)) continue;
+        fprintf(stderr, "bench: %s\n", scenarios[i].name);
+        if (runScenario(&scenarios[i], gipwrap, port, iterations, concurrency, &results[i]) != 0 || results[i].runs == 0) {
+            fprintf(stderr, "bench: %s failed\n", scenarios[i].name);
+            failed = 1;
+        }
+        selected[i] = 1;
+        selectedCount++;
+    }
+    kill(mockPid, SIGTERM);
+    waitpid(mockPid, NULL, 0);
+
+    FILE *out = outPath ? fopen(outPath, "w") : NULL;
+    FILE *targets[] = { stdout, out };
+    for (size_t t = 0; t < 2; ++t) {
+        if (!targets[t]) continue;
+        fprintf(targets[t], "{\"iterations\":%zu,\"concurrency\":%d,\"scenarios\":[\n", iterations, concurrency);
+        size_t written = 0;
+        for (size_t i = 0; i < scenarioCount; ++i) {
+            if (!selected || !selected[i]) continue;
+            writeResult(targets[t], &scenarios[i], &results[i], ++written == selectedCount);
+        }
+        fprintf(targets[t], "]}\n");
+    }
+    if (out) fclose(out);
+
+    for (size_t i = 0; results && i < scenarioCount; ++i) free(results[i].samplesMs);
+    free(results);
+    free(selected);
+    return failed ? 1 : 0;
+}
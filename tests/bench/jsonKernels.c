@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ai_core/core.h"
+#include "ai_core/jsonEscape.h"
+
+/*
+ * Microbenchmark for the JSON string kernels declared in
+ * ai_core/jsonEscape.h (each provider's escaper and the tools' one) and
+ * find_json_string (scan plus unescape of a chat completion "content").
+ * Each kernel runs over ASCII prose, escape-heavy text and multi-byte UTF-8
+ * at sizes from 1 KB to 100 MB. After a warmup, every repetition times
+ * enough iterations to last about 20 ms; the median, spread and cycles per
+ * byte (perf cycle counter, else TSC) are reported as JSON.
+ */
+
+typedef enum {
+    KERNEL_ESCAPE_ALLOC,
+    KERNEL_ESCAPE_BUFFER,
+    KERNEL_FIND
+} KernelShape;
+
+typedef struct {
+    const char *name;
+    KernelShape shape;
+    char* (*escapeAlloc)(const char *str);
+} JsonKernel;
+
+typedef struct {
+    const char *name;
+    char *text;
+    char *document;
+    size_t bytes;
+} Corpus;
+
+static const JsonKernel kernels[] = {
+    { "claudeEscapeJson", KERNEL_ESCAPE_ALLOC, claudeEscapeJson },
+    { "deepseekEscapeJson", KERNEL_ESCAPE_ALLOC, deepseekEscapeJson },
+    { "ollamaEscapeJson", KERNEL_ESCAPE_ALLOC, ollamaEscapeJson },
+    { "chatgptEscapeJson", KERNEL_ESCAPE_BUFFER, NULL },
+    { "toolsEscapeJson", KERNEL_ESCAPE_ALLOC, toolsEscapeJson },
+    { "find_json_string", KERNEL_FIND, NULL },
+};
+
+static int cycleFd = -1;
+static const char *cycleSource = "none";
+
+static double nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static void openCycleCounter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cycleFd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (cycleFd >= 0) {
+        ioctl(cycleFd, PERF_EVENT_IOC_ENABLE, 0);
+        cycleSource = "perf";
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    cycleSource = "tsc";
+#endif
+}
+
+static unsigned long long readCycles(void) {
+    if (cycleFd >= 0) {
+        unsigned long long count = 0;
+        if (read(cycleFd, &count, sizeof(count)) == (ssize_t)sizeof(count)) return count;
+        return 0;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Fills size bytes (plus NUL) by repeating seed, never splitting a UTF-8 sequence. */
+static char* repeatSeed(const char *seed, size_t size) {
+    size_t seedLen = strlen(seed);
+    char *text = malloc(size + 1);
+    if (!text) return NULL;
+
+    size_t len = 0;
+    while (len + seedLen <= size) {
+        memcpy(text + len, seed, seedLen);
+        len += seedLen;
+    }
+    while (len < size) text[len++] = ' ';
+    text[len] = '\0';
+    return text;
+}
+
+static char* buildDocument(const char *text) {
+    char *escaped = toolsEscapeJson(text);
+    if (!escaped) return NULL;
+
+    const char *head = "{\"id\":\"chatcmpl-bench\",\"object\":\"chat.completion\",\"model\":\"bench\",\"choices\":[{\"index\":0,"
+                       "\"message\":{\"role\":\"assistant\",\"content\":\"";
+    const char *tail = "\"},\"finish_reason\":\"stop\"}],\"usage\":{\"prompt_tokens\":1,\"completion_tokens\":1}}";
+    size_t len = strlen(head) + strlen(escaped) + strlen(tail) + 1;
+    char *document = malloc(len);
+    if (document) snprintf(document, len, "%s%s%s", head, escaped, tail);
+    free(escaped);
+    return document;
+}
+
+static size_t runKernel(const JsonKernel *kernel, const Corpus *corpus, char *buffer, size_t bufferSize) {
+    size_t produced = 0;
+    if (kernel->shape == KERNEL_ESCAPE_ALLOC) {
+        char *out = kernel->escapeAlloc(corpus->text);
+        if (out) produced = strlen(out);
+        free(out);
+    } else if (kernel->shape == KERNEL_ESCAPE_BUFFER) {
+        chatgptEscapeJson(corpus->text, buffer, bufferSize);
+        produced = strlen(buffer);
+    } else {
+        const char *message = strstr(corpus->document, "\"message\"");
+        char *out = message ? find_json_string(message, "content") : NULL;
+        if (out) produced = strlen(out);
+        free(out);
+    }
+    return produced;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double left = *(const double *)a;
+    double right = *(const double *)b;
+    return left < right ? -1 : left > right ? 1 : 0;
+}
+
+static void measure(FILE *out, const JsonKernel *kernel, const Corpus *corpus, int repetitions, int *first) {
+    size_t bufferSize = corpus->bytes * 2 + 8;
+    char *buffer = kernel->shape == KERNEL_ESCAPE_BUFFER ? malloc(bufferSize) : NULL;
+    double *nsPerByte = calloc((size_t)repetitions, sizeof(double));
+    double *cyclesPerByte = calloc((size_t)repetitions, sizeof(double));
+    if ((kernel->shape == KERNEL_ESCAPE_BUFFER && !buffer) || !nsPerByte || !cyclesPerByte) {
+        free(buffer);
+        free(nsPerByte);
+        free(cyclesPerByte);
+        return;
+    }
+
+    /* Warmup: at least 3 calls and 50 ms, which also sizes the iteration count. */
+    size_t produced = 0;
+    size_t warmCalls = 0;
+    double warmStart = nowNs();
+    while (warmCalls < 3 || nowNs() - warmStart < 50e6) {
+        produced = runKernel(kernel, corpus, buffer, bufferSize);
+        warmCalls++;
+    }
+    double perCall = (nowNs() - warmStart) / (double)warmCalls;
+    size_t iterations = perCall > 0 ? (size_t)(20e6 / perCall) : 1;
+    if (iterations == 0) iterations = 1;
+
+    for (int r = 0; r < repetitions; ++r) {
+        unsigned long long cycleStart = readCycles();
+        double start = nowNs();
+        for (size_t i = 0; i < iterations; ++i) {
+            runKernel(kernel, corpus, buffer, bufferSize);
+        }
+        double elapsed = nowNs() - start;
+        unsigned long long cycles = readCycles() - cycleStart;
+        double bytes = (double)corpus->bytes * (double)iterations;
+        nsPerByte[r] = elapsed / bytes;
+        cyclesPerByte[r] = (double)cycles / bytes;
+    }
+
+    double mean = 0;
+    for (int r = 0; r < repetitions; ++r) mean += nsPerByte[r];
+    mean /= repetitions;
+    double variance = 0;
+    for (int r = 0; r < repetitions; ++r) variance += (nsPerByte[r] - mean) * (nsPerByte[r] - mean);
+    double stddevPct = repetitions > 1 && mean > 0 ? sqrt(variance / (repetitions - 1)) / mean * 100.0 : 0;
+
+    qsort(nsPerByte, (size_t)repetitions, sizeof(double), compareDoubles);
+    qsort(cyclesPerByte, (size_t)repetitions, sizeof(double), compareDoubles);
+    double median = nsPerByte[repetitions / 2];
+    double best = nsPerByte[0];
+    double worst = nsPerByte[repetitions - 1];
+
+    fprintf(stderr, "%-24s %-13s %10zu B  %7.3f GB/s  %6.2f cyc/B  +-%.1f%%\n", kernel->name, corpus->name, corpus->bytes,
+            1.0 / median, cyclesPerByte[repetitions / 2], stddevPct);
+    fprintf(out,
+        "%s    {\"kernel\":\"%s\",\"corpus\":\"%s\",\"bytes\":%zu,\"outputBytes\":%zu,\"iterations\":%zu,\"repetitions\":%d,"
+        "\"medianGBps\":%.4f,\"bestGBps\":%.4f,\"worstGBps\":%.4f,\"stddevPct\":%.2f,\"cyclesPerByte\":%.4f,\"cycleSource\":\"%s\"}",
+        *first ? "" : ",\n", kernel->name, corpus->name, corpus->bytes, produced, iterations, repetitions,
+        1.0 / median, 1.0 / best, 1.0 / worst, stddevPct, cyclesPerByte[repetitions / 2], cycleSource);
+    *first = 0;
+
+    free(buffer);
+    free(nsPerByte);
+    free(cyclesPerByte);
+}
+
+static size_t parseSize(const char *text) {
+    char *end = NULL;
+    double value = strtod(text, &end);
+    if (end && (*end == 'k' || *end == 'K')) value *= 1024;
+    if (end && (*end == 'm' || *end == 'M')) value *= 1024 * 1024;
+    return value > 0 ? (size_t)value : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: jsonKernels [--sizes 1k,64k,1m,16m,100m] [--repetitions N] [--filter SUBSTRING] [--out FILE]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *sizeList = "1k,64k,1m,16m,100m";
+    const char *filter = NULL;
+    const char *outPath = NULL;
+    int repetitions = 11;
+
+    static const struct option longOptions[] = {
+        { "sizes", required_argument, NULL, 's' },
+        { "repetitions", required_argument, NULL, 'r' },
+        { "filter", required_argument, NULL, 'f' },
+        { "out", required_argument, NULL, 'o' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:r:f:o:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 's': sizeList = optarg; break;
+            case 'r': repetitions = atoi(optarg); break;
+            case 'f': filter = optarg; break;
+            case 'o': outPath = optarg; break;
+            default: usage();
+        }
+    }
+    if (repetitions < 1) usage();
+
+    const struct {
+        const char *name;
+        const char *seed;
+    } seeds[] = {
+        { "ascii", "The request body is built once per call and then copied into a temporary file for curl. " },
+        { "heavy-escape", "\"key\":\"C:\\\\path\\\\to\\\\file\"\n\t{\"nested\":\"\\\"quoted\\\"\"}\r\n" },
+        { "utf8", "Grüße aus Köln, naïve café. 日本語のテキストと中文字符。 Ελληνικά и русский текст 🙂🚀 " },
+    };
+
+    openCycleCounter();
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        perror(outPath);
+        return 1;
+    }
+    fprintf(out, "{\"cycleSource\":\"%s\",\"results\":[\n", cycleSource);
+
+    int first = 1;
+    char *sizes = strdup(sizeList);
+    for (char *save = NULL, *token = strtok_r(sizes, ",", &save); token; token = strtok_r(NULL, ",", &save)) {
+        size_t size = parseSize(token);
+        if (size == 0) continue;
+
+        for (size_t s = 0; s < sizeof(seeds) / sizeof(seeds[0]); ++s) {
+            Corpus corpus = { seeds[s].name, repeatSeed(seeds[s].seed, size), NULL, size };
+            corpus.document = corpus.text ? buildDocument(corpus.text) : NULL;
+            if (!corpus.document) {
+                fprintf(stderr, "jsonKernels: out of memory at %zu bytes\n", size);
+                free(corpus.text);
+                continue;
+            }
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+                if (filter && !strstr(kernels[k].name, filter) && !strstr(corpus.name, filter)) continue;
+                measure(out, &kernels[k], &corpus, repetitions, &first);
+                fflush(out);
+            }
+            free(corpus.text);
+            free(corpus.document);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    free(sizes);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+/*
+ * Local stand-in for the chatgpt/deepseek, claude and ollama endpoints.
+ * The response shape follows the request path; the query string tunes it:
+ *   latency=MS   delay before replying
+ *   size=BYTES   length of the reply text
+ *   steps=N      agent tool steps before answering "done" (default 1)
+ *   chunk=BYTES  reply text per event when the request asks to stream (default 16)
+ *   gap=MS       delay between streamed events
+ * Agent requests are recognised by gipwrap's agent system prompt and answered
+ * with status "continue" (listDir) until the conversation holds N steps.
+ * Requests with "stream":true get SSE (openai, anthropic) or NDJSON (ollama).
+ * Prints "port N" on stdout once listening.
+ */
+
+typedef struct {
+    int latencyMs;
+    size_t size;
+    int steps;
+    size_t chunk;
+    int gapMs;
+} MockQuery;
+
+static char* duplicateString(const char *src) {
+    if (!src) return NULL;
+    size_t len = strlen(src);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len + 1);
+    return out;
+}
+
+static int sendAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) return -1;
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+static long queryValue(const char *query, const char *key, long fallback) {
+    size_t keyLen = strlen(key);
+    for (const char *p = query; p && *p; ) {
+        if (strncmp(p, key, keyLen) == 0 && p[keyLen] == '=') {
+            return strtol(p + keyLen + 1, NULL, 10);
+        }
+        p = strchr(p, '&');
+        if (p) p++;
+    }
+    return fallback;
+}
+
+static size_t countOccurrences(const char *haystack, const char *needle) {
+    size_t count = 0;
+    size_t needleLen = strlen(needle);
+    for (const char *p = strstr(haystack, needle); p; p = strstr(p + needleLen, needle)) {
+        count++;
+    }
+    return count;
+}
+
+/* Reply text as it appears inside the outer JSON string, i.e. already escaped. */
+static char* buildReplyText(const char *body, const MockQuery *query) {
+    const char *filler = "The quick brown fox jumps over the lazy dog. ";
+    size_t fillerLen = strlen(filler);
+    size_t size = query->size ? query->size : 1;
+    char *text = malloc(size + 256);
+    if (!text) return NULL;
+
+    size_t len = 0;
+    int agent = strstr(body, "Respond exclusively in JSON") != NULL;
+    if (agent && countOccurrences(body, "[agent step ") < (size_t)query->steps) {
+        sprintf(text, "{\\\"status\\\":\\\"continue\\\",\\\"message\\\":\\\"listing\\\",\\\"tool\\\":\\\"listDir\\\",\\\"toolInput\\\":\\\".\\\"}");
+        return text;
+    }
+    if (agent) {
+        len = (size_t)sprintf(text, "{\\\"status\\\":\\\"done\\\",\\\"message\\\":\\\"");
+    }
+    for (size_t i = 0; i < size; ++i) {
+        text[len++] = filler[i % fillerLen];
+    }
+    if (agent) {
+        len += (size_t)sprintf(text + len, "\\\"}");
+    }
+    text[len] = '\0';
+    return text;
+}
+
+static char* buildResponse(const char *path, const char *body, size_t bodyLen, const MockQuery *query) {
+    char *text = buildReplyText(body, query);
+    if (!text) return NULL;
+
+    size_t promptTokens = bodyLen / 4 + 1;
+    size_t completionTokens = strlen(text) / 4 + 1;
+    size_t cap = strlen(text) + 512;
+    char *json = malloc(cap);
+    if (!json) {
+        free(text);
+        return NULL;
+    }
+
+    if (strstr(path, "/v1/messages")) {
+        snprintf(json, cap,
+            "{\"id\":\"msg_mock\",\"type\":\"message\",\"role\":\"assistant\",\"model\":\"mock\","
+            "\"content\":[{\"type\":\"text\",\"text\":\"%s\"}],\"stop_reason\":\"end_turn\","
+            "\"usage\":{\"input_tokens\":%zu,\"output_tokens\":%zu}}", text, promptTokens, completionTokens);
+    } else if (strstr(path, "/api/generate")) {
+        snprintf(json, cap,
+            "{\"model\":\"mock\",\"response\":\"%s\",\"done\":true,"
+            "\"prompt_eval_count\":%zu,\"eval_count\":%zu,\"eval_duration\":1000000}", text, promptTokens, completionTokens);
+    } else {
+        snprintf(json, cap,
+            "{\"id\":\"chatcmpl-mock\",\"object\":\"chat.completion\",\"model\":\"mock\","
+            "\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":\"%s\"},\"finish_reason\":\"stop\"}],"
+            "\"usage\":{\"prompt_tokens\":%zu,\"completion_tokens\":%zu,\"total_tokens\":%zu}}",
+            text, promptTokens, completionTokens, promptTokens + completionTokens);
+    }
+    free(text);
+    return json;
+}
+
+static int sendFormatted(int fd, const char *fmt, ...) {
+    char event[8192];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(event, sizeof(event), fmt, args);
+    va_end(args);
+    if (len < 0 || (size_t)len >= sizeof(event)) return -1;
+    return sendAll(fd, event, (size_t)len);
+}
+
+/* Streams the reply in query->chunk sized events, never splitting an escape sequence. */
+static void serveStream(int fd, const char *path, const char *body, size_t bodyLen, const MockQuery *query) {
+    char *text = buildReplyText(body, query);
+    if (!text) return;
+    size_t promptTokens = bodyLen / 4 + 1;
+    size_t completionTokens = strlen(text) / 4 + 1;
+
+    const char *eventFmt;
+    const char *header;
+    if (strstr(path, "/v1/messages")) {
+        header = "Content-Type: text/event-stream";
+        eventFmt = "event: content_block_delta\ndata: {\"type\":\"content_block_delta\",\"index\":0,"
+                   "\"delta\":{\"type\":\"text_delta\",\"text\":\"%.*s\"}}\n\n";
+    } else if (strstr(path, "/api/generate")) {
+        header = "Content-Type: application/x-ndjson";
+        eventFmt = "{\"model\":\"mock\",\"response\":\"%.*s\",\"done\":false}\n";
+    } else {
+        header = "Content-Type: text/event-stream";
+        eventFmt = "data: {\"id\":\"chatcmpl-mock\",\"object\":\"chat.completion.chunk\","
+                   "\"choices\":[{\"index\":0,\"delta\":{\"content\":\"%.*s\"}}],\"usage\":null}\n\n";
+    }
+
+    char head[256];
+    int headLen = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n%s\r\nConnection: close\r\n\r\n", header);
+    int ok = sendAll(fd, head, (size_t)headLen) == 0;
+    if (ok && strstr(path, "/v1/messages")) {
+        ok = sendFormatted(fd, "event: message_start\ndata: {\"type\":\"message_start\",\"message\":{\"id\":\"msg_mock\","
+                           "\"usage\":{\"input_tokens\":%zu,\"output_tokens\":1}}}\n\n", promptTokens) == 0;
+    }
+
+    size_t chunk = query->chunk ? query->chunk : 16;
+    if (chunk > 2048) chunk = 2048;
+    for (size_t pos = 0, len = strlen(text); ok && pos < len; ) {
+        size_t take = len - pos < chunk ? len - pos : chunk;
+        size_t backslashes = 0;
+        while (backslashes < take && text[pos + take - 1 - backslashes] == '\\') backslashes++;
+        if (backslashes % 2 && pos + take < len) take++;
+        ok = sendFormatted(fd, eventFmt, (int)take, text + pos) == 0;
+        pos += take;
+        if (query->gapMs > 0) usleep((useconds_t)query->gapMs * 1000);
+    }
+
+    if (ok && strstr(path, "/v1/messages")) {
+        sendFormatted(fd, "event: message_delta\ndata: {\"type\":\"message_delta\",\"delta\":{\"stop_reason\":\"end_turn\"},"
+                      "\"usage\":{\"input_tokens\":%zu,\"output_tokens\":%zu}}\n\nevent: message_stop\ndata: {\"type\":\"message_stop\"}\n\n",
+                      promptTokens, completionTokens);
+    } else if (ok && strstr(path, "/api/generate")) {
+        sendFormatted(fd, "{\"model\":\"mock\",\"response\":\"\",\"done\":true,\"prompt_eval_count\":%zu,\"eval_count\":%zu}\n",
+                      promptTokens, completionTokens);
+    } else if (ok) {
+        sendFormatted(fd, "data: {\"id\":\"chatcmpl-mock\",\"object\":\"chat.completion.chunk\",\"choices\":[],"
+                      "\"usage\":{\"prompt_tokens\":%zu,\"completion_tokens\":%zu}}\n\ndata: [DONE]\n\n",
+                      promptTokens, completionTokens);
+    }
+    free(text);
+}
+
+static void* serveConnection(void *arg) {
+    int fd = (int)(long)arg;
+    size_t cap = 65536;
+    size_t len = 0;
+    char *request = malloc(cap + 1);
+    char *headerEnd = NULL;
+    size_t contentLength = 0;
+
+    while (request) {
+        if (len == cap) {
+            char *resized = realloc(request, cap * 2 + 1);
+            if (!resized) break;
+            request = resized;
+            cap *= 2;
+        }
+        ssize_t got = recv(fd, request + len, cap - len, 0);
+        if (got <= 0) break;
+        len += (size_t)got;
+        request[len] = '\0';
+
+        if (!headerEnd) {
+            headerEnd = strstr(request, "\r\n\r\n");
+            if (!headerEnd) continue;
+            const char *lengthHeader = strcasestr(request, "\r\nContent-Length:");
+            if (lengthHeader && lengthHeader < headerEnd) {
+                contentLength = strtoul(lengthHeader + 17, NULL, 10);
+            }
+        }
+        if (len >= (size_t)(headerEnd - request) + 4 + contentLength) break;
+    }
+
+    if (request && headerEnd) {
+        size_t headerLen = (size_t)(headerEnd - request);
+        char *body = headerEnd + 4;
+        char *pathStart = strchr(request, ' ');
+        char *pathEnd = pathStart ? strchr(pathStart + 1, ' ') : NULL;
+        if (pathStart && pathEnd) {
+            *pathEnd = '\0';
+            char *path = duplicateString(pathStart + 1);
+            char *query = path ? strchr(path, '?') : NULL;
+            if (query) *query++ = '\0';
+
+            MockQuery settings = {
+                .latencyMs = (int)queryValue(query, "latency", 0),
+                .size = (size_t)queryValue(query, "size", 256),
+                .steps = (int)queryValue(query, "steps", 1),
+                .chunk = (size_t)queryValue(query, "chunk", 16),
+                .gapMs = (int)queryValue(query, "gap", 0)
+            };
+            if (settings.latencyMs > 0) usleep((useconds_t)settings.latencyMs * 1000);
+
+            if (path && strstr(body, "\"stream\":true")) {
+                serveStream(fd, path, body, len - headerLen - 4, &settings);
+                free(path);
+                free(request);
+                close(fd);
+                return NULL;
+            }
+
+            char *json = path ? buildResponse(path, body, len - headerLen - 4, &settings) : NULL;
+            if (json) {
+                char header[256];
+                int headerBytes = snprintf(header, sizeof(header),
+                    "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", strlen(json));
+                if (sendAll(fd, header, (size_t)headerBytes) == 0) {
+                    sendAll(fd, json, strlen(json));
+                }
+                free(json);
+            }
+            free(path);
+        }
+    }
+
+    free(request);
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int port = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:h")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: mockProvider [-p port]\n");
+                return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    socklen_t addrLen = sizeof(addr);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 128) != 0 ||
+        getsockname(listener, (struct sockaddr *)&addr, &addrLen) != 0) {
+        perror("mockProvider");
+        return 1;
+    }
+
+    printf("port %d\n", ntohs(addr.sin_port));
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) continue;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serveConnection, (void *)(long)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
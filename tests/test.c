@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ai_core/providers.h"
+#include "tools/fileSearch.h"
+#include "tools/memoryVector.h"
+
+/*
+ * Regression tests, run by make test. Each check prints a FAIL line and
+ * the run exits non-zero if any fails.
+ */
+
+static int failures;
+
+static void check(int ok, const char *what, const char *detail) {
+    if (!ok) {
+        failures++;
+        fprintf(stderr, "FAIL %s: %s\n", what, detail ? detail : "(null)");
+    }
+}
+
+static int writeFile(const char *dir, const char *name, const char *text) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+    fputs(text, file);
+    return fclose(file);
+}
+
+static char* search(const char *root, const char *pattern) {
+    FileSearchOptions options;
+    memset(&options, 0, sizeof(options));
+    options.walk.root = root;
+    options.walk.maxEntries = 200;
+    options.pattern = pattern;
+    char *error = NULL;
+    char *out = fileSearchRun(&options, &error);
+    if (!out) return error;
+    free(error);
+    return out;
+}
+
+/* The literal prefilter must never reject a line the regex matches. */
+static void testSearchPrefilter(void) {
+    char dir[] = "/tmp/gipwrap_test_XXXXXX";
+    if (!mkdtemp(dir)) {
+        check(0, "searchFiles prefilter", "mkdtemp failed");
+        return;
+    }
+    writeFile(dir, "sample.txt", "xxy\nabbcd\nword end\nmore words\n");
+
+    static const struct {
+        const char *pattern;
+        const char *line;
+    } cases[] = {
+        { "x{2}y", "xxy" },
+        { "ab{0,2}cd", "abbcd" },
+        { "ab*cd", "abbcd" },
+        { "ab+cd", "abbcd" },
+        { "\\<word\\>", "word end" },
+        { "end\\'", "word end" },
+        { "\\`more", "more words" },
+        { "wor[dk]s?", "word end" },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        char *out = search(dir, cases[i].pattern);
+        check(out && strstr(out, cases[i].line) != NULL, cases[i].pattern, out);
+        free(out);
+    }
+    char *none = search(dir, "x{3}y");
+    check(none && strstr(none, "No matches") != NULL, "x{3}y", none);
+    free(none);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/sample.txt", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+/* A [provider] section without a url must not reach the request builders with a NULL url. */
+static void testProviderWithoutUrl(void) {
+    char home[] = "/tmp/gipwrap_test_XXXXXX";
+    if (!mkdtemp(home)) {
+        check(0, "provider without url", "mkdtemp failed");
+        return;
+    }
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/.gipwrap", home);
+    mkdir(dir, 0700);
+    writeFile(dir, "config",
+              "[provider nourl]\nmodel = some-model\n"
+              "[provider claude]\nurl =\n"
+              "[provider local]\nurl = http://127.0.0.1:8000/v1/chat/completions\n");
+
+    char *savedHome = getenv("HOME") ? strdup(getenv("HOME")) : NULL;
+    setenv("HOME", home, 1);
+    const AIProvider *nourl = providerFind("nourl");
+    const AIProvider *claude = providerFind("claude");
+    const AIProvider *local = providerFind("local");
+    check(nourl == NULL, "provider without url", nourl ? nourl->url : NULL);
+    check(claude && claude->url, "built-in provider with empty url", claude ? claude->url : NULL);
+    check(local && local->url, "provider with url", local ? local->url : NULL);
+    if (savedHome) {
+        setenv("HOME", savedHome, 1);
+    } else {
+        unsetenv("HOME");
+    }
+    free(savedHome);
+
+    char path[600];
+    snprintf(path, sizeof(path), "%s/config", dir);
+    unlink(path);
+    rmdir(dir);
+    rmdir(home);
+}
+
+static uint64_t randomState = 88172645463325252ull;
+
+static double randomGauss(void) {
+    double u[2];
+    for (int i = 0; i < 2; ++i) {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 7;
+        randomState ^= randomState << 17;
+        u[i] = (double)(randomState >> 11) / 9007199254740992.0;
+    }
+    return sqrt(-2.0 * log(u[0] + 1e-12)) * cos(6.283185307179586 * u[1]);
+}
+
+static void normalize(float *vector, uint32_t dim) {
+    double norm = 0.0;
+    for (uint32_t i = 0; i < dim; ++i) norm += (double)vector[i] * vector[i];
+    for (uint32_t i = 0; i < dim; ++i) vector[i] = (float)(vector[i] / sqrt(norm));
+}
+
+/*
+ * recall@10 of the sign-bit prefilter against an exact scan, on clustered
+ * vectors that share a common offset the way real embeddings do.
+ */
+static void testVectorRecall(void) {
+    enum { DIM = 256, COUNT = 8192, CLUSTERS = 64, K = 10, QUERIES = 50 };
+    char dir[] = "/tmp/gipwrap_test_XXXXXX";
+    float *vectors = malloc((size_t)COUNT * DIM * sizeof(float));
+    float *centers = malloc((size_t)CLUSTERS * DIM * sizeof(float));
+    float offset[DIM];
+    if (!vectors || !centers || !mkdtemp(dir)) {
+        check(0, "memory vector recall", "setup failed");
+        free(vectors);
+        free(centers);
+        return;
+    }
+    char vecPath[512];
+    char bitsPath[600];
+    snprintf(vecPath, sizeof(vecPath), "%s/memory.vec", dir);
+    snprintf(bitsPath, sizeof(bitsPath), "%s.bits", vecPath);
+
+    for (uint32_t i = 0; i < DIM; ++i) offset[i] = (float)(2.0 * randomGauss());
+    for (size_t i = 0; i < (size_t)CLUSTERS * DIM; ++i) centers[i] = (float)randomGauss();
+    int appended = 1;
+    for (size_t r = 0; r < COUNT && appended; ++r) {
+        float *vector = vectors + r * DIM;
+        for (uint32_t i = 0; i < DIM; ++i) vector[i] = (float)(offset[i] + centers[(r % CLUSTERS) * DIM + i] + 0.8 * randomGauss());
+        normalize(vector, DIM);
+        float copy[DIM];
+        memcpy(copy, vector, sizeof(copy));
+        appended = memoryVectorAppend(vecPath, r + 1, 1, copy, DIM, NULL) == 0;
+    }
+    check(appended, "memory vector recall", "append failed");
+
+    size_t matched = 0;
+    for (int q = 0; appended && q < QUERIES; ++q) {
+        float query[DIM];
+        const float *base = vectors + (size_t)(q * 97 % COUNT) * DIM;
+        for (uint32_t i = 0; i < DIM; ++i) query[i] = (float)(base[i] + 0.1 * randomGauss());
+        normalize(query, DIM);
+
+        double best[K];
+        uint64_t bestId[K];
+        size_t found = 0;
+        for (size_t r = 0; r < COUNT; ++r) {
+            double dot = 0.0;
+            for (uint32_t i = 0; i < DIM; ++i) dot += (double)query[i] * vectors[r * DIM + i];
+            if (found == K && dot <= best[K - 1]) continue;
+            size_t pos = found < K ? found++ : K - 1;
+            for (; pos > 0 && best[pos - 1] < dot; --pos) {
+                best[pos] = best[pos - 1];
+                bestId[pos] = bestId[pos - 1];
+            }
+            best[pos] = dot;
+            bestId[pos] = r + 1;
+        }
+
+        MemoryVectorHit hits[K];
+        size_t hitCount = memoryVectorSearch(vecPath, query, DIM, 0, 0, hits, K);
+        for (size_t i = 0; i < K; ++i) {
+            for (size_t j = 0; j < hitCount; ++j) matched += hits[j].id == bestId[i];
+        }
+    }
+    double recall = (double)matched / (QUERIES * K);
+    char detail[64];
+    snprintf(detail, sizeof(detail), "recall@%d %.3f", K, recall);
+    check(recall >= 0.85, "memory vector recall", detail);
+
+    unlink(bitsPath);
+    unlink(vecPath);
+    rmdir(dir);
+    free(vectors);
+    free(centers);
+}
+
+int main(void) {
+    testSearchPrefilter();
+    testProviderWithoutUrl();
+    testVectorRecall();
+    if (failures) {
+        fprintf(stderr, "%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}